@@ -0,0 +1,167 @@
+/*
+ * Line-oriented control socket for the long-running sender/receiver agents
+ *
+ * Endpoints:
+ *   unix:<path>            Unix domain socket (a bare path means the same)
+ *   tcp:[<addr>:]<port>    TCP on <addr>, loopback if omitted; give 0.0.0.0 for a
+ *                          docker published or QEMU hostfwd port inside the guest
+ *   vsock:<port>           AF_VSOCK, reachable from the host as <guest-cid>:<port>
+ *
+ * Clients are served one at a time. Every request is a single text line,
+ * every reply is a single line: the CSV record the one-shot tool would
+ * print, or "ERR <reason>". "QUIT" closes the connection, "SHUTDOWN" stops
+ * the agent. There is no authentication: whoever reaches the endpoint can
+ * drive the agent, so keep it on loopback or a published port that is.
+ */
+
+#ifndef AGENT_H
+#define AGENT_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/vm_sockets.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define AGENT_BACKLOG 4
+
+// Handles one request line and writes exactly one reply line to out.
+typedef void (*agent_handler)(char *line, FILE *out, void *ctx);
+
+static int agent_listen(const char *endpoint)
+{
+    int fd = -1;
+
+    if (strncmp(endpoint, "tcp:", 4) == 0) {
+        struct sockaddr_in addr;
+        const char *spec = endpoint + 4;
+        const char *colon = strrchr(spec, ':');
+        int one = 1;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (colon) {
+            char host[64];
+            snprintf(host, sizeof(host), "%.*s", (int)(colon - spec), spec);
+            if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+                fprintf(stderr, "Invalid listen address %s\n", host);
+                return -1;
+            }
+            spec = colon + 1;
+        }
+        addr.sin_port = htons((uint16_t)strtoul(spec, NULL, 10));
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd == -1)
+            goto fail;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+            goto fail;
+    } else if (strncmp(endpoint, "vsock:", 6) == 0) {
+        struct sockaddr_vm addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.svm_family = AF_VSOCK;
+        addr.svm_cid = VMADDR_CID_ANY;
+        addr.svm_port = strtoul(endpoint + 6, NULL, 10);
+
+        fd = socket(AF_VSOCK, SOCK_STREAM, 0);
+        if (fd == -1)
+            goto fail;
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+            goto fail;
+    } else {
+        struct sockaddr_un addr;
+        const char *path = strncmp(endpoint, "unix:", 5) == 0 ? endpoint + 5 : endpoint;
+
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "Socket path too long: %s\n", path);
+            return -1;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+
+        unlink(path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+            goto fail;
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+            goto fail;
+    }
+
+    if (listen(fd, AGENT_BACKLOG) == -1)
+        goto fail;
+    return fd;
+
+fail:
+    fprintf(stderr, "Cannot listen on %s: %s\n", endpoint, strerror(errno));
+    if (fd != -1)
+        close(fd);
+    return -1;
+}
+
+// Accept clients and dispatch their request lines until SHUTDOWN.
+static int agent_serve(int listen_fd, agent_handler handler, void *ctx)
+{
+    bool shutdown_requested = false;
+
+    // A client going away mid-reply must not kill the agent.
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!shutdown_requested) {
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("accept");
+            return -1;
+        }
+
+        FILE *in = fdopen(conn, "r");
+        FILE *out = fdopen(dup(conn), "w");
+        if (!in || !out) {
+            perror("fdopen");
+            if (in) fclose(in); else close(conn);
+            if (out) fclose(out);
+            continue;
+        }
+
+        char *line = NULL;
+        size_t cap = 0;
+        ssize_t len;
+        while ((len = getline(&line, &cap, in)) > 0) {
+            while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+                line[--len] = '\0';
+            if (len == 0)
+                continue;
+
+            if (strcmp(line, "QUIT") == 0)
+                break;
+            if (strcmp(line, "SHUTDOWN") == 0) {
+                shutdown_requested = true;
+                break;
+            }
+
+            handler(line, out, ctx);
+            if (fflush(out) == EOF)
+                break;
+        }
+
+        free(line);
+        fclose(in);
+        fclose(out);
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""Compare two probe_bench JSON results (make bench), e.g. two runtimes or a
+host before and after a kernel update.
+
+    ./bench_compare.py bench-runc.json bench-runsc-kvm.json
+    ./bench_compare.py --tolerance 0.25 baseline.json bench-vm.json
+
+Prints the median ns of every (primitive, state) in both files and their
+ratio; rows slower than the tolerance are marked, and the exit status is 1
+if there is any, so it can gate a run.
+"""
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        doc = json.load(f)
+    return doc, {(r["primitive"], r["state"]): r for r in doc["results"]}
+
+
+def median(result):
+    if "error" in result or result["samples"] == 0:
+        return None
+    return result["ns"]["p50"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--tolerance", type=float, default=0.5,
+                        help="relative p50 slowdown flagged as a regression (default: 0.5)")
+    args = parser.parse_args()
+
+    base_doc, base = load(args.baseline)
+    cand_doc, cand = load(args.candidate)
+    print(f"# {base_doc['label']} ({base_doc['kernel']}, {base_doc['timing']['source']}) vs "
+          f"{cand_doc['label']} ({cand_doc['kernel']}, {cand_doc['timing']['source']})")
+    print("primitive,state,base_p50_ns,cand_p50_ns,ratio,flag")
+
+    regressions = 0
+    for key in list(base) + [k for k in cand if k not in base]:
+        b = median(base[key]) if key in base else None
+        c = median(cand[key]) if key in cand else None
+        ratio = c / b if b and c is not None else None
+        flag = ""
+        if ratio is not None and ratio > 1 + args.tolerance:
+            flag = "slower"
+            regressions += 1
+        elif b is not None and c is None:
+            flag = "missing"
+        print(f"{key[0]},{key[1]},{'' if b is None else f'{b:.0f}'},"
+              f"{'' if c is None else f'{c:.0f}'},{'' if ratio is None else f'{ratio:.2f}'},{flag}")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
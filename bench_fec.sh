@@ -0,0 +1,62 @@
+#!/bin/bash
+# Measure goodput against raw rate for each error correcting code and stride.
+#
+# Usage: ./bench_fec.sh [file] [num_bits] [repetitions] [calib_file]
+#
+# num_bits payload bits are encoded with each code (see fec.h); the default
+# fits the conv code at stride 128 on the 128 MiB carriers. Every repetition
+# evicts the page cache, sends a fresh random payload and receives it once.
+# Prints one CSV row per (code, stride, repetition) and per (code, stride):
+#   raw bps      carrier bits / wall time of send + receive
+#   goodput bps  correctly received payload bits / the same wall time
+
+TARGET_FILE=${1:-/workspace/rand0.bin}
+NUM_BITS=${2:-120}
+REPETITIONS=${3:-10}
+CALIB_FILE=${4:-/tmp/bench_fec.calib}
+CODES="none hamming conv"
+STRIDES="32 64 128"
+
+set -e
+
+. "$(dirname "$0")/lib_bench.sh"
+
+bench_results
+
+echo "code,stride,repetition,payload_bits,carrier_bits,bit_errors,wall_ns"
+
+for stride in $STRIDES; do
+    for rep in $(seq 1 $REPETITIONS); do
+        PATTERN=$(random_pattern $NUM_BITS)
+
+        for code in $CODES; do
+            evict $TARGET_FILE
+            begin=$(date +%s%N)
+            LD_BIND_NOW=1 ./sender_stride -e $code $TARGET_FILE $PATTERN $stride > /dev/null
+            out=$(LD_BIND_NOW=1 ./receiver_stride -u -c $CALIB_FILE -e $code $TARGET_FILE \
+                  $NUM_BITS 0 $stride)
+            end=$(date +%s%N)
+
+            carrier=$(echo "$out" | cut -d, -f3)
+            errors=$(bit_errors "$PATTERN" "$(received_bits "$out")")
+
+            echo "$code,$stride,$rep,$NUM_BITS,$carrier,$errors,$((end - begin))" | tee -a $RESULTS
+        done
+    done
+done
+
+awk -F, '
+    {
+        k = $1 "," $2
+        bits[k] += $4; carrier[k] += $5; errs[k] += $6; wall[k] += $7
+        if ($6 == 0) ok[k]++
+        n[k]++
+    }
+    END {
+        for (k in n) {
+            split(k, f, ",")
+            printf "# %s stride %s: raw %.1f bps, goodput %.1f bps, BER %.4f, %d/%d frames error-free\n",
+                   f[1], f[2], carrier[k] / (wall[k] / 1e9), (bits[k] - errs[k]) / (wall[k] / 1e9),
+                   errs[k] / bits[k], ok[k], n[k]
+        }
+    }' $RESULTS | sort
@@ -0,0 +1,52 @@
+#!/bin/bash
+# Compare the serial and io_uring receiver backends on the same carrier file.
+#
+# Usage: ./bench_receiver_backends.sh [file] [num_bits] [stride] [repetitions]
+#
+# Every repetition evicts the page cache, primes the same random pattern
+# with sender_stride and receives it once per backend. Prints one CSV row
+# per (backend, repetition) and the mean frame receive time per backend.
+
+TARGET_FILE=${1:-/workspace/rand0.bin}
+NUM_BITS=${2:-1024}
+STRIDE=${3:-32}
+REPETITIONS=${4:-10}
+THRESHOLD=0  # receiver_stride's own default
+
+set -e
+
+. "$(dirname "$0")/lib_bench.sh"
+
+PATTERN=$(random_pattern $NUM_BITS)
+bench_results
+
+echo "backend,repetition,bit_errors,total_measurement_cycles,wall_ns"
+
+for rep in $(seq 1 $REPETITIONS); do
+    for backend in serial uring; do
+        FLAGS=""
+        if [ $backend = uring ]; then
+            FLAGS="-u"
+        fi
+
+        evict $TARGET_FILE
+        LD_BIND_NOW=1 ./sender_stride $TARGET_FILE $PATTERN $STRIDE > /dev/null
+
+        begin=$(date +%s%N)
+        out=$(LD_BIND_NOW=1 ./receiver_stride $FLAGS $TARGET_FILE $NUM_BITS $THRESHOLD $STRIDE)
+        end=$(date +%s%N)
+
+        errors=$(bit_errors "$PATTERN" "$(received_bits "$out")")
+        cycles=$(echo "$out" | cut -d, -f11)
+
+        echo "$backend,$rep,$errors,$cycles,$((end - begin))" | tee -a $RESULTS
+    done
+done
+
+awk -F, '
+    { cycles[$1] += $4; wall[$1] += $5; errs[$1] += $3; n[$1]++ }
+    END {
+        for (b in n)
+            printf "# %s: mean %.0f cycles, %.3f ms wall, %.2f bit errors per frame\n",
+                   b, cycles[b] / n[b], wall[b] / n[b] / 1e6, errs[b] / n[b]
+    }' $RESULTS
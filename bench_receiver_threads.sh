@@ -0,0 +1,54 @@
+#!/bin/bash
+# Frame receive time of receiver_stride for 1..max_threads probe threads.
+#
+# Usage: ./bench_receiver_threads.sh [file] [num_bits] [stride] [repetitions] [max_threads]
+#
+# Run it natively, inside a runc/runsc container and inside a QEMU guest to
+# compare runtimes; RUNTIME only labels the rows and RECEIVER_FLAGS is passed
+# to every receiver_stride call (e.g. RECEIVER_FLAGS=-u).
+
+TARGET_FILE=${1:-/workspace/rand0.bin}
+NUM_BITS=${2:-1024}
+STRIDE=${3:-32}
+REPETITIONS=${4:-10}
+MAX_THREADS=${5:-$(nproc)}
+RUNTIME=${RUNTIME:-native}
+THRESHOLD=0  # receiver_stride's own default
+
+set -e
+
+. "$(dirname "$0")/lib_bench.sh"
+
+PATTERN=$(random_pattern $NUM_BITS)
+bench_results
+
+echo "runtime,threads,repetition,bit_errors,total_measurement_cycles,wall_ns"
+
+for threads in $(seq 1 $MAX_THREADS); do
+    for rep in $(seq 1 $REPETITIONS); do
+        evict $TARGET_FILE
+        LD_BIND_NOW=1 ./sender_stride $TARGET_FILE $PATTERN $STRIDE > /dev/null
+
+        begin=$(date +%s%N)
+        out=$(LD_BIND_NOW=1 ./receiver_stride $RECEIVER_FLAGS -t $threads $TARGET_FILE $NUM_BITS $THRESHOLD $STRIDE)
+        end=$(date +%s%N)
+
+        errors=$(bit_errors "$PATTERN" "$(received_bits "$out")")
+        cycles=$(echo "$out" | cut -d, -f11)
+
+        echo "$RUNTIME,$threads,$rep,$errors,$cycles,$((end - begin))" | tee -a $RESULTS
+    done
+done
+
+awk -F, '
+    { cycles[$2] += $5; wall[$2] += $6; errs[$2] += $4; n[$2]++ }
+    END {
+        best = 0
+        for (t = 1; t in n; t++) {
+            printf "# %d thread(s): mean %.0f cycles, %.3f ms wall, %.2f bit errors per frame\n",
+                   t, cycles[t] / n[t], wall[t] / n[t] / 1e6, errs[t] / n[t]
+            if (best == 0 || wall[t] / n[t] < wall[best] / n[best])
+                best = t
+        }
+        printf "# fastest: %d thread(s)\n", best
+    }' $RESULTS
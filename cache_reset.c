@@ -0,0 +1,146 @@
+/*
+ * Evict only the given carrier files (or page ranges of them) from the page
+ * cache and verify they are gone, instead of drop_caches (see cache_reset.h).
+ *
+ * Usage: ./cache_reset [-v] [-n] <file>[:ranges] [<file>[:ranges] ...]
+ *   ranges: comma separated pages or first-last ranges, e.g. "0-1023,4096";
+ *           the whole file if omitted
+ *   -n: do not verify residency afterwards
+ *
+ * Prints one CSV record per file. Exits with 1 if any page is still
+ * resident (or residency cannot be checked), so scripts can fall back to a
+ * global reset.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "timing.h"
+#include "cache_reset.h"
+
+// Reset every range of one file; returns pages left resident or -1.
+static long reset_file(const char *path, const char *ranges, bool verify, bool verbose)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    struct stat st;
+    size_t pages_reset = 0;
+    long before = 0, after = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "Failed to open file %s: %s\n", path, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+    size_t file_pgs = (st.st_size + (pg_size - 1)) / pg_size;
+
+    uint64_t begin_ns = timing_monotonic_ns();
+    const char *p = ranges ? ranges : "";
+    do {
+        size_t first = 0, last = file_pgs ? file_pgs - 1 : 0;
+        char *end;
+
+        if (*p) {
+            first = last = strtoul(p, &end, 10);
+            if (end == p)
+                goto bad_range;
+            p = end;
+            if (*p == '-') {
+                last = strtoul(p + 1, &end, 10);
+                if (end == p + 1 || last < first)
+                    goto bad_range;
+                p = end;
+            }
+            if (*p == ',')
+                p++;
+            else if (*p)
+                goto bad_range;
+        }
+        if (file_pgs == 0)
+            break;
+        if (last >= file_pgs)
+            last = file_pgs - 1;
+        if (first > last)
+            continue;
+
+        size_t n = last - first + 1;
+        if (verify && before >= 0) {
+            long r = cache_residency(fd, first, n);
+            before = r < 0 ? -1 : before + r;
+        }
+        long r = cache_reset(fd, first, n, verify);
+        after = r < 0 || after < 0 ? -1 : after + r;
+        pages_reset += n;
+        if (verbose)
+            fprintf(stderr, "%s: pages %zu-%zu reset, %ld left\n", path, first, last, r);
+    } while (*p);
+    uint64_t end_ns = timing_monotonic_ns();
+
+    printf("%s,%zu,%zu,%ld,%ld,%lu\n", path, file_pgs, pages_reset,
+           verify ? before : -1L, verify ? after : -1L, end_ns - begin_ns);
+    close(fd);
+    return after;
+
+bad_range:
+    fprintf(stderr, "Invalid page range '%s' for %s\n", ranges, path);
+    close(fd);
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    bool verbose = false;
+    bool verify = true;
+    int arg_idx = 1;
+    int ret = 0;
+
+    // Check for -v and -n flags
+    while (arg_idx < argc && argv[arg_idx][0] == '-') {
+        if (strcmp(argv[arg_idx], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg_idx], "-n") == 0) {
+            verify = false;
+        } else {
+            break;
+        }
+        arg_idx++;
+    }
+
+    if (argc < arg_idx + 1) {
+        fprintf(stderr, "Usage: %s [-v] [-n] <file>[:ranges] [<file>[:ranges] ...]\n", argv[0]);
+        fprintf(stderr, "  ranges: pages or first-last ranges, comma separated (default: whole file)\n");
+        fprintf(stderr, "  -n: skip the residency check\n");
+        exit(EBADF);
+    }
+
+    if (verbose)
+        printf("filename,file_pages,pages_reset,resident_before,resident_after,reset_ns\n");
+
+    for (int i = arg_idx; i < argc; i++) {
+        char *arg = strdup(argv[i]);
+        // Only split on the last ':' when a page range follows it.
+        char *colon = strrchr(arg, ':');
+        char *ranges = NULL;
+        if (colon && isdigit((unsigned char)colon[1])) {
+            *colon = '\0';
+            ranges = colon + 1;
+        }
+        if (reset_file(arg, ranges, verify, verbose) != 0)
+            ret = 1;
+        free(arg);
+    }
+
+    fflush(stdout);
+    return ret;
+}
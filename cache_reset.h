@@ -0,0 +1,91 @@
+/*
+ * Targeted page cache reset for carrier files
+ *
+ * cache_reset() drops a page range of one file from the page cache with
+ * POSIX_FADV_DONTNEED and checks with mincore() on a shared mapping of
+ * the range that the pages are really gone, retrying the survivors a few
+ * times (dirty pages are written back first, pages under writeback or
+ * locked by another reader only drop once they are released). Unlike
+ * drop_caches it touches nothing but the given file and takes
+ * milliseconds instead of seconds.
+ *
+ * Some runtimes (e.g. gVisor with its own file cache) ignore the advice or
+ * report every page resident; callers see that as pages left over and can
+ * fall back to a global reset.
+ *
+ * Needs _GNU_SOURCE for sync_file_range().
+ */
+
+#ifndef CACHE_RESET_H
+#define CACHE_RESET_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CACHE_RESET_TRIES 4
+#define CACHE_RESET_RETRY_US 1000
+
+// Resident pages in [first_page, first_page + num_pages) of fd, or -1.
+static long cache_residency(int fd, size_t first_page, size_t num_pages)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    size_t len = num_pages * pg_size;
+    unsigned char *vec;
+    long resident = 0;
+
+    if (num_pages == 0)
+        return 0;
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, (off_t)(first_page * pg_size));
+    if (map == MAP_FAILED)
+        return -1;
+    vec = malloc(num_pages);
+    if (!vec || mincore(map, len, vec) == -1) {
+        free(vec);
+        munmap(map, len);
+        return -1;
+    }
+    for (size_t i = 0; i < num_pages; i++)
+        resident += vec[i] & 1;
+
+    free(vec);
+    munmap(map, len);
+    return resident;
+}
+
+/*
+ * Evict [first_page, first_page + num_pages) of fd. Returns the number of
+ * pages still resident afterwards (0 on success), or -1 if residency
+ * cannot be checked; without verify the range is only advised once.
+ */
+static long cache_reset(int fd, size_t first_page, size_t num_pages, bool verify)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    off_t off = (off_t)(first_page * pg_size);
+    off_t len = (off_t)(num_pages * pg_size);
+    long resident = 0;
+
+    // Dirty pages cannot be dropped before they are written back
+    sync_file_range(fd, off, len, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                                  SYNC_FILE_RANGE_WAIT_AFTER);
+
+    for (int attempt = 0; attempt < CACHE_RESET_TRIES; attempt++) {
+        if (attempt > 0)
+            usleep(CACHE_RESET_RETRY_US);
+        posix_fadvise(fd, off, len, POSIX_FADV_DONTNEED);
+        if (!verify)
+            return 0;
+        resident = cache_residency(fd, first_page, num_pages);
+        if (resident <= 0)
+            return resident;
+    }
+    return resident;
+}
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * Automatic hot/cold threshold calibration and drift tracking
+ *
+ * calib_run() takes a set of spare carrier pages (never the data pages),
+ * evicts half of them with POSIX_FADV_DONTNEED, primes the other half, and
+ * times a pread() of each in shuffled order. The latencies of both classes
+ * seed a two-cluster fit (k-means on log2 ticks); the decision boundary is
+ * the midpoint between the two cluster centers.
+ *
+ * calib_update() keeps adjusting the centers (and with them the threshold)
+ * from every classified sample, so long runs follow host load changes.
+ *
+ * The fitted state is saved to a small text file and reloaded by later
+ * invocations, as long as the timing source is the same.
+ */
+
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timing.h"
+
+#define CALIB_DEFAULT_ROUNDS 8
+#define CALIB_MAX_ITERATIONS 32
+// Weight of a new sample in the running cluster centers
+#define CALIB_DRIFT_ALPHA (1.0 / 64.0)
+// Cold pages must be at least this many times slower than hot ones
+#define CALIB_MIN_SEPARATION 2.0
+// Octaves from an uncalibrated threshold at which calib_soft() saturates
+#define CALIB_DEFAULT_SPREAD 2.0
+
+struct calib {
+    double hot_center;   // log2 ticks
+    double cold_center;  // log2 ticks
+    uint64_t threshold;
+    bool valid;
+};
+
+static inline double calib_log(uint64_t ticks)
+{
+    return log2((double)ticks + 1.0);
+}
+
+static inline void calib_set_threshold(struct calib *c)
+{
+    c->threshold = (uint64_t)exp2((c->hot_center + c->cold_center) / 2.0);
+}
+
+// Feed one classified sample; returns true if it counts as hot (cached).
+static inline bool calib_update(struct calib *c, uint64_t ticks)
+{
+    double x = calib_log(ticks);
+    bool hot = ticks < c->threshold;
+
+    if (hot)
+        c->hot_center += CALIB_DRIFT_ALPHA * (x - c->hot_center);
+    else
+        c->cold_center += CALIB_DRIFT_ALPHA * (x - c->cold_center);
+    calib_set_threshold(c);
+
+    return hot;
+}
+
+/*
+ * Confidence that a sample is hot, in [-1, 1]: its log distance from the
+ * threshold, scaled by half the gap between the cluster centers. Without a
+ * calibration (c == NULL) threshold applies and CALIB_DEFAULT_SPREAD
+ * octaves saturate. Failed measurements (0 or UINT64_MAX) give 0.
+ */
+static inline double calib_soft(const struct calib *c, uint64_t threshold, uint64_t ticks)
+{
+    if (ticks == 0 || ticks == UINT64_MAX)
+        return 0.0;
+
+    double spread = c ? (c->cold_center - c->hot_center) / 2.0 : CALIB_DEFAULT_SPREAD;
+    double x = (calib_log(c ? c->threshold : threshold) - calib_log(ticks)) / spread;
+
+    return x > 1.0 ? 1.0 : x < -1.0 ? -1.0 : x;
+}
+
+// Two-cluster k-means in one dimension, seeded with *lo and *hi.
+static void calib_fit(const double *x, size_t n, double *lo, double *hi)
+{
+    for (int iter = 0; iter < CALIB_MAX_ITERATIONS; iter++) {
+        double sum_lo = 0, sum_hi = 0;
+        size_t n_lo = 0, n_hi = 0;
+        double boundary = (*lo + *hi) / 2.0;
+
+        for (size_t i = 0; i < n; i++) {
+            if (x[i] < boundary) {
+                sum_lo += x[i];
+                n_lo++;
+            } else {
+                sum_hi += x[i];
+                n_hi++;
+            }
+        }
+        if (n_lo == 0 || n_hi == 0)
+            return;
+
+        double new_lo = sum_lo / n_lo, new_hi = sum_hi / n_hi;
+        if (new_lo == *lo && new_hi == *hi)
+            return;
+        *lo = new_lo;
+        *hi = new_hi;
+    }
+}
+
+static int calib_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void calib_print_histogram(const double *hot, size_t n_hot,
+                                  const double *cold, size_t n_cold)
+{
+    size_t hot_bins[64] = {0}, cold_bins[64] = {0};
+
+    for (size_t i = 0; i < n_hot; i++)
+        hot_bins[(int)hot[i] & 63]++;
+    for (size_t i = 0; i < n_cold; i++)
+        cold_bins[(int)cold[i] & 63]++;
+
+    fprintf(stderr, "Calibration histogram (log2 ticks: hot cold)\n");
+    for (int b = 0; b < 64; b++) {
+        if (hot_bins[b] || cold_bins[b])
+            fprintf(stderr, "  2^%-2d %6zu %6zu\n", b, hot_bins[b], cold_bins[b]);
+    }
+}
+
+/*
+ * Calibrate on the given spare pages of fd. Returns 0 and fills c on
+ * success, -1 if the classes do not separate (e.g. eviction is a no-op
+ * under this runtime), leaving c untouched.
+ */
+static int calib_run(struct calib *c, int fd, const size_t *pages, size_t num_pages,
+                     unsigned rounds, bool verbose)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    size_t half = num_pages / 2;
+    char *buff = malloc(pg_size);
+    size_t *order = malloc(num_pages * sizeof(size_t));
+    double *hot = malloc((size_t)rounds * half * sizeof(double));
+    double *cold = malloc((size_t)rounds * (num_pages - half) * sizeof(double));
+    size_t n_hot = 0, n_cold = 0;
+    int ret = -1;
+
+    if (num_pages < 2 || !buff || !order || !hot || !cold)
+        goto out;
+
+    // Readahead would warm the cold pages next to primed ones
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+    for (size_t i = 0; i < num_pages; i++)
+        order[i] = i;
+
+    for (unsigned r = 0; r < rounds; r++) {
+        // Alternate which half is hot so both halves see both classes
+        for (size_t i = 0; i < num_pages; i++) {
+            off_t off = (off_t)pages[i] * pg_size;
+            bool is_hot = (i < half) == (r % 2 == 0);
+
+            if (is_hot) {
+                pread(fd, buff, pg_size, off);
+            } else {
+                posix_fadvise(fd, off, pg_size, POSIX_FADV_DONTNEED);
+            }
+        }
+
+        for (size_t i = num_pages - 1; i > 0; i--) {
+            size_t j = (size_t)rand() % (i + 1);
+            size_t tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+
+        for (size_t k = 0; k < num_pages; k++) {
+            size_t i = order[k];
+            bool is_hot = (i < half) == (r % 2 == 0);
+            uint64_t start = timing_start();
+            ssize_t got = pread(fd, buff, pg_size, (off_t)pages[i] * pg_size);
+            uint64_t end = timing_stop();
+
+            if (got < 0)
+                continue;
+            if (is_hot)
+                hot[n_hot++] = calib_log(timing_elapsed(start, end));
+            else
+                cold[n_cold++] = calib_log(timing_elapsed(start, end));
+        }
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_NORMAL);
+
+    if (n_hot == 0 || n_cold == 0)
+        goto out;
+
+    qsort(hot, n_hot, sizeof(double), calib_compare_double);
+    qsort(cold, n_cold, sizeof(double), calib_compare_double);
+    if (verbose)
+        calib_print_histogram(hot, n_hot, cold, n_cold);
+
+    double hot_median = hot[n_hot / 2], cold_median = cold[n_cold / 2];
+    if (cold_median - hot_median < log2(CALIB_MIN_SEPARATION)) {
+        fprintf(stderr, "Warning: calibration failed, cold pages (2^%.1f ticks) not slower "
+                        "than hot ones (2^%.1f ticks)\n", cold_median, hot_median);
+        goto out;
+    }
+
+    // Fit both clusters on the pooled, unlabeled samples
+    double *all = malloc((n_hot + n_cold) * sizeof(double));
+    if (!all)
+        goto out;
+    memcpy(all, hot, n_hot * sizeof(double));
+    memcpy(all + n_hot, cold, n_cold * sizeof(double));
+    calib_fit(all, n_hot + n_cold, &hot_median, &cold_median);
+    free(all);
+
+    c->hot_center = hot_median;
+    c->cold_center = cold_median;
+    c->valid = true;
+    calib_set_threshold(c);
+    ret = 0;
+
+out:
+    free(buff);
+    free(order);
+    free(hot);
+    free(cold);
+    return ret;
+}
+
+static int calib_load(struct calib *c, const char *path)
+{
+    char source[32];
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return -1;
+    int n = fscanf(f, "%lu %lf %lf %31s", &c->threshold, &c->hot_center, &c->cold_center, source);
+    fclose(f);
+
+    // Ticks from a different clock source are not comparable
+    if (n != 4 || strcmp(source, timing.source) != 0)
+        return -1;
+    c->valid = true;
+    return 0;
+}
+
+static int calib_save(const struct calib *c, const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f) {
+        fprintf(stderr, "Cannot save calibration to %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "%lu %.6f %.6f %s\n", c->threshold, c->hot_center, c->cold_center, timing.source);
+    fclose(f);
+    return 0;
+}
+
+#endif
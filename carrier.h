@@ -0,0 +1,109 @@
+/*
+ * Carrier file manifest
+ *
+ * mkcarrier writes one line per generated carrier, '#' starts a comment:
+ *   carrier <path> <pages> <page_size> <seed>
+ * The tools' -M take the geometry of a listed carrier from here without
+ * stat()ing it; files that are not listed (or a missing manifest) fall back
+ * to fstat(). A listed file shorter than its entry (a stale manifest) shows
+ * up as a read at end of file, which the tools report through
+ * carrier_short_read(). Paths match verbatim or, failing that, after
+ * realpath(), relative entries being relative to the manifest; mkcarrier
+ * writes absolute ones.
+ */
+
+#ifndef CARRIER_H
+#define CARRIER_H
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CARRIER_MANIFEST_HEADER "# carrier <path> <pages> <page_size> <seed>\n"
+
+// Pages of filename in the manifest (in our page size), 0 if not listed.
+static size_t carrier_manifest_pages(const char *manifest, const char *filename)
+{
+    FILE *f = fopen(manifest, "r");
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    char line[PATH_MAX + 128];
+    char want[PATH_MAX], dir[PATH_MAX];
+    bool have_want = realpath(filename, want) != NULL;
+    size_t pages = 0;
+
+    if (!f) {
+        fprintf(stderr, "Warning: cannot read manifest %s: %s\n", manifest, strerror(errno));
+        return 0;
+    }
+    snprintf(dir, sizeof(dir), "%s", manifest);
+    char *slash = strrchr(dir, '/');
+    if (slash)
+        slash[1] = '\0';
+    else
+        dir[0] = '\0';
+
+    while (fgets(line, sizeof(line), f)) {
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        char *kind = strtok(line, " \t\r\n");
+        char *path = strtok(NULL, " \t\r\n");
+        char *npages = strtok(NULL, " \t\r\n");
+        char *psize = strtok(NULL, " \t\r\n");
+        if (!kind || strcmp(kind, "carrier") != 0 || !path || !npages || !psize)
+            continue;
+
+        bool match = strcmp(path, filename) == 0;
+        if (!match && have_want) {
+            char joined[2 * PATH_MAX], resolved[PATH_MAX];
+            snprintf(joined, sizeof(joined), "%s%s", path[0] == '/' ? "" : dir, path);
+            match = realpath(joined, resolved) && strcmp(resolved, want) == 0;
+        }
+        if (match) {
+            // Round down: a partial page of ours is not a whole carrier page
+            pages = strtoull(npages, NULL, 10) * strtoull(psize, NULL, 10) / pg_size;
+            break;
+        }
+    }
+    fclose(f);
+    return pages;
+}
+
+/*
+ * Pages of the open carrier fd: from the manifest if it lists filename,
+ * else from fstat(). 0 for an empty file, (size_t)-1 if fstat fails.
+ */
+static size_t carrier_pages(int fd, const char *manifest, const char *filename)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    struct stat st;
+
+    if (manifest) {
+        size_t pages = carrier_manifest_pages(manifest, filename);
+        if (pages)
+            return pages;
+    }
+    if (fstat(fd, &st) == -1)
+        return (size_t)-1;
+    return (st.st_size + (pg_size - 1)) / pg_size;
+}
+
+// A read of page came back empty: the carrier ends before it, i.e. its
+// manifest entry is stale. Warns once per process.
+static void carrier_short_read(size_t page)
+{
+    static atomic_bool warned;
+
+    if (!atomic_exchange(&warned, true))
+        fprintf(stderr, "Warning: carrier ends before page %zu, is the manifest stale?\n", page);
+}
+
+#endif
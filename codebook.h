@@ -0,0 +1,372 @@
+/*
+ * Symbol codec over a set of (file, page) carrier slots
+ *
+ * A codebook file lists the slots and how k-bit symbols map onto subsets
+ * of them, '#' starts a comment:
+ *   slot <file> <page>[,<page>...]     one slot per page, numbered in order
+ *   weight <w>                         constant-weight code: each symbol primes
+ *                                      exactly w slots, k = floor(log2(C(n, w)))
+ *   symbol <value> <slot>[,<slot>...]  explicit subset for one symbol; all 2^k
+ *                                      values must be listed, each once and
+ *                                      with a subset of its own
+ * Without weight or symbol lines every slot carries one bit (k = n).
+ *
+ * The sender primes the subset of a symbol. The receiver probes every slot
+ * once, turns the cycle times into soft values (calib_soft()) and picks the
+ * most likely symbol: one decision per slot for the plain mapping, the w
+ * fastest slots for a constant-weight code, the best correlating entry for
+ * an explicit table. Subsets that belong to no symbol decode to -1.
+ */
+
+#ifndef CODEBOOK_H
+#define CODEBOOK_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Symbols of the plain mapping must fit an int64_t
+#define CODEBOOK_MAX_SLOTS 62
+#define CODEBOOK_MAX_FILES 16
+// Explicit tables are kept in memory and searched exhaustively
+#define CODEBOOK_MAX_TABLE_BITS 12
+
+struct codebook_file {
+    char *path;
+    int fd;
+};
+
+struct codebook_slot {
+    size_t file;
+    size_t page;
+};
+
+struct codebook {
+    struct codebook_file files[CODEBOOK_MAX_FILES];
+    size_t num_files;
+    struct codebook_slot slots[CODEBOOK_MAX_SLOTS];
+    size_t num_slots;
+    unsigned weight;        // 0 unless constant-weight
+    unsigned symbol_bits;   // k
+    uint64_t *table;        // explicit masks indexed by symbol, or NULL
+};
+
+static uint64_t codebook_binom(unsigned n, unsigned k)
+{
+    uint64_t r = 1;
+
+    if (k > n)
+        return 0;
+    if (k > n - k)
+        k = n - k;
+    // Exact at every step: r * (n - i) is divisible by i + 1
+    for (unsigned i = 0; i < k; i++)
+        r = r / (i + 1) * (n - i) + r % (i + 1) * (n - i) / (i + 1);
+    return r;
+}
+
+static unsigned codebook_log2_floor(uint64_t x)
+{
+    return x ? 63 - __builtin_clzll(x) : 0;
+}
+
+static size_t codebook_file_index(struct codebook *cb, const char *path)
+{
+    for (size_t i = 0; i < cb->num_files; i++) {
+        if (strcmp(cb->files[i].path, path) == 0)
+            return i;
+    }
+    if (cb->num_files == CODEBOOK_MAX_FILES)
+        return SIZE_MAX;
+    cb->files[cb->num_files].path = strdup(path);
+    cb->files[cb->num_files].fd = -1;
+    return cb->num_files++;
+}
+
+// Parse the codebook at path; files are not opened yet.
+static int codebook_cmp_mask(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Two symbols with the same subset could never be told apart
+static int codebook_check_unique(const uint64_t *table, size_t entries, const char *path)
+{
+    uint64_t *sorted = malloc(entries * sizeof(uint64_t));
+
+    if (!sorted) {
+        perror("malloc");
+        return -1;
+    }
+    memcpy(sorted, table, entries * sizeof(uint64_t));
+    qsort(sorted, entries, sizeof(uint64_t), codebook_cmp_mask);
+    for (size_t i = 1; i < entries; i++) {
+        if (sorted[i] == sorted[i - 1]) {
+            fprintf(stderr, "Codebook %s: two symbols share slot mask 0x%lx\n", path, sorted[i]);
+            free(sorted);
+            return -1;
+        }
+    }
+    free(sorted);
+    return 0;
+}
+
+static int codebook_load(struct codebook *cb, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[4096];
+    size_t table_entries = 0;
+    uint64_t *pending = NULL;
+    size_t pending_cap = 0;
+    int lineno = 0;
+
+    memset(cb, 0, sizeof(*cb));
+    if (!f) {
+        fprintf(stderr, "Failed to open codebook %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char *hash = strchr(line, '#');
+        lineno++;
+        if (hash)
+            *hash = '\0';
+
+        char *kind = strtok(line, " \t\r\n");
+        if (!kind)
+            continue;
+
+        if (strcmp(kind, "slot") == 0) {
+            char *file = strtok(NULL, " \t\r\n");
+            char *pages = strtok(NULL, " \t\r\n");
+            size_t fi = file ? codebook_file_index(cb, file) : SIZE_MAX;
+
+            if (fi == SIZE_MAX || !pages)
+                goto bad_line;
+            for (char *p = strtok(pages, ","); p; p = strtok(NULL, ",")) {
+                if (cb->num_slots == CODEBOOK_MAX_SLOTS)
+                    goto bad_line;
+                cb->slots[cb->num_slots].file = fi;
+                cb->slots[cb->num_slots].page = strtoul(p, NULL, 10);
+                cb->num_slots++;
+            }
+        } else if (strcmp(kind, "weight") == 0) {
+            char *w = strtok(NULL, " \t\r\n");
+            if (!w || (cb->weight = strtoul(w, NULL, 10)) == 0)
+                goto bad_line;
+        } else if (strcmp(kind, "symbol") == 0) {
+            char *value = strtok(NULL, " \t\r\n");
+            char *members = strtok(NULL, " \t\r\n");
+            size_t v = value ? strtoul(value, NULL, 10) : SIZE_MAX;
+            uint64_t mask = 0;
+
+            if (v >= (1UL << CODEBOOK_MAX_TABLE_BITS) || !members)
+                goto bad_line;
+            for (char *p = strtok(members, ","); p; p = strtok(NULL, ",")) {
+                char *end;
+                unsigned long slot = strtoul(p, &end, 10);
+                if (end == p || *end || slot >= CODEBOOK_MAX_SLOTS)
+                    goto bad_line;
+                mask |= 1ULL << slot;
+            }
+            if (v >= pending_cap) {
+                size_t cap = pending_cap ? pending_cap : 16;
+                while (cap <= v)
+                    cap *= 2;
+                uint64_t *grown = realloc(pending, cap * sizeof(uint64_t));
+                if (!grown)
+                    goto bad_line;
+                memset(grown + pending_cap, 0, (cap - pending_cap) * sizeof(uint64_t));
+                pending = grown;
+                pending_cap = cap;
+            }
+            if (pending[v] != 0)
+                goto bad_line;      // value listed twice
+            table_entries++;
+            pending[v] = mask;
+        } else {
+            goto bad_line;
+        }
+    }
+    fclose(f);
+
+    if (cb->num_slots == 0) {
+        fprintf(stderr, "Codebook %s has no slots\n", path);
+        goto fail;
+    }
+
+    if (table_entries) {
+        unsigned k = codebook_log2_floor(table_entries);
+        if ((1UL << k) != table_entries) {
+            fprintf(stderr, "Codebook %s: %zu symbols, need a power of two\n", path, table_entries);
+            goto fail;
+        }
+        for (size_t v = 0; v < table_entries; v++) {
+            if (v >= pending_cap || pending[v] == 0 || pending[v] >> cb->num_slots) {
+                fprintf(stderr, "Codebook %s: symbol %zu missing or uses unknown slots\n",
+                        path, v);
+                goto fail;
+            }
+        }
+        if (codebook_check_unique(pending, table_entries, path) == -1)
+            goto fail;
+        cb->table = pending;
+        cb->symbol_bits = k;
+    } else if (cb->weight) {
+        if (cb->weight >= cb->num_slots) {
+            fprintf(stderr, "Codebook %s: weight %u needs more than %zu slots\n",
+                    path, cb->weight, cb->num_slots);
+            goto fail;
+        }
+        cb->symbol_bits = codebook_log2_floor(codebook_binom(cb->num_slots, cb->weight));
+        free(pending);
+    } else {
+        cb->symbol_bits = cb->num_slots;
+        free(pending);
+    }
+    return 0;
+
+bad_line:
+    fprintf(stderr, "Codebook %s:%d: invalid line\n", path, lineno);
+    fclose(f);
+fail:
+    free(pending);
+    return -1;
+}
+
+static int codebook_open(struct codebook *cb)
+{
+    for (size_t i = 0; i < cb->num_files; i++) {
+        cb->files[i].fd = open(cb->files[i].path, O_RDONLY);
+        if (cb->files[i].fd == -1) {
+            fprintf(stderr, "Failed to open file %s: %s\n", cb->files[i].path, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void codebook_close(struct codebook *cb)
+{
+    for (size_t i = 0; i < cb->num_files; i++) {
+        if (cb->files[i].fd != -1)
+            close(cb->files[i].fd);
+        free(cb->files[i].path);
+    }
+    free(cb->table);
+    cb->num_files = 0;
+    cb->table = NULL;
+}
+
+static inline uint64_t codebook_symbols(const struct codebook *cb)
+{
+    return cb->symbol_bits >= 64 ? UINT64_MAX : 1ULL << cb->symbol_bits;
+}
+
+// Slot mask of symbol; -1 if symbol is out of range.
+static int codebook_encode(const struct codebook *cb, uint64_t symbol, uint64_t *mask)
+{
+    if (cb->symbol_bits < 64 && symbol >= codebook_symbols(cb))
+        return -1;
+
+    if (cb->table) {
+        *mask = cb->table[symbol];
+    } else if (cb->weight) {
+        // Unrank in the combinatorial number system, highest member first
+        uint64_t rest = symbol;
+        unsigned c = cb->num_slots;
+        *mask = 0;
+        for (unsigned i = cb->weight; i > 0; i--) {
+            do
+                c--;
+            while (codebook_binom(c, i) > rest);
+            rest -= codebook_binom(c, i);
+            *mask |= 1ULL << c;
+        }
+    } else {
+        // Slot 0 carries the most significant bit
+        *mask = 0;
+        for (size_t i = 0; i < cb->num_slots; i++)
+            *mask |= ((symbol >> (cb->num_slots - 1 - i)) & 1) << i;
+    }
+    return 0;
+}
+
+/*
+ * Most likely symbol for the soft values of all slots (positive = cached),
+ * or -1 if the best subset is no symbol. *margin is how far the decision
+ * was from flipping: the smallest |soft| for the plain mapping, the gap
+ * between the w-th and (w+1)-th fastest slot for a constant-weight code,
+ * the correlation gap to the runner-up for a table.
+ */
+static int64_t codebook_decode(const struct codebook *cb, const double *soft, double *margin)
+{
+    size_t n = cb->num_slots;
+
+    if (cb->table) {
+        double best = -1e300, second = -1e300;
+        int64_t best_symbol = -1;
+
+        for (uint64_t v = 0; v < codebook_symbols(cb); v++) {
+            double corr = 0;
+            for (size_t i = 0; i < n; i++)
+                corr += (cb->table[v] >> i) & 1 ? soft[i] : -soft[i];
+            if (corr > best) {
+                second = best;
+                best = corr;
+                best_symbol = v;
+            } else if (corr > second) {
+                second = corr;
+            }
+        }
+        *margin = best - second;
+        return best_symbol;
+    }
+
+    if (cb->weight) {
+        uint64_t mask = 0, rank = 0;
+        double lowest_in = 1e300, highest_out = -1e300;
+
+        // The w most cached-looking slots
+        for (unsigned i = 0; i < cb->weight; i++) {
+            size_t best = SIZE_MAX;
+            for (size_t s = 0; s < n; s++) {
+                if (!((mask >> s) & 1) && (best == SIZE_MAX || soft[s] > soft[best]))
+                    best = s;
+            }
+            mask |= 1ULL << best;
+            if (soft[best] < lowest_in)
+                lowest_in = soft[best];
+        }
+        for (size_t s = 0; s < n; s++) {
+            if (!((mask >> s) & 1) && soft[s] > highest_out)
+                highest_out = soft[s];
+        }
+        *margin = lowest_in - highest_out;
+
+        for (unsigned s = 0, i = 0; s < n; s++) {
+            if ((mask >> s) & 1)
+                rank += codebook_binom(s, ++i);
+        }
+        return rank < codebook_symbols(cb) ? (int64_t)rank : -1;
+    }
+
+    uint64_t symbol = 0;
+    *margin = 1e300;
+    for (size_t i = 0; i < n; i++) {
+        symbol = (symbol << 1) | (soft[i] > 0);
+        if (fabs(soft[i]) < *margin)
+            *margin = fabs(soft[i]);
+    }
+    return (int64_t)symbol;
+}
+
+#endif
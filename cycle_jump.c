@@ -1,25 +1,24 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include "timing.h"
 
+// Smallest gap between two timer reads reported as a jump, in ns so it
+// means the same with the TSC and the clock fallback (100 cycles at 2.5 GHz)
+#define JUMP_NS 40
 
-static inline uint64_t rdtsc(void) {
-    unsigned hi, lo;
-    // serialize before reading tsc
-    asm volatile("lfence" ::: "memory");
-    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
-    return ((uint64_t)hi << 32) | lo;
-}
 
 int main() {
     //run a tight loop and print when we have a jump in rdtsc values
-    uint64_t last = rdtsc();
+    timing_init();
+    uint64_t jump = timing_from_ns(JUMP_NS);
+    uint64_t last = timing_start();
     while (1) {
-        uint64_t curr = rdtsc();
-        if (curr - last > 100) {
+        uint64_t curr = timing_start();
+        if (curr - last > jump) {
             printf("Cycle jump detected: %lu -> %lu (diff=%lu)\n", last, curr, curr - last);
         }
-        last = rdtsc(); //dont count the printf time
+        last = timing_start(); //dont count the printf time
     }
 
-}
\ No newline at end of file
+}
@@ -1,84 +1,509 @@
-/* This is a minimal poor man's eviction of page cache. Just load a
- * large file in RAM.
+/*
+ * Page cache pressure generator: age carrier pages out of the page cache by
+ * streaming a large backing file through it, or by asking a cgroup v2 to
+ * reclaim memory.
  *
  * Author: Novak Boškov <boskov@bu.edu>
  *
  * Created on Dec, 2019.
  *
- * Usage: ./eviction /path/to/a/large/file [create_a_large_file]
+ * Usage: ./eviction [-v] [-j threads] [-c chunk_kib] [-b mib_per_s] [-m]
+ *                   [-f free_mib | -s steal_mib] [-p passes] [-H hold_s]
+ *                   <file> [create_mib]
+ *        ./eviction [-v] -R <reclaim_mib> [-g cgroup_dir]
  *
- * If the third parameter is passed then creates a file as large as
- * the RAM of the host computer, and loads it.
+ * With create_mib the backing file is (re)written with large parallel
+ * writes first, 0 meaning as large as the RAM of the host; an existing file
+ * of the right size is reused. The file is then read by several threads in
+ * large chunks (pread, or -m: map and touch every page), so the only memory
+ * held is the page cache itself, which the kernel can always reclaim: no
+ * OOM risk, unlike loading the file into malloc()ed memory.
+ *
+ * Streaming stops once the target is reached:
+ *   -f: MemFree dropped to free_mib, i.e. the kernel must now reclaim cache
+ *       (and with it the carrier pages) for every new page,
+ *   -s: the kernel reclaimed (pgsteal) at least steal_mib since the start,
+ *   otherwise after passes full passes over the file (default 1).
+ * -b caps the read rate, -H keeps the -f target for hold_s seconds by
+ * sleeping and streaming again only when free memory grows back.
+ *
+ * -R writes to memory.reclaim of the given cgroup (default: our own) and
+ * needs no backing file.
+ *
+ * Prints one CSV record; exits with 1 if the target was not reached.
  */
 
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <stdint.h>
 
-#define B_TO_GB 1073741824.0
+#include "timing.h"
+#include "cache_reset.h"
+
+#define MIB (1024UL * 1024UL)
+#define EVICTION_DEFAULT_THREADS 4
+#define EVICTION_DEFAULT_CHUNK_KIB 2048
+// Passes over the file before an -f/-s target is given up
+#define EVICTION_MAX_PASSES 8
+#define EVICTION_POLL_US 10000
+#define EVICTION_FILL 0x1
+
+struct stream_ctx {
+    int fd;
+    size_t file_size;
+    size_t span;                // file_size rounded up to whole chunks
+    size_t chunk;
+    size_t max_bytes;           // stop after this much, all threads together
+    double bytes_per_ns;        // 0: unthrottled
+    bool use_mmap;
+    uint64_t begin_ns;          // of the current stream() call, the rate cap counts from here
+    atomic_size_t cursor;       // next chunk to read, in bytes, wraps around the file
+    atomic_size_t streamed;     // by the current stream() call
+    atomic_bool stop;
+    atomic_bool failed;
+};
+
+// Field of a "name value" file such as /proc/meminfo, /proc/vmstat; -1 if missing.
+static long long read_stat(const char *path, const char *name)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    size_t len = strlen(name);
+    long long value = -1;
+
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, name, len) == 0 && (line[len] == ':' || line[len] == ' ')) {
+            value = strtoll(line + len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+static long long mem_free_kib(void)
+{
+    return read_stat("/proc/meminfo", "MemFree");
+}
+
+// Pages reclaimed by kswapd and direct reclaim since boot
+static long long pages_stolen(void)
+{
+    long long kswapd = read_stat("/proc/vmstat", "pgsteal_kswapd");
+    long long direct = read_stat("/proc/vmstat", "pgsteal_direct");
+    return kswapd < 0 || direct < 0 ? -1 : kswapd + direct;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+    struct timespec ts = { .tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        ;
+}
+
+struct create_ctx {
+    int fd;
+    size_t size;
+    size_t chunk;
+    atomic_size_t cursor;
+    atomic_bool failed;
+};
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Needs 1 arg.\n");
+static void *create_worker(void *arg)
+{
+    struct create_ctx *c = arg;
+    char *buf = malloc(c->chunk);
+
+    if (!buf) {
+        atomic_store(&c->failed, true);
+        return NULL;
+    }
+    memset(buf, EVICTION_FILL, c->chunk);
+
+    for (;;) {
+        size_t off = atomic_fetch_add(&c->cursor, c->chunk);
+        if (off >= c->size)
+            break;
+        size_t len = c->size - off < c->chunk ? c->size - off : c->chunk;
+        if (pwrite(c->fd, buf, len, off) != (ssize_t)len) {
+            perror("pwrite");
+            atomic_store(&c->failed, true);
+            break;
+        }
+        // Write back as we go so creation never piles up dirty pages
+        sync_file_range(c->fd, off, len, SYNC_FILE_RANGE_WRITE);
+    }
+    free(buf);
+    return NULL;
+}
+
+// Write size bytes to path with num_threads writers, unless it already has that size.
+static int create_file(const char *path, size_t size, size_t chunk, int num_threads, bool verbose)
+{
+    struct stat st;
+    struct create_ctx c = { .size = size, .chunk = chunk };
+    pthread_t threads[num_threads];
+
+    if (stat(path, &st) == 0 && (size_t)st.st_size == size) {
+        if (verbose)
+            fprintf(stderr, "Reusing %s (%.2f GB)\n", path, size / (double)(1024 * MIB));
         return 0;
-    } else if (argc == 3) {
-        // Create the file as big as RAM
-        size_t ram_bytes = sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
-        float ram_gb = ram_bytes / B_TO_GB;
+    }
 
-        printf("A %.2f GB file will be created in %s\n", ram_gb, argv[1]);
+    c.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (c.fd == -1) {
+        fprintf(stderr, "Failed to create file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (verbose)
+        fprintf(stderr, "Creating %s (%.2f GB) with %d writers\n", path,
+                size / (double)(1024 * MIB), num_threads);
+    // Only a hint for the allocator, plain writes follow anyway
+    posix_fallocate(c.fd, 0, size);
+    atomic_init(&c.cursor, 0);
+    atomic_init(&c.failed, false);
 
-        FILE *f_write = fopen(argv[1], "wb");
-        char to_write = 0x1;
-        int progress = 0;
-        for (size_t i = 0; i < ram_bytes; i++) {
-            if (i % (int)B_TO_GB == 0)
-                printf("%d/%.2f GB...\n", progress++, ram_gb);
+    for (int i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, create_worker, &c);
+    for (int i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
 
-            fwrite(&to_write, 1, 1, f_write);
+    if (!atomic_load(&c.failed) && fdatasync(c.fd) == -1) {
+        perror("fdatasync");
+        atomic_store(&c.failed, true);
+    }
+    close(c.fd);
+    return atomic_load(&c.failed) ? -1 : 0;
+}
+
+static void *stream_worker(void *arg)
+{
+    struct stream_ctx *s = arg;
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    char *buf = s->use_mmap ? NULL : malloc(s->chunk);
+    volatile char sink = 0;
+
+    if (!s->use_mmap && !buf) {
+        atomic_store(&s->failed, true);
+        atomic_store(&s->stop, true);
+        return NULL;
+    }
+
+    while (!atomic_load(&s->stop)) {
+        size_t pos = atomic_fetch_add(&s->cursor, s->chunk);
+        size_t off = pos % s->span;
+        size_t len = s->file_size - off < s->chunk ? s->file_size - off : s->chunk;
+
+        if (pos >= s->max_bytes)
+            break;
+
+        if (s->use_mmap) {
+            char *map = mmap(NULL, len, PROT_READ, MAP_SHARED, s->fd, off);
+            if (map == MAP_FAILED) {
+                perror("mmap");
+                atomic_store(&s->failed, true);
+                break;
+            }
+            madvise(map, len, MADV_SEQUENTIAL);
+            for (size_t i = 0; i < len; i += pg_size)
+                sink += map[i];
+            munmap(map, len);
+        } else if (pread(s->fd, buf, len, off) == -1) {
+            perror("pread");
+            atomic_store(&s->failed, true);
+            break;
         }
-        fclose(f_write);
 
-        printf("A %.2f GB file created in %s\n", ram_gb, argv[1]);
+        size_t done = atomic_fetch_add(&s->streamed, len) + len;
+        if (s->bytes_per_ns > 0) {
+            // Sleep until the rate cap allows the bytes streamed so far
+            uint64_t due = s->begin_ns + (uint64_t)(done / s->bytes_per_ns);
+            uint64_t now = timing_monotonic_ns();
+            if (due > now)
+                sleep_ns(due - now);
+        }
     }
+    (void)sink;
+    free(buf);
+    if (atomic_load(&s->failed))
+        atomic_store(&s->stop, true);
+    return NULL;
+}
+
+/*
+ * Stream the file until the target is met or max_bytes are read. The
+ * caller's thread polls the target. Returns true if it was reached.
+ */
+static bool stream(struct stream_ctx *s, int num_threads, long long free_kib_target,
+                   long long steal_target, long long steal_base)
+{
+    pthread_t threads[num_threads];
+    bool reached = false;
+
+    // Every call, a top-up too, is rate capped from its own start
+    s->begin_ns = timing_monotonic_ns();
+    atomic_store(&s->streamed, 0);
+    atomic_store(&s->stop, false);
+    for (int i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, stream_worker, s);
+
+    for (;;) {
+        if (free_kib_target >= 0 && mem_free_kib() <= free_kib_target)
+            reached = true;
+        if (steal_target >= 0 && pages_stolen() - steal_base >= steal_target)
+            reached = true;
+        if (reached || atomic_load(&s->stop) ||
+            atomic_load(&s->cursor) >= s->max_bytes + num_threads * s->chunk)
+            break;
+        usleep(EVICTION_POLL_US);
+    }
+    atomic_store(&s->stop, true);
+    for (int i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    // A plain pass target is reached once every byte went through the cache
+    if (free_kib_target < 0 && steal_target < 0)
+        reached = !atomic_load(&s->failed) && atomic_load(&s->cursor) >= s->max_bytes;
+    return reached;
+}
+
+// cgroup v2 directory of this process
+static int own_cgroup(char *dir, size_t len)
+{
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    char line[4096];
+    int ret = -1;
+
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            // Hybrid hierarchies mount v2 under unified/
+            const char *root = access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0 ?
+                               "/sys/fs/cgroup" : "/sys/fs/cgroup/unified";
+            int n = snprintf(dir, len, "%s%s", root, strcmp(line + 3, "/") == 0 ? "" : line + 3);
+            if (n < 0 || (size_t)n >= len)
+                fprintf(stderr, "cgroup path too long: %s%s\n", root, line + 3);
+            else
+                ret = 0;
+            break;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+// Ask the cgroup to reclaim mib; 0 if all of it was reclaimed.
+static int cgroup_reclaim(const char *cgroup, size_t mib, bool verbose)
+{
+    char dir[4096], path[4200], request[32];
+    long long steal_before = pages_stolen();
+    int ret = 0;
+
+    if (cgroup)
+        snprintf(dir, sizeof(dir), "%s", cgroup);
+    else if (own_cgroup(dir, sizeof(dir)) == -1) {
+        fprintf(stderr, "Cannot find our cgroup v2 directory, pass one with -g\n");
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/memory.reclaim", dir);
+
+    uint64_t begin_ns = timing_monotonic_ns();
+    int fd = open(path, O_WRONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to open %s: %s (needs cgroup v2, Linux 5.19+)\n",
+                path, strerror(errno));
+        return -1;
+    }
+    int n = snprintf(request, sizeof(request), "%zu", mib * MIB);
+    // EAGAIN: the cgroup could not reclaim the whole amount
+    if (write(fd, request, n) == -1) {
+        if (verbose)
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        ret = 1;
+    }
+    close(fd);
+    uint64_t end_ns = timing_monotonic_ns();
 
-    int pg_size = sysconf(_SC_PAGESIZE);
-    int fd = open(argv[1], O_RDONLY);
-    struct stat f_stat;
-    fstat(fd, &f_stat);
-    int pgs_in_f = f_stat.st_size / pg_size;
-    int lst_pg_B = f_stat.st_size % pg_size;
-    unsigned char *load = malloc(f_stat.st_size);
+    long long stolen = pages_stolen() - steal_before;
+    printf("%s,%zu,%.2f,%lu,%s\n", dir, mib,
+           steal_before < 0 ? -1.0 : stolen * (double)sysconf(_SC_PAGESIZE) / MIB,
+           end_ns - begin_ns, ret ? "partial" : "ok");
+    return ret;
+}
 
-    printf("Loading %s (%.2fGB)\n"
-           "Normally, I would get killed by the kernel when RAM is full.\n"
-           "Very stealthy, right? Right?...\n\n",
-           argv[1], f_stat.st_size / B_TO_GB);
+int main(int argc, char *argv[])
+{
+    bool verbose = false;
+    bool use_mmap = false;
+    int num_threads = EVICTION_DEFAULT_THREADS;
+    size_t chunk_kib = EVICTION_DEFAULT_CHUNK_KIB;
+    double rate_mib = 0;
+    long long free_mib = -1, steal_mib = -1, reclaim_mib = -1;
+    long passes = 0;
+    long hold_s = 0;
+    const char *cgroup = NULL;
+    int arg_idx = 1;
 
-    // Load file page by page
-    for (int i = 0, part = 0; i < pgs_in_f; i++) {
-        int ret = read(fd, load + ((uintptr_t)i * pg_size), pg_size);
+    // Check for flags
+    while (arg_idx < argc && argv[arg_idx][0] == '-') {
+        const char *flag = argv[arg_idx];
+        bool has_value = arg_idx + 1 < argc;
 
-        if (ret == -1) {
-            printf("There is an issue with reading\n");
-            exit(1);
+        if (strcmp(flag, "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(flag, "-m") == 0) {
+            use_mmap = true;
+        } else if (strcmp(flag, "-j") == 0 && has_value) {
+            num_threads = atoi(argv[++arg_idx]);
+        } else if (strcmp(flag, "-c") == 0 && has_value) {
+            chunk_kib = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(flag, "-b") == 0 && has_value) {
+            rate_mib = atof(argv[++arg_idx]);
+        } else if (strcmp(flag, "-f") == 0 && has_value) {
+            free_mib = atoll(argv[++arg_idx]);
+        } else if (strcmp(flag, "-s") == 0 && has_value) {
+            steal_mib = atoll(argv[++arg_idx]);
+        } else if (strcmp(flag, "-p") == 0 && has_value) {
+            passes = atol(argv[++arg_idx]);
+        } else if (strcmp(flag, "-H") == 0 && has_value) {
+            hold_s = atol(argv[++arg_idx]);
+        } else if (strcmp(flag, "-R") == 0 && has_value) {
+            reclaim_mib = atoll(argv[++arg_idx]);
+        } else if (strcmp(flag, "-g") == 0 && has_value) {
+            cgroup = argv[++arg_idx];
+        } else {
+            break;
         }
+        arg_idx++;
+    }
+
+    timing_init();
+
+    if (reclaim_mib >= 0) {
+        if (verbose)
+            printf("cgroup,requested_mib,reclaimed_mib,reclaim_ns,result\n");
+        int ret = cgroup_reclaim(cgroup, reclaim_mib, verbose);
+        fflush(stdout);
+        return ret ? 1 : 0;
+    }
+
+    if (argc < arg_idx + 1 || num_threads < 1 || chunk_kib == 0 ||
+        (free_mib >= 0 && steal_mib >= 0)) {
+        fprintf(stderr, "Usage: %s [-v] [-j threads] [-c chunk_kib] [-b mib_per_s] [-m]\n"
+                        "       [-f free_mib | -s steal_mib] [-p passes] [-H hold_s] <file> [create_mib]\n"
+                        "       %s [-v] -R <reclaim_mib> [-g cgroup_dir]\n", argv[0], argv[0]);
+        fprintf(stderr, "  create_mib: write the file first, 0 = RAM size\n");
+        fprintf(stderr, "  -j: reader/writer threads (default %d)\n", EVICTION_DEFAULT_THREADS);
+        fprintf(stderr, "  -c: read/write size (default %d KiB)\n", EVICTION_DEFAULT_CHUNK_KIB);
+        fprintf(stderr, "  -b: cap the read rate\n");
+        fprintf(stderr, "  -m: map and touch pages instead of pread\n");
+        fprintf(stderr, "  -f: stop once MemFree is down to free_mib\n");
+        fprintf(stderr, "  -s: stop once the kernel reclaimed steal_mib\n");
+        fprintf(stderr, "  -p: passes over the file (default 1, %d with -f/-s)\n", EVICTION_MAX_PASSES);
+        fprintf(stderr, "  -H: keep the -f target for hold_s seconds\n");
+        fprintf(stderr, "  -R: reclaim from a cgroup v2 via memory.reclaim\n");
+        exit(EBADF);
+    }
+
+    const char *filename = argv[arg_idx];
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    size_t chunk = (chunk_kib * 1024 + pg_size - 1) / pg_size * pg_size;
+    uint64_t create_ns = 0;
+
+    if (argc > arg_idx + 1) {
+        size_t size = strtoull(argv[arg_idx + 1], NULL, 10) * MIB;
+        if (size == 0)
+            size = (size_t)sysconf(_SC_PHYS_PAGES) * pg_size;
+        uint64_t begin_ns = timing_monotonic_ns();
+        if (create_file(filename, size, chunk, num_threads, verbose) == -1)
+            exit(EIO);
+        create_ns = timing_monotonic_ns() - begin_ns;
+    }
 
-        if (i % (pgs_in_f / 10) == 0)
-            printf("Read %d%%, file offset: %lu\n", part++ * 10,
-                   lseek(fd, 0, SEEK_CUR));
+    struct stream_ctx s = { .chunk = chunk, .use_mmap = use_mmap };
+    struct stat st;
+    s.fd = open(filename, O_RDONLY);
+    if (s.fd == -1 || fstat(s.fd, &st) == -1 || st.st_size == 0) {
+        fprintf(stderr, "Failed to open file %s: %s\n", filename,
+                s.fd == -1 ? strerror(errno) : "empty");
+        exit(EBADF);
     }
+    s.file_size = st.st_size;
+    s.span = (s.file_size + chunk - 1) / chunk * chunk;
 
-    // If file is not page-aligned, read the remaining bytes
-    if (lst_pg_B) {
-        int ret = read(fd, load + (pgs_in_f * pg_size), lst_pg_B);
-        printf("Tail of %d bytes is read.\n", ret);
+    if (passes <= 0)
+        passes = free_mib >= 0 || steal_mib >= 0 ? EVICTION_MAX_PASSES : 1;
+    s.max_bytes = passes * s.span;
+    s.bytes_per_ns = rate_mib * MIB / 1e9;
+
+    // Start from disk, not from what creation or an earlier run left cached
+    cache_reset(s.fd, 0, (s.file_size + pg_size - 1) / pg_size, false);
+    posix_fadvise(s.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    long long free_before = mem_free_kib();
+    long long steal_base = pages_stolen();
+    long long free_target = free_mib >= 0 ? free_mib * 1024 : -1;
+    long long steal_target = steal_mib >= 0 ? steal_mib * (long long)(MIB / pg_size) : -1;
+
+    if (steal_target >= 0 && steal_base < 0) {
+        fprintf(stderr, "No pgsteal counters in /proc/vmstat\n");
+        exit(ENOTSUP);
+    }
+    if (verbose) {
+        fprintf(stderr, "Streaming %s (%.2f GB), %d threads, %zu KiB %s, MemFree %lld MiB\n",
+                filename, s.file_size / (double)(1024 * MIB), num_threads, chunk / 1024,
+                use_mmap ? "mmap" : "pread", free_before / 1024);
+        printf("filename,file_mib,threads,chunk_kib,mode,streamed_mib,create_ns,stream_ns,"
+               "mib_per_s,memfree_before_mib,memfree_after_mib,reclaimed_mib,target_reached\n");
+    }
+
+    atomic_init(&s.cursor, 0);
+    atomic_init(&s.streamed, 0);
+    atomic_init(&s.stop, false);
+    atomic_init(&s.failed, false);
+    bool reached = stream(&s, num_threads, free_target, steal_target, steal_base);
+    uint64_t stream_ns = timing_monotonic_ns() - s.begin_ns;
+    long long free_after = mem_free_kib();
+    long long stolen = steal_base < 0 ? -1 : pages_stolen() - steal_base;
+    size_t streamed = atomic_load(&s.streamed);
+
+    printf("%s,%zu,%d,%zu,%s,%zu,%lu,%lu,%.2f,%lld,%lld,%.2f,%d\n", filename,
+           s.file_size / MIB, num_threads, chunk / 1024, use_mmap ? "mmap" : "pread",
+           streamed / MIB, create_ns, stream_ns, streamed / (double)MIB / (stream_ns / 1e9),
+           free_before / 1024, free_after / 1024,
+           stolen < 0 ? -1.0 : stolen * (double)pg_size / MIB, reached);
+    fflush(stdout);
+
+    // Sleep while the pressure lasts, top it up only when free memory comes back
+    if (reached && hold_s > 0 && free_target >= 0) {
+        uint64_t hold_end = timing_monotonic_ns() + hold_s * 1000000000ULL;
+        while (timing_monotonic_ns() < hold_end && !atomic_load(&s.failed)) {
+            if (mem_free_kib() > free_target) {
+                s.max_bytes = atomic_load(&s.cursor) + s.span;
+                stream(&s, num_threads, free_target, -1, steal_base);
+                if (verbose)
+                    fprintf(stderr, "Topped up, MemFree %lld MiB\n", mem_free_kib() / 1024);
+            }
+            sleep_ns(100 * 1000000ULL);
+        }
     }
 
-    printf("Interrupt program to release RAM.\n");
-    // Don't finish the program. Keep RAM occupied if not killed by now.
-    for( ; ; ) {}
+    close(s.fd);
+    return reached && !atomic_load(&s.failed) ? 0 : 1;
 }
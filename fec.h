@@ -0,0 +1,216 @@
+/*
+ * Forward error correction for the strided channel
+ *
+ * Codes (selected with -e on sender_stride/receiver_stride):
+ *   none     raw bits
+ *   hamming  Hamming(7,4), systematic: d1 d2 d3 d4 p1 p2 p3 per 4 data bits,
+ *            data zero-padded to a multiple of 4
+ *   conv     rate 1/2 convolutional code, K=7, generators 0171/0133,
+ *            terminated with 6 zero tail bits
+ *
+ * Decoders take soft inputs, one value per coded bit in [-1, 1]: positive
+ * means cached ('1'), the magnitude is the confidence. Hamming blocks are
+ * decoded by maximum correlation over all 16 codewords, the convolutional
+ * code with a 64-state soft Viterbi decoder.
+ */
+
+#ifndef FEC_H
+#define FEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FEC_CONV_K 7
+#define FEC_CONV_STATES (1 << (FEC_CONV_K - 1))
+#define FEC_CONV_G1 0171
+#define FEC_CONV_G2 0133
+
+enum fec_code {
+    FEC_NONE,
+    FEC_HAMMING74,
+    FEC_CONV,
+};
+
+static const char *const fec_names[] = {
+    [FEC_NONE] = "none",
+    [FEC_HAMMING74] = "hamming",
+    [FEC_CONV] = "conv",
+};
+
+static int fec_parse(const char *name, enum fec_code *code)
+{
+    for (size_t i = 0; i < sizeof(fec_names) / sizeof(fec_names[0]); i++) {
+        if (strcmp(name, fec_names[i]) == 0) {
+            *code = (enum fec_code)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Carrier bits needed for data_bits of payload
+static size_t fec_encoded_bits(enum fec_code code, size_t data_bits)
+{
+    switch (code) {
+    case FEC_HAMMING74:
+        return (data_bits + 3) / 4 * 7;
+    case FEC_CONV:
+        return 2 * (data_bits + FEC_CONV_K - 1);
+    default:
+        return data_bits;
+    }
+}
+
+// Payload bits that fit into coded_bits carrier bits
+static size_t fec_data_bits(enum fec_code code, size_t coded_bits)
+{
+    switch (code) {
+    case FEC_HAMMING74:
+        return coded_bits / 7 * 4;
+    case FEC_CONV:
+        return coded_bits / 2 > FEC_CONV_K - 1 ? coded_bits / 2 - (FEC_CONV_K - 1) : 0;
+    default:
+        return coded_bits;
+    }
+}
+
+static inline unsigned fec_hamming_codeword(unsigned nibble)
+{
+    unsigned d1 = (nibble >> 3) & 1, d2 = (nibble >> 2) & 1;
+    unsigned d3 = (nibble >> 1) & 1, d4 = nibble & 1;
+
+    return (nibble << 3) | ((d1 ^ d2 ^ d4) << 2) | ((d1 ^ d3 ^ d4) << 1) | (d2 ^ d3 ^ d4);
+}
+
+static inline unsigned fec_conv_outputs(unsigned reg)
+{
+    return (__builtin_parity(reg & FEC_CONV_G1) << 1) | __builtin_parity(reg & FEC_CONV_G2);
+}
+
+// Encode data bits (0/1 values) into coded; returns fec_encoded_bits().
+static size_t fec_encode(enum fec_code code, const unsigned char *data, size_t data_bits,
+                         unsigned char *coded)
+{
+    size_t pos = 0;
+
+    switch (code) {
+    case FEC_HAMMING74:
+        for (size_t i = 0; i < data_bits; i += 4) {
+            unsigned nibble = 0;
+            for (size_t b = 0; b < 4; b++)
+                nibble = (nibble << 1) | (i + b < data_bits ? data[i + b] & 1 : 0);
+            unsigned word = fec_hamming_codeword(nibble);
+            for (int b = 6; b >= 0; b--)
+                coded[pos++] = (word >> b) & 1;
+        }
+        return pos;
+    case FEC_CONV: {
+        unsigned reg = 0;
+        for (size_t i = 0; i < data_bits + FEC_CONV_K - 1; i++) {
+            unsigned u = i < data_bits ? data[i] & 1 : 0;
+            reg = ((reg << 1) | u) & ((1u << FEC_CONV_K) - 1);
+            unsigned out = fec_conv_outputs(reg);
+            coded[pos++] = out >> 1;
+            coded[pos++] = out & 1;
+        }
+        return pos;
+    }
+    default:
+        memcpy(coded, data, data_bits);
+        return data_bits;
+    }
+}
+
+static void fec_decode_hamming(const double *soft, size_t data_bits, unsigned char *data)
+{
+    for (size_t i = 0, blk = 0; i < data_bits; i += 4, blk += 7) {
+        double best = -1e300;
+        unsigned best_nibble = 0;
+
+        for (unsigned nibble = 0; nibble < 16; nibble++) {
+            unsigned word = fec_hamming_codeword(nibble);
+            double corr = 0;
+            for (int b = 0; b < 7; b++)
+                corr += (word >> (6 - b)) & 1 ? soft[blk + b] : -soft[blk + b];
+            if (corr > best) {
+                best = corr;
+                best_nibble = nibble;
+            }
+        }
+        for (size_t b = 0; b < 4 && i + b < data_bits; b++)
+            data[i + b] = (best_nibble >> (3 - b)) & 1;
+    }
+}
+
+static int fec_decode_conv(const double *soft, size_t data_bits, unsigned char *data)
+{
+    size_t steps = data_bits + FEC_CONV_K - 1;
+    uint64_t *decisions = malloc(steps * sizeof(uint64_t));
+    double metric[FEC_CONV_STATES], next[FEC_CONV_STATES];
+
+    if (!decisions)
+        return -1;
+
+    // Encoder starts in state 0
+    for (unsigned s = 0; s < FEC_CONV_STATES; s++)
+        metric[s] = s == 0 ? 0.0 : -1e300;
+
+    for (size_t t = 0; t < steps; t++) {
+        double a = soft[2 * t], b = soft[2 * t + 1];
+        uint64_t decided = 0;
+
+        for (unsigned ns = 0; ns < FEC_CONV_STATES; ns++) {
+            double best = -1e300;
+            unsigned best_msb = 0;
+
+            // ns = low 6 bits of the register; the predecessor adds one older bit
+            for (unsigned msb = 0; msb < 2; msb++) {
+                unsigned prev = (ns >> 1) | (msb << (FEC_CONV_K - 2));
+                unsigned out = fec_conv_outputs((msb << (FEC_CONV_K - 1)) | ns);
+                double m = metric[prev] + (out & 2 ? a : -a) + (out & 1 ? b : -b);
+                if (m > best) {
+                    best = m;
+                    best_msb = msb;
+                }
+            }
+            next[ns] = best;
+            decided |= (uint64_t)best_msb << ns;
+        }
+        decisions[t] = decided;
+        memcpy(metric, next, sizeof(metric));
+    }
+
+    // Terminated: trace back from state 0
+    unsigned state = 0;
+    for (size_t t = steps; t-- > 0;) {
+        if (t < data_bits)
+            data[t] = state & 1;
+        unsigned msb = (decisions[t] >> state) & 1;
+        state = (state >> 1) | (msb << (FEC_CONV_K - 2));
+    }
+
+    free(decisions);
+    return 0;
+}
+
+// Decode data_bits payload bits from fec_encoded_bits(code, data_bits) soft values.
+static int fec_decode(enum fec_code code, const double *soft, size_t data_bits,
+                      unsigned char *data)
+{
+    switch (code) {
+    case FEC_HAMMING74:
+        fec_decode_hamming(soft, data_bits, data);
+        return 0;
+    case FEC_CONV:
+        return fec_decode_conv(soft, data_bits, data);
+    default:
+        for (size_t i = 0; i < data_bits; i++)
+            data[i] = soft[i] > 0;
+        return 0;
+    }
+}
+
+#endif
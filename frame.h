@@ -0,0 +1,139 @@
+/*
+ * Frame format of the streaming mode of sender_stride/receiver_stride
+ *
+ *   | preamble 16 | seq 8 | len 8 | payload len*8 | crc8 8 |
+ *
+ * Bits are sent MSB first, one bit per strided page. The preamble is the
+ * 13-bit Barker code followed by 000, which the receiver finds again even
+ * with a few flipped bits or a small offset. The CRC-8 (poly 0x07) covers
+ * seq, len and payload.
+ *
+ * Each frame owns a fixed region of FRAME_SLOT_BITS strided pages (more when
+ * an error correcting code is applied, see fec.h); frame slot k goes to
+ * region k % num_regions. Slots are aligned to multiples of
+ * the frame interval on CLOCK_REALTIME, which co-located containers share,
+ * so both sides agree on the current slot without talking to each other.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAME_PREAMBLE 0xF9A8u
+#define FRAME_PREAMBLE_BITS 16
+#define FRAME_MAX_PAYLOAD 32
+#define FRAME_HEADER_BITS (FRAME_PREAMBLE_BITS + 8 + 8)
+#define FRAME_SLOT_BITS (FRAME_HEADER_BITS + FRAME_MAX_PAYLOAD * 8 + 8)
+// Preamble may start this many bits into the region
+#define FRAME_MAX_OFFSET 4
+// Flipped preamble bits still accepted as a match
+#define FRAME_PREAMBLE_TOLERANCE 2
+
+// Strided page index carrying bit `bit` of the slot_bits wide `region`
+static inline size_t frame_page(size_t region, size_t slot_bits, size_t bit, size_t page_stride)
+{
+    return (region * slot_bits + bit) * page_stride;
+}
+
+// Sleep until the given CLOCK_REALTIME instant.
+static inline void frame_sleep_until(uint64_t realtime_ns)
+{
+    struct timespec ts = {
+        .tv_sec = realtime_ns / 1000000000ULL,
+        .tv_nsec = realtime_ns % 1000000000ULL,
+    };
+
+    while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) != 0)
+        ;
+}
+
+static inline uint8_t frame_crc8(uint8_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static inline size_t frame_put_bits(unsigned char *bits, size_t pos, uint32_t value, int width)
+{
+    for (int b = width - 1; b >= 0; b--)
+        bits[pos++] = (value >> b) & 1;
+    return pos;
+}
+
+static inline uint32_t frame_get_bits(const unsigned char *bits, size_t pos, int width)
+{
+    uint32_t value = 0;
+    for (int b = 0; b < width; b++)
+        value = (value << 1) | (bits[pos + b] & 1);
+    return value;
+}
+
+// Encode one frame into bits (FRAME_SLOT_BITS entries, unused tail is 0).
+// Returns the number of bits that carry the frame.
+static size_t frame_encode(unsigned char *bits, uint8_t seq, const uint8_t *payload, uint8_t len)
+{
+    uint8_t header[2] = { seq, len };
+    uint8_t crc = frame_crc8(frame_crc8(0, header, 2), payload, len);
+    size_t pos = 0;
+
+    memset(bits, 0, FRAME_SLOT_BITS);
+    pos = frame_put_bits(bits, pos, FRAME_PREAMBLE, FRAME_PREAMBLE_BITS);
+    pos = frame_put_bits(bits, pos, seq, 8);
+    pos = frame_put_bits(bits, pos, len, 8);
+    for (uint8_t i = 0; i < len; i++)
+        pos = frame_put_bits(bits, pos, payload[i], 8);
+    pos = frame_put_bits(bits, pos, crc, 8);
+    return pos;
+}
+
+/*
+ * Look for a frame in the num_bits received bits. Returns 0 and fills seq,
+ * payload and len for a frame with a valid CRC, -1 if there is no preamble
+ * and -2 if the preamble matched but the frame is corrupt.
+ */
+static int frame_decode(const unsigned char *bits, size_t num_bits,
+                        uint8_t *seq, uint8_t *payload, uint8_t *len)
+{
+    int ret = -1;
+
+    for (size_t off = 0; off <= FRAME_MAX_OFFSET; off++) {
+        if (off + FRAME_HEADER_BITS + 8 > num_bits)
+            break;
+
+        uint32_t preamble = frame_get_bits(bits, off, FRAME_PREAMBLE_BITS);
+        if (__builtin_popcount(preamble ^ FRAME_PREAMBLE) > FRAME_PREAMBLE_TOLERANCE)
+            continue;
+
+        ret = -2;
+        size_t pos = off + FRAME_PREAMBLE_BITS;
+        uint8_t header[2];
+        header[0] = frame_get_bits(bits, pos, 8);
+        header[1] = frame_get_bits(bits, pos + 8, 8);
+        pos += 16;
+        if (header[1] > FRAME_MAX_PAYLOAD || pos + header[1] * 8 + 8 > num_bits)
+            continue;
+
+        for (uint8_t i = 0; i < header[1]; i++, pos += 8)
+            payload[i] = frame_get_bits(bits, pos, 8);
+        uint8_t crc = frame_get_bits(bits, pos, 8);
+        if (crc != frame_crc8(frame_crc8(0, header, 2), payload, header[1]))
+            continue;
+
+        *seq = header[0];
+        *len = header[1];
+        return 0;
+    }
+
+    return ret;
+}
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * Online latency statistics in constant memory
+ *
+ * A log-linear (HDR style) histogram: values below 2^HIST_SUB_BITS get a
+ * bucket each, above that every power of two is split into
+ * 2^HIST_SUB_BITS equal buckets, so a bucket is never wider than 1/32 of
+ * its lower bound (about 3% quantile error) over the whole uint64 range.
+ * Count, exact mean (Welford), variance, min and max are kept alongside.
+ *
+ * The probe loops feed one histogram per class (hot / cold decision) and
+ * hist_save() writes them as a text file, '#' starts a comment:
+ *   stats <class> <samples> <mean> <stddev> <min> <p50> <p90> <p99> <p99.9> <max>
+ *   bucket <class> <lower> <upper> <count>      non-empty buckets only
+ * plotCsvBins.py --hist renders it.
+ */
+
+#ifndef HIST_H
+#define HIST_H
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_BUCKETS (1U << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct hist {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double mean;
+    double m2;
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+static inline void hist_init(struct hist *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+static inline unsigned hist_index(uint64_t v)
+{
+    if (v < HIST_SUB_BUCKETS)
+        return v;
+    unsigned e = 63 - __builtin_clzll(v);
+    unsigned shift = e - HIST_SUB_BITS;
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS + ((v >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+static inline uint64_t hist_lower(unsigned idx)
+{
+    if (idx < HIST_SUB_BUCKETS)
+        return idx;
+    unsigned shift = idx / HIST_SUB_BUCKETS - 1;
+    return (uint64_t)(HIST_SUB_BUCKETS + idx % HIST_SUB_BUCKETS) << shift;
+}
+
+// Last value that still falls into bucket idx
+static inline uint64_t hist_upper(unsigned idx)
+{
+    if (idx < HIST_SUB_BUCKETS)
+        return idx;
+    return hist_lower(idx) + ((1ULL << (idx / HIST_SUB_BUCKETS - 1)) - 1);
+}
+
+static inline void hist_add(struct hist *h, uint64_t v)
+{
+    double delta = (double)v - h->mean;
+
+    h->count++;
+    h->mean += delta / h->count;
+    h->m2 += delta * ((double)v - h->mean);
+    if (v < h->min)
+        h->min = v;
+    if (v > h->max)
+        h->max = v;
+    h->buckets[hist_index(v)]++;
+}
+
+// dst += src, with the pooled mean and variance
+static void hist_merge(struct hist *dst, const struct hist *src)
+{
+    if (src->count == 0)
+        return;
+    double n = dst->count + src->count;
+    double delta = src->mean - dst->mean;
+
+    dst->m2 += src->m2 + delta * delta * dst->count * src->count / n;
+    dst->mean += delta * src->count / n;
+    dst->count += src->count;
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+}
+
+static inline double hist_stddev(const struct hist *h)
+{
+    return h->count > 1 ? sqrt(h->m2 / (h->count - 1)) : 0.0;
+}
+
+// Value at quantile q (0..1): midpoint of its bucket, clamped to [min, max].
+static uint64_t hist_quantile(const struct hist *h, double q)
+{
+    if (h->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)ceil(q * h->count);
+    uint64_t seen = 0;
+
+    if (rank == 0)
+        rank = 1;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = hist_lower(i) + (hist_upper(i) - hist_lower(i)) / 2;
+            return v < h->min ? h->min : v > h->max ? h->max : v;
+        }
+    }
+    return h->max;
+}
+
+// Threshold (the first value called cold) that misclassifies the fewest
+// samples of hot and cold, their number in *errors.
+static uint64_t hist_split(const struct hist *hot, const struct hist *cold, uint64_t *errors)
+{
+    uint64_t hot_above = hot->count, cold_below = 0;
+    uint64_t best = hot_above, threshold = 0;
+
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        hot_above -= hot->buckets[i];
+        cold_below += cold->buckets[i];
+        if (hot_above + cold_below < best) {
+            best = hot_above + cold_below;
+            threshold = hist_upper(i) + 1;
+        }
+    }
+    *errors = best;
+    return threshold;
+}
+
+// One-line summary, e.g. for verbose output.
+static void hist_print(FILE *out, const char *name, const struct hist *h)
+{
+    fprintf(out, "%s: %lu samples, mean %.1f, stddev %.1f, p50 %lu, p90 %lu, p99 %lu, "
+                 "p99.9 %lu, min %lu, max %lu\n",
+            name, h->count, h->mean, hist_stddev(h), hist_quantile(h, 0.5),
+            hist_quantile(h, 0.9), hist_quantile(h, 0.99), hist_quantile(h, 0.999),
+            h->count ? h->min : 0, h->max);
+}
+
+static void hist_write(FILE *f, const char *name, const struct hist *h)
+{
+    fprintf(f, "stats %s %lu %.3f %.3f %lu %lu %lu %lu %lu %lu\n", name, h->count, h->mean,
+            hist_stddev(h), h->count ? h->min : 0, hist_quantile(h, 0.5), hist_quantile(h, 0.9),
+            hist_quantile(h, 0.99), hist_quantile(h, 0.999), h->max);
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        if (h->buckets[i])
+            fprintf(f, "bucket %s %lu %lu %lu\n", name, hist_lower(i), hist_upper(i),
+                    h->buckets[i]);
+    }
+}
+
+// Write the hot and cold histograms and their union ("all") to path.
+static int hist_save(const char *path, const struct hist *hot, const struct hist *cold)
+{
+    FILE *f = fopen(path, "w");
+    struct hist all;
+
+    if (!f) {
+        fprintf(stderr, "Failed to write statistics %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    hist_init(&all);
+    hist_merge(&all, hot);
+    hist_merge(&all, cold);
+
+    fprintf(f, "# stats <class> <samples> <mean> <stddev> <min> <p50> <p90> <p99> <p99.9> <max>\n"
+               "# bucket <class> <lower> <upper> <count>\n");
+    hist_write(f, "hot", hot);
+    hist_write(f, "cold", cold);
+    hist_write(f, "all", &all);
+    fclose(f);
+    return 0;
+}
+
+#endif
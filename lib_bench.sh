@@ -0,0 +1,28 @@
+# Helpers shared by the channel benchmarks, source it (it brings in
+# lib_evict.sh as well):
+#   . "$(dirname "$0")/lib_bench.sh"
+
+. "$(dirname "${BASH_SOURCE[0]}")/lib_evict.sh"
+
+# random_pattern <bits>: that many random '0'/'1' characters
+random_pattern() {
+    head -c $1 /dev/urandom | od -An -v -tu1 | tr -s ' ' '\n' | grep -v '^$' \
+        | awk '{printf "%d", $1 % 2}'
+}
+
+# bit_errors <sent> <received>: bits of sent that received gets wrong
+bit_errors() {
+    awk -v a="$1" -v b="$2" \
+        'BEGIN { e = 0; for (i = 1; i <= length(a); i++) if (substr(a, i, 1) != substr(b, i, 1)) e++; print e }'
+}
+
+# received_bits <record>: the bit_pattern field of a receiver_stride record
+received_bits() {
+    echo "$1" | cut -d, -f12
+}
+
+# Point RESULTS at a scratch file for the summary, removed on exit
+bench_results() {
+    RESULTS=$(mktemp)
+    trap 'rm -f $RESULTS' EXIT
+}
@@ -0,0 +1,27 @@
+# Page cache reset shared by the benchmark and QEMU scripts, source it:
+#   . "$(dirname "$0")/lib_evict.sh"
+# cache_reset evicts only the named files and verifies it; where it cannot,
+# the whole page cache is dropped instead.
+
+CACHE_RESET=${CACHE_RESET:-./cache_reset}
+
+# Reset only the given files, drop_caches if the eviction cannot be verified
+evict() {
+    if ! $CACHE_RESET "$@" > /dev/null; then
+        sync
+        echo 1 | sudo tee /proc/sys/vm/drop_caches > /dev/null
+    fi
+}
+
+# Evict the QEMU VM images under $VM_PATH from the host page cache
+evict_vm_images() {
+    echo -e "\nEvicting the VM images from the host page cache..."
+    # Only the images, drop_caches if cache_reset cannot verify the eviction
+    if sudo $CACHE_RESET $VM_PATH/base.qcow2 $VM_PATH/vmA.qcow2 $VM_PATH/vmB.qcow2 > /dev/null; then
+        echo "========> VM images are now evicted."
+    else
+        sync
+        echo 1 | sudo tee -a /proc/sys/vm/drop_caches
+        echo "========> Entire OS Page Cache is now evicted."
+    fi
+}
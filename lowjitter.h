@@ -0,0 +1,118 @@
+/*
+ * Low-jitter execution (--low-jitter <cpu>[:<rt_prio>] on every tool)
+ *
+ * low_jitter_enter() runs once, after argument parsing and before
+ * timing_init(), and takes the usual sources of timing noise out of the
+ * probe loops:
+ *   - lazy binding: a dynamically linked tool re-executes itself with
+ *     LD_BIND_NOW=1 (what the scripts used to prefix), the -static
+ *     targets of the Makefile need no loader at all,
+ *   - migration: the process is pinned to cpu,
+ *   - preemption: with rt_prio > 0 it runs SCHED_FIFO at that priority
+ *     (needs CAP_SYS_NICE, a warning where the runtime refuses),
+ *   - page faults: LOW_JITTER_STACK of stack (the pg_size and file_pgs
+ *     VLAs) and LOW_JITTER_HEAP of heap are touched, malloc is told to
+ *     keep its heap and not to mmap() large blocks, and everything mapped
+ *     so far, code included, is locked with mlockall(MCL_CURRENT).
+ *
+ * Only current mappings are locked: MCL_FUTURE would populate every file
+ * mapping made later (the touch and mmap probes, cache_residency()), i.e.
+ * read the carrier into the page cache. Threads started afterwards get
+ * unlocked stacks and inherit the single-core mask.
+ */
+
+#ifndef LOWJITTER_H
+#define LOWJITTER_H
+
+#include <sys/auxv.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <malloc.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOW_JITTER_STACK (1U << 20)
+#define LOW_JITTER_HEAP (16U << 20)
+
+struct low_jitter {
+    int cpu;
+    int rt_prio;    // 0: keep the normal scheduling class
+};
+
+// Parse "<cpu>[:<rt_prio>]".
+static int low_jitter_parse(const char *spec, struct low_jitter *lj)
+{
+    char *end;
+
+    lj->cpu = strtol(spec, &end, 10);
+    lj->rt_prio = 0;
+    if (end == spec || lj->cpu < 0 || lj->cpu >= CPU_SETSIZE)
+        goto bad;
+    if (*end == ':') {
+        const char *prio = end + 1;
+        lj->rt_prio = strtol(prio, &end, 10);
+        if (end == prio || lj->rt_prio < sched_get_priority_min(SCHED_FIFO) ||
+            lj->rt_prio > sched_get_priority_max(SCHED_FIFO))
+            goto bad;
+    }
+    if (*end == '\0')
+        return 0;
+bad:
+    fprintf(stderr, "Invalid --low-jitter '%s', expected <cpu>[:<rt_prio 1-99>]\n", spec);
+    return -1;
+}
+
+static __attribute__((noinline)) void low_jitter_touch_stack(void)
+{
+    volatile char stack[LOW_JITTER_STACK];
+
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
+static void low_jitter_enter(const struct low_jitter *lj, char *argv[], bool verbose)
+{
+    cpu_set_t set;
+
+    // No PT_INTERP, no AT_BASE: static binaries have nothing to bind
+    if (getauxval(AT_BASE) != 0 && !getenv("LD_BIND_NOW")) {
+        setenv("LD_BIND_NOW", "1", 1);
+        execv("/proc/self/exe", argv);
+        perror("Warning: cannot re-execute with LD_BIND_NOW");
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(lj->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        fprintf(stderr, "Failed to pin to cpu %d: %s\n", lj->cpu, strerror(errno));
+        exit(errno);
+    }
+    if (lj->rt_prio > 0) {
+        struct sched_param param = { .sched_priority = lj->rt_prio };
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == -1)
+            fprintf(stderr, "Warning: no SCHED_FIFO %d: %s\n", lj->rt_prio, strerror(errno));
+    }
+
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_TRIM_THRESHOLD, -1);
+    char *heap = malloc(LOW_JITTER_HEAP);
+    if (heap) {
+        for (size_t i = 0; i < LOW_JITTER_HEAP; i += 4096)
+            ((volatile char *)heap)[i] = 0;
+        free(heap);
+    }
+    low_jitter_touch_stack();
+    if (mlockall(MCL_CURRENT) == -1)
+        fprintf(stderr, "Warning: mlockall: %s (RLIMIT_MEMLOCK?)\n", strerror(errno));
+
+    if (verbose)
+        fprintf(stderr, "Low jitter: cpu %d, %s, %s binding\n", lj->cpu,
+                sched_getscheduler(0) == SCHED_FIFO ? "SCHED_FIFO" : "normal scheduling",
+                getauxval(AT_BASE) ? "eager" : "static");
+}
+
+#endif
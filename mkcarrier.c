@@ -0,0 +1,237 @@
+/*
+ * Generate random carrier files for the channel, replacing
+ * dd if=/dev/urandom.
+ *
+ * Usage: ./mkcarrier [-v] [-j threads] [-s seed] [-m manifest] <pages> <file> [<file> ...]
+ *   pages: size of every file in pages
+ *   -j: writer threads (default: online CPUs)
+ *   -s: fixed seed, the files are then identical on every host, whatever
+ *       the thread count (default: a random seed)
+ *   -m: write a manifest of the files for sender_stride/receiver_stride -M
+ *       (see carrier.h)
+ *
+ * Every 1 MiB block is filled from its own xoshiro256** stream seeded
+ * with (seed, file, block), so blocks are independent and any thread can
+ * write any block. The files are written back and dropped from the page
+ * cache at the end, leaving every carrier page cold.
+ *
+ * Prints one CSV record per file.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/random.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timing.h"
+#include "cache_reset.h"
+#include "carrier.h"
+
+#define BLOCK_BYTES (1024 * 1024)
+
+struct gen_ctx {
+    int *fds;
+    size_t num_files;
+    size_t file_bytes;
+    size_t blocks_per_file;
+    uint64_t seed;
+    atomic_size_t next_block;   // over all files
+    atomic_bool failed;
+};
+
+static inline uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+// Fill len bytes (a multiple of 8) with xoshiro256** from state s.
+static void fill_block(uint64_t *buf, size_t len, uint64_t s[4])
+{
+    for (size_t i = 0; i < len / sizeof(uint64_t); i++) {
+        buf[i] = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+    }
+}
+
+static void *gen_worker(void *arg)
+{
+    struct gen_ctx *g = arg;
+    uint64_t *buf = aligned_alloc(4096, BLOCK_BYTES);
+    size_t total = g->num_files * g->blocks_per_file;
+
+    if (!buf) {
+        atomic_store(&g->failed, true);
+        return NULL;
+    }
+
+    for (;;) {
+        size_t b = atomic_fetch_add(&g->next_block, 1);
+        if (b >= total || atomic_load(&g->failed))
+            break;
+        size_t file = b / g->blocks_per_file;
+        size_t off = (b % g->blocks_per_file) * (size_t)BLOCK_BYTES;
+        size_t len = g->file_bytes - off < BLOCK_BYTES ? g->file_bytes - off : BLOCK_BYTES;
+
+        uint64_t x = g->seed ^ ((uint64_t)file << 48) ^ (b % g->blocks_per_file);
+        uint64_t s[4] = { splitmix64(&x), splitmix64(&x), splitmix64(&x), splitmix64(&x) };
+        fill_block(buf, BLOCK_BYTES, s);
+
+        if (pwrite(g->fds[file], buf, len, off) != (ssize_t)len) {
+            perror("pwrite");
+            atomic_store(&g->failed, true);
+            break;
+        }
+        // Start writeback early instead of piling up dirty pages
+        sync_file_range(g->fds[file], off, len, SYNC_FILE_RANGE_WRITE);
+    }
+    free(buf);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    bool verbose = false;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = 0;
+    bool fixed_seed = false;
+    const char *manifest = NULL;
+    int arg_idx = 1;
+
+    // Check for -v, -j, -s and -m flags
+    while (arg_idx < argc && argv[arg_idx][0] == '-') {
+        if (strcmp(argv[arg_idx], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg_idx], "-j") == 0 && arg_idx + 1 < argc) {
+            num_threads = strtol(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-s") == 0 && arg_idx + 1 < argc) {
+            seed = strtoull(argv[++arg_idx], NULL, 0);
+            fixed_seed = true;
+        } else if (strcmp(argv[arg_idx], "-m") == 0 && arg_idx + 1 < argc) {
+            manifest = argv[++arg_idx];
+        } else {
+            break;
+        }
+        arg_idx++;
+    }
+
+    if (argc < arg_idx + 2 || num_threads < 1) {
+        fprintf(stderr, "Usage: %s [-v] [-j threads] [-s seed] [-m manifest] <pages> <file> [<file> ...]\n",
+                argv[0]);
+        fprintf(stderr, "  pages: size of every file in pages\n");
+        fprintf(stderr, "  -j: writer threads (default: online CPUs)\n");
+        fprintf(stderr, "  -s: fixed seed for reproducible files (default: random)\n");
+        fprintf(stderr, "  -m: write a carrier manifest for sender_stride/receiver_stride -M\n");
+        exit(EBADF);
+    }
+
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    size_t pages = strtoull(argv[arg_idx], NULL, 10);
+    size_t num_files = argc - arg_idx - 1;
+    char **files = &argv[arg_idx + 1];
+    int fds[num_files];
+    pthread_t threads[num_threads];
+
+    if (pages == 0) {
+        fprintf(stderr, "Error: pages must be positive\n");
+        exit(EINVAL);
+    }
+    if (!fixed_seed && getrandom(&seed, sizeof(seed), 0) != sizeof(seed)) {
+        perror("getrandom");
+        exit(errno);
+    }
+
+    struct gen_ctx g = {
+        .fds = fds,
+        .num_files = num_files,
+        .file_bytes = pages * pg_size,
+        .blocks_per_file = (pages * pg_size + BLOCK_BYTES - 1) / BLOCK_BYTES,
+        .seed = seed,
+    };
+    atomic_init(&g.next_block, 0);
+    atomic_init(&g.failed, false);
+
+    for (size_t i = 0; i < num_files; i++) {
+        fds[i] = open(files[i], O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fds[i] == -1) {
+            fprintf(stderr, "Failed to create file %s: %s\n", files[i], strerror(errno));
+            exit(errno);
+        }
+        posix_fallocate(fds[i], 0, g.file_bytes);
+    }
+
+    if (verbose) {
+        fprintf(stderr, "Generating %zu file(s) of %zu pages, seed 0x%016" PRIx64 ", %ld thread(s)\n",
+                num_files, pages, seed, num_threads);
+        printf("filename,pages,page_size,seed,threads,total_ns,mib_per_s\n");
+    }
+
+    uint64_t begin_ns = timing_monotonic_ns();
+    for (long i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, gen_worker, &g);
+    for (long i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    for (size_t i = 0; i < num_files; i++) {
+        if (fdatasync(fds[i]) == -1) {
+            perror("fdatasync");
+            atomic_store(&g.failed, true);
+        }
+        cache_reset(fds[i], 0, pages, false);
+        close(fds[i]);
+    }
+    uint64_t total_ns = timing_monotonic_ns() - begin_ns;
+
+    if (atomic_load(&g.failed))
+        exit(EIO);
+
+    double mib_per_s = num_files * g.file_bytes / (1024.0 * 1024.0) / (total_ns / 1e9);
+    for (size_t i = 0; i < num_files; i++)
+        printf("%s,%zu,%zu,0x%016" PRIx64 ",%ld,%lu,%.2f\n", files[i], pages, pg_size, seed,
+               num_threads, total_ns, mib_per_s);
+
+    if (manifest) {
+        FILE *f = fopen(manifest, "w");
+        if (!f) {
+            fprintf(stderr, "Failed to write manifest %s: %s\n", manifest, strerror(errno));
+            exit(errno);
+        }
+        fputs(CARRIER_MANIFEST_HEADER, f);
+        // Absolute: relative entries would resolve against the manifest's directory
+        for (size_t i = 0; i < num_files; i++) {
+            char path[PATH_MAX];
+            if (!realpath(files[i], path)) {
+                fprintf(stderr, "Cannot resolve %s: %s\n", files[i], strerror(errno));
+                exit(errno);
+            }
+            fprintf(f, "carrier %s %zu %zu 0x%016" PRIx64 "\n", path, pages, pg_size, seed);
+        }
+        fclose(f);
+    }
+
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Interference monitor
+ *
+ * cycle_jump's detector as a sibling thread: it reads the timing source
+ * (timing.h) in a tight loop on a core of its own and records every gap
+ * longer than the jump threshold, i.e. an interval in which it did not
+ * run (interrupt, preemption, VM exit, SMI), as a [start, end) event in a
+ * lock-free single-producer ring. Afterwards monitor_tainted() tells
+ * whether a probe's timed window overlapped one of them.
+ *
+ * The monitor sees what stops its own core, which is what stops the whole
+ * guest (host preemption, VM exits) plus the local noise of that core, so
+ * a tainted sample is suspect rather than proven late. monitor_start()
+ * takes the core from the caller's affinity mask, so probe threads
+ * created later never share it; it refuses to share the caller's only
+ * core, every probe would overlap the monitor's own descheduling.
+ *
+ * A timed read can only get slower, so a tainted sample that still looks
+ * cached is kept; the tools discard tainted samples from the latency
+ * statistics, label them TRACE_LABEL_TAINTED and turn tainted cold-looking
+ * bits into erasures for the error correcting decoders.
+ */
+
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timing.h"
+
+#define MONITOR_EVENTS 4096     // power of two
+#define MONITOR_DEFAULT_JUMP_NS 2000
+// How long monitor_tainted() waits for the monitor to pass a window
+#define MONITOR_WAIT_NS (10ULL * 1000ULL * 1000ULL)
+
+struct monitor_event {
+    uint64_t start;
+    uint64_t end;
+};
+
+// Span of one probe: timing_start() before it, timing_stop() after it
+struct monitor_window {
+    uint64_t start;
+    uint64_t end;
+};
+
+struct monitor {
+    pthread_t thread;
+    int cpu;
+    uint64_t threshold;             // ticks
+    atomic_bool stop;
+    atomic_uint_fast64_t head;      // events written so far
+    atomic_uint_fast64_t seen;      // last timestamp the monitor read
+    struct monitor_event events[MONITOR_EVENTS];
+};
+
+static void *monitor_main(void *arg)
+{
+    struct monitor *m = arg;
+    uint64_t last = timing_start();
+
+    while (!atomic_load_explicit(&m->stop, memory_order_relaxed)) {
+        uint64_t now = timing_start();
+
+        if (now - last > m->threshold) {
+            uint64_t h = atomic_load_explicit(&m->head, memory_order_relaxed);
+            m->events[h & (MONITOR_EVENTS - 1)] = (struct monitor_event){ last, now };
+            atomic_store_explicit(&m->head, h + 1, memory_order_release);
+        }
+        atomic_store_explicit(&m->seen, now, memory_order_release);
+        last = now;
+    }
+    return NULL;
+}
+
+// Monitor thread on cpu, in the normal scheduling class even under a
+// real-time caller (lowjitter.h): it never sleeps.
+static int monitor_spawn(struct monitor *m, int cpu)
+{
+    struct sched_param param = { .sched_priority = 0 };
+    pthread_attr_t attr;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_attr_init(&attr);
+    pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+    int ret = pthread_create(&m->thread, &attr, monitor_main, m);
+    pthread_attr_destroy(&attr);
+    if (ret == 0)
+        m->cpu = cpu;
+    return ret;
+}
+
+// Start the monitor on the last core the caller may use and take that
+// core out of the caller's mask. A caller pinned to a single core keeps it
+// and the monitor goes to the first online core outside the caller's mask
+// on which the thread can be started.
+// jump_ns 0 selects the default.
+static int monitor_start(struct monitor *m, uint64_t jump_ns)
+{
+    cpu_set_t allowed, mine;
+    int ret = -1;
+
+    memset(m, 0, sizeof(*m));
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("sched_getaffinity");
+        return -1;
+    }
+    m->threshold = timing_from_ns(jump_ns ? jump_ns : MONITOR_DEFAULT_JUMP_NS);
+    atomic_init(&m->stop, false);
+    atomic_init(&m->head, 0);
+    atomic_init(&m->seen, timing_start());
+
+    if (CPU_COUNT(&allowed) > 1) {
+        int cpu = CPU_SETSIZE - 1;
+        while (!CPU_ISSET(cpu, &allowed))
+            cpu--;
+        mine = allowed;
+        CPU_CLR(cpu, &mine);
+        if (sched_setaffinity(0, sizeof(mine), &mine) == -1) {
+            perror("sched_setaffinity");
+            return -1;
+        }
+        ret = monitor_spawn(m, cpu);
+    } else {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int cpu = 0; cpu < online && cpu < CPU_SETSIZE && ret != 0; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed))
+                ret = monitor_spawn(m, cpu);
+        }
+    }
+    if (ret != 0) {
+        fprintf(stderr, "Warning: interference monitor needs a second core, disabled\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void monitor_stop(struct monitor *m)
+{
+    atomic_store(&m->stop, true);
+    pthread_join(m->thread, NULL);
+}
+
+static inline uint64_t monitor_events(struct monitor *m)
+{
+    return atomic_load_explicit(&m->head, memory_order_acquire);
+}
+
+// Whether [start, end] (timing_start()/timing_stop() values) overlapped a
+// jump. Waits until the monitor has run past end; windows older than the
+// ring still holds, or a monitor that does not catch up, count as tainted.
+static bool monitor_tainted(struct monitor *m, uint64_t start, uint64_t end)
+{
+    uint64_t deadline = timing_monotonic_ns() + MONITOR_WAIT_NS;
+
+    while (atomic_load_explicit(&m->seen, memory_order_acquire) < end) {
+        if (timing_monotonic_ns() > deadline)
+            return true;
+        sched_yield();
+    }
+
+    uint64_t head = atomic_load_explicit(&m->head, memory_order_acquire);
+    uint64_t oldest = head > MONITOR_EVENTS ? head - MONITOR_EVENTS : 0;
+    uint64_t lowest = head;
+
+    // Events are in time order and disjoint: stop at the first one that
+    // ended before the window
+    while (lowest > oldest) {
+        struct monitor_event e = m->events[--lowest & (MONITOR_EVENTS - 1)];
+
+        if (e.end < start)
+            break;
+        if (e.start < end)
+            return true;
+    }
+    // Ran off the ring, or a slot read was overwritten meanwhile
+    if (lowest == oldest && oldest > 0)
+        return true;
+    return monitor_events(m) > lowest + MONITOR_EVENTS;
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Paired-page layout of the differential channel
+ *
+ * Every bit is a pair of pages in one carrier: the first page cached means
+ * 0, the second one 1. The receiver times both and takes the faster as the
+ * cached one, so the decision needs no threshold, only the two reads to
+ * differ. Bit i lives in carrier i % num_files as pair j = i / num_files of
+ * that file, on pages 2j * stride and (2j + 1) * stride; stride 1 is the
+ * original pages 0 and 1.
+ *
+ * read_page -D primes one page of every pair and evicts its partner, so a
+ * message needs no cache reset before it where that eviction works (not
+ * under runsc, -D fails there); spy_on_diff -n reads the pairs in random
+ * order. Both turn readahead off on their descriptors
+ * (POSIX_FADV_RANDOM): a read must not warm the other page of its pair.
+ */
+
+#ifndef PAIRS_H
+#define PAIRS_H
+
+#include <stddef.h>
+
+#define PAIRS_MAX_FILES 16
+#define PAIRS_DEFAULT_STRIDE 1
+
+static inline size_t pair_file(size_t bit, size_t num_files)
+{
+    return bit % num_files;
+}
+
+// side 0 is the page cached for a 0 bit, side 1 the one for a 1 bit
+static inline size_t pair_page(size_t bit, size_t num_files, size_t stride, int side)
+{
+    return (2 * (bit / num_files) + side) * stride;
+}
+
+// Bits the carriers hold, the smallest one limiting every file's share
+static size_t pairs_capacity(const size_t *file_pgs, size_t num_files, size_t stride)
+{
+    size_t per_file = (size_t)-1;
+
+    for (size_t f = 0; f < num_files; f++) {
+        size_t pairs = file_pgs[f] > stride ? (file_pgs[f] - 1 - stride) / (2 * stride) + 1 : 0;
+        if (pairs < per_file)
+            per_file = pairs;
+    }
+    return num_files ? per_file * num_files : 0;
+}
+
+#endif
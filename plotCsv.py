@@ -2,6 +2,7 @@
 import argparse
 import numpy as np
 import matplotlib.pyplot as plt
+import trace_reader
 
 def load_two_column_file(path):
     # First line is header: "Page 1, Page 0"
@@ -73,14 +74,20 @@ def plot_bars(stats0, stats1, statsd, extents, title, out):
 
 def parse_args():
     p = argparse.ArgumentParser()
-    p.add_argument("csv", help="CSV/text file like qemu_p*_50_results.txt")
+    p.add_argument("csv", help="CSV/text file like qemu_p*_50_results.txt, or a binary trace with --trace")
+    p.add_argument("--trace", action="store_true", help="Input is a binary sample trace (see trace.h)")
+    p.add_argument("--page0", default="rand0.bin", help="Trace samples of page 0: <file>[:<page>]")
+    p.add_argument("--page1", default="rand1.bin", help="Trace samples of page 1: <file>[:<page>]")
     p.add_argument("--title", default="Cycles", help="Plot title")
     p.add_argument("--out", default="plot.png", help="Output filename")
     return p.parse_args()
 
 def main():
     args = parse_args()
-    page0, page1 = load_two_column_file(args.csv)
+    if args.trace:
+        page0, page1 = trace_reader.load_pair(args.csv, args.page0, args.page1)
+    else:
+        page0, page1 = load_two_column_file(args.csv)
     stats0, stats1, statsd = compute_stats(page0, page1)
     extents = compute_extents(page0, page1)
 
@@ -2,6 +2,7 @@
 import argparse
 import numpy as np
 import matplotlib.pyplot as plt
+import trace_reader
 
 def load_two_column_file(path):
     # Skip the first line (header like "Page 1, Page 0")
@@ -13,6 +14,46 @@ def load_two_column_file(path):
     col1 = data[:, 1]
     return col0, col1
 
+def load_hist_file(path):
+    # Statistics file of spy_on/receiver_stride -H (see hist.h)
+    stats = {}
+    buckets = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0].startswith("#"):
+                continue
+            if fields[0] == "stats":
+                stats[fields[1]] = [float(v) for v in fields[2:]]
+            elif fields[0] == "bucket":
+                buckets.setdefault(fields[1], []).append([int(v) for v in fields[2:]])
+    return stats, {name: np.array(b) for name, b in buckets.items()}
+
+def plot_hist_file(path):
+    # Render the precomputed histograms, nothing is re-derived from samples
+    stats, buckets = load_hist_file(path)
+
+    print("class,samples,mean,stddev,min,p50,p90,p99,p99.9,max")
+    for name, values in stats.items():
+        print(name + "," + ",".join(f"{v:.0f}" if i != 2 else f"{v:.1f}" for i, v in enumerate(values)))
+
+    plt.figure(figsize=(8, 5))
+    for name in ("hot", "cold"):
+        if name not in buckets:
+            continue
+        lower, upper, count = buckets[name].T
+        plt.bar(lower, count, width=upper - lower + 1, align="edge", alpha=0.5,
+                label=f"{name} (p50 {stats[name][4]:.0f}, p99 {stats[name][6]:.0f})")
+
+    plt.xscale("log")
+    plt.xlabel("Cycles")
+    plt.ylabel("Count")
+    plt.title("Latency histogram by class")
+    plt.legend()
+    plt.grid(True, alpha=0.3)
+    plt.tight_layout()
+    plt.savefig("plot.png")
+
 def main():
     parser = argparse.ArgumentParser(
         description="Plot two-column results and their difference."
@@ -21,9 +62,25 @@ def main():
         "file",
         help="Path to CSV/text file with two numeric columns (comma-separated).",
     )
+    parser.add_argument("--trace", action="store_true",
+                        help="Input is a binary sample trace (see trace.h)")
+    parser.add_argument("--page1", default="rand1.bin",
+                        help="Trace samples of the first column: <file>[:<page>]")
+    parser.add_argument("--page0", default="rand0.bin",
+                        help="Trace samples of the second column: <file>[:<page>]")
+    parser.add_argument("--hist", action="store_true",
+                        help="Input is a statistics file of spy_on/receiver_stride -H")
     args = parser.parse_args()
 
-    col0, col1 = load_two_column_file(args.file)
+    if args.hist:
+        plot_hist_file(args.file)
+        return
+
+    if args.trace:
+        # Same column order as the text files: page 1 first
+        col1, col0 = trace_reader.load_pair(args.file, args.page0, args.page1)
+    else:
+        col0, col1 = load_two_column_file(args.file)
     diff = col0 - col1
 
     # Compute statistics
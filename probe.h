@@ -0,0 +1,339 @@
+/*
+ * Page probe strategies
+ *
+ * One timed access to one page of a file, with the access method chosen at
+ * runtime instead of at build time:
+ *   read   lseek() + read() on the descriptor kept open
+ *   pread  pread() on the descriptor kept open
+ *   open   open() + pread() + close() per page, the open() timed apart
+ *   mmap   mmap() of the page, touch of a random word, munmap(); the mmap()
+ *          (and madvise()) timed apart
+ *   touch  the file is mapped once and a random word of the page touched,
+ *          a cold page costs a major fault
+ *   nowait ask the kernel instead of reading: residency comes back in the
+ *          sample, the timing of the query is kept as a second signal
+ * The cycles of a sample are always those of the access itself, ns the
+ * wall time of the whole probe including setup, i.e. the probe cost.
+ *
+ * Every timed read faults a cold page in, so it can be seen cold once per
+ * eviction. nowait does not, given a kernel that answers without reading;
+ * probe_open() picks the best one the file allows (enum probe_via):
+ *   cachestat()            Linux 6.5+, for files we own or may write; no
+ *                          side effect at all
+ *   preadv2(RWF_NOWAIT)    EAGAIN instead of blocking on a cold page. Since
+ *                          Linux 5.9 the miss still starts reading that
+ *                          one page (not its neighbours), so it is cold to
+ *                          the first query only
+ *   timing                 plain pread(), for runtimes that reject both
+ *                          (gVisor, old kernels)
+ *
+ * Pages touched through the shared mapping stay mapped, so a page cache
+ * eviction cannot drop them; probe_release() unmaps one again.
+ */
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timing.h"
+
+enum probe_strategy {
+    PROBE_READ,
+    PROBE_PREAD,
+    PROBE_OPEN,
+    PROBE_MMAP,
+    PROBE_TOUCH,
+    PROBE_NOWAIT,
+    PROBE_STRATEGIES,
+};
+
+static const char *const probe_names[PROBE_STRATEGIES] = {
+    "read", "pread", "open", "mmap", "touch", "nowait",
+};
+
+// How PROBE_NOWAIT learns residency, best first
+enum probe_via {
+    PROBE_VIA_CACHESTAT,
+    PROBE_VIA_RWF_NOWAIT,
+    PROBE_VIA_TIMING,
+};
+
+static const char *const probe_via_names[] = { "cachestat", "rwf_nowait", "timing" };
+
+#ifndef __NR_cachestat
+#define __NR_cachestat 451
+#endif
+
+// uapi struct cachestat_range / struct cachestat, not in older headers
+struct probe_cachestat_range {
+    uint64_t off;
+    uint64_t len;
+};
+
+struct probe_cachestat {
+    uint64_t nr_cache;
+    uint64_t nr_dirty;
+    uint64_t nr_writeback;
+    uint64_t nr_evicted;
+    uint64_t nr_recently_evicted;
+};
+
+struct probe {
+    enum probe_strategy strategy;
+    const char *path;
+    int fd;
+    size_t pg_size;
+    size_t file_size;
+    char *buff;
+    char *map;          // whole file, touch only
+    enum probe_via via; // nowait only
+};
+
+struct probe_sample {
+    uint64_t cycles;        // the access
+    uint64_t setup_cycles;  // open() for open, mmap() for mmap, else 0
+    uint64_t ns;            // whole probe
+    int resident;           // the kernel's answer (nowait), -1: go by cycles
+};
+
+static int probe_parse(const char *name, enum probe_strategy *strategy)
+{
+    for (int i = 0; i < PROBE_STRATEGIES; i++) {
+        if (strcmp(name, probe_names[i]) == 0) {
+            *strategy = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static inline long probe_cachestat(int fd, off_t off, size_t len, struct probe_cachestat *cs)
+{
+    struct probe_cachestat_range range = { (uint64_t)off, len };
+
+    return syscall(__NR_cachestat, fd, &range, cs, 0);
+}
+
+// Best residency query fd allows, see enum probe_via.
+static enum probe_via probe_nowait_via(int fd, size_t file_size, size_t pg_size)
+{
+    struct probe_cachestat cs;
+    char byte;
+    struct iovec iov = { &byte, 1 };
+
+    if (probe_cachestat(fd, 0, pg_size, &cs) == 0)
+        return PROBE_VIA_CACHESTAT;
+    // At the end of the file: the flag is checked, nothing is read
+    if (preadv2(fd, &iov, 1, (off_t)file_size, RWF_NOWAIT) >= 0)
+        return PROBE_VIA_RWF_NOWAIT;
+    return PROBE_VIA_TIMING;
+}
+
+// Residency of page through via: 1 cached, 0 not, -1 failed (or via timing,
+// where the caller goes by the latency). *cycles gets the query's latency.
+static int probe_residency(int fd, enum probe_via via, size_t page, size_t pg_size, char *buff,
+                           uint64_t *cycles)
+{
+    off_t off = (off_t)(page * pg_size);
+    struct probe_cachestat cs;
+    struct iovec iov = { buff, pg_size };
+    uint64_t start, end;
+    long ret;
+    int resident = -1;
+
+    switch (via) {
+    case PROBE_VIA_CACHESTAT:
+        start = timing_start();
+        ret = probe_cachestat(fd, off, pg_size, &cs);
+        end = timing_stop();
+        if (ret == 0)
+            resident = cs.nr_cache > 0;
+        break;
+    case PROBE_VIA_RWF_NOWAIT:
+        start = timing_start();
+        ret = preadv2(fd, &iov, 1, off, RWF_NOWAIT);
+        end = timing_stop();
+        if (ret > 0)
+            resident = 1;
+        else if (ret == -1 && errno == EAGAIN)
+            resident = 0;
+        break;
+    default:
+        start = timing_start();
+        ret = pread(fd, buff, pg_size, off);
+        end = timing_stop();
+        if (ret < 0) {
+            *cycles = UINT64_MAX;
+            return -1;
+        }
+        break;
+    }
+    *cycles = resident == -1 && via != PROBE_VIA_TIMING ? UINT64_MAX : timing_elapsed(start, end);
+    return resident;
+}
+
+static void probe_close(struct probe *p)
+{
+    if (p->map)
+        munmap(p->map, p->file_size);
+    if (p->fd != -1)
+        close(p->fd);
+    free(p->buff);
+    p->map = NULL;
+    p->buff = NULL;
+    p->fd = -1;
+}
+
+// Returns -1 with nothing left open on failure
+static int probe_open(struct probe *p, const char *path, enum probe_strategy strategy)
+{
+    struct stat st;
+
+    memset(p, 0, sizeof(*p));
+    p->strategy = strategy;
+    p->path = path;
+    p->pg_size = sysconf(_SC_PAGESIZE);
+    p->fd = open(path, O_RDONLY);
+    if (p->fd == -1 || fstat(p->fd, &st) == -1) {
+        fprintf(stderr, "Failed to open file %s: %s\n", path, strerror(errno));
+        probe_close(p);
+        return -1;
+    }
+    p->file_size = st.st_size;
+    p->buff = malloc(p->pg_size);
+    if (!p->buff) {
+        perror("malloc");
+        probe_close(p);
+        return -1;
+    }
+
+    if (strategy == PROBE_TOUCH && p->file_size > 0) {
+        p->map = mmap(NULL, p->file_size, PROT_READ, MAP_SHARED, p->fd, 0);
+        if (p->map == MAP_FAILED) {
+            perror("mmap");
+            p->map = NULL;
+            probe_close(p);
+            return -1;
+        }
+        // Every fault should bring in exactly the probed page
+        madvise(p->map, p->file_size, MADV_RANDOM);
+    }
+    if (strategy == PROBE_NOWAIT) {
+        p->via = probe_nowait_via(p->fd, p->file_size, p->pg_size);
+        if (p->via == PROBE_VIA_TIMING)
+            fprintf(stderr, "Warning: %s: no cachestat() or RWF_NOWAIT, nowait probes read\n",
+                    path);
+    }
+    return 0;
+}
+
+static inline uint64_t probe_touch(const char *page_addr)
+{
+    uint64_t start = timing_start();
+    volatile int tmp = *(const int *)page_addr;
+    (void)tmp; // Prevent optimization
+    uint64_t end = timing_stop();
+
+    return timing_elapsed(start, end);
+}
+
+// Time one access to page; UINT64_MAX if it fails.
+static uint64_t probe_page(struct probe *p, size_t page, struct probe_sample *sample)
+{
+    off_t off = (off_t)(page * p->pg_size);
+    size_t word = (size_t)rand() % (p->pg_size / sizeof(int)) * sizeof(int);
+    uint64_t start, end, setup = 0, cycles = UINT64_MAX;
+    uint64_t begin_ns = timing_monotonic_ns();
+    int resident = -1;
+    ssize_t ret;
+
+    if ((size_t)off >= p->file_size)
+        return UINT64_MAX;
+    // Stay inside the last, partial page
+    if (off + word + sizeof(int) > p->file_size)
+        word = 0;
+
+    switch (p->strategy) {
+    case PROBE_READ:
+        if (lseek(p->fd, off, SEEK_SET) == -1)
+            return UINT64_MAX;
+        start = timing_start();
+        ret = read(p->fd, p->buff, p->pg_size);
+        end = timing_stop();
+        if (ret >= 0)
+            cycles = timing_elapsed(start, end);
+        break;
+    case PROBE_PREAD:
+        start = timing_start();
+        ret = pread(p->fd, p->buff, p->pg_size, off);
+        end = timing_stop();
+        if (ret >= 0)
+            cycles = timing_elapsed(start, end);
+        break;
+    case PROBE_OPEN: {
+        start = timing_start();
+        int fd = open(p->path, O_RDONLY);
+        end = timing_stop();
+        if (fd == -1)
+            return UINT64_MAX;
+        setup = timing_elapsed(start, end);
+        start = timing_start();
+        ret = pread(fd, p->buff, p->pg_size, off);
+        end = timing_stop();
+        close(fd);
+        if (ret >= 0)
+            cycles = timing_elapsed(start, end);
+        break;
+    }
+    case PROBE_MMAP: {
+        start = timing_start();
+        char *map = mmap(NULL, p->pg_size, PROT_READ, MAP_SHARED, p->fd, off);
+        // Else the fault reads around the page, up to read_ahead_kb
+        if (map != MAP_FAILED)
+            madvise(map, p->pg_size, MADV_RANDOM);
+        end = timing_stop();
+        if (map == MAP_FAILED)
+            return UINT64_MAX;
+        setup = timing_elapsed(start, end);
+        cycles = probe_touch(map + word);
+        munmap(map, p->pg_size);
+        break;
+    }
+    case PROBE_TOUCH:
+        cycles = probe_touch(p->map + off + word);
+        break;
+    case PROBE_NOWAIT:
+        resident = probe_residency(p->fd, p->via, page, p->pg_size, p->buff, &cycles);
+        break;
+    default:
+        break;
+    }
+
+    if (sample) {
+        sample->cycles = cycles;
+        sample->setup_cycles = setup;
+        sample->ns = timing_monotonic_ns() - begin_ns;
+        sample->resident = resident;
+    }
+    return cycles;
+}
+
+// Drop our own mapping of page so the page cache may evict it.
+static inline void probe_release(struct probe *p, size_t page)
+{
+    if (p->map && page * p->pg_size < p->file_size)
+        madvise(p->map + page * p->pg_size, p->pg_size, MADV_DONTNEED);
+}
+
+#endif
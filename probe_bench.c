@@ -0,0 +1,464 @@
+/*
+ * Microbenchmark of the primitives the probe tools are built from, so the
+ * per-syscall cost can be compared across runtimes (runc, runsc-kvm,
+ * runsc-systrap, QEMU) and across hosts and kernels.
+ *
+ * Usage: ./probe_bench [-v] [-n iterations] [-w warmup] [-s size_mib] [-f file] [-l label]
+ *                      [--low-jitter cpu[:rt_prio]]
+ *   -n: timed iterations per primitive and state (default: 1000)
+ *   -w: untimed iterations before them (default: 100)
+ *   -s: size of the scratch file in MiB (default: 64)
+ *   -f: file to probe (default: ./probe_bench.dat, created with random
+ *       content if missing or smaller than -s)
+ *   -l: label stored in the output, e.g. the runtime (default: hostname)
+ *   -v: progress on stderr
+ *   --low-jitter: pin, optionally SCHED_FIFO, lock memory (see lowjitter.h);
+ *       the "low_jitter" field records it
+ *
+ * Every primitive runs hot and cold:
+ *   open            open() + close() of the file
+ *   fstat           fstat() of a freshly opened descriptor
+ *   pread           pread() of one page
+ *   mmap_fault      first touch of one page mapped with MADV_RANDOM, the
+ *                   mmap()/munmap() around it untimed
+ *   fadvise         POSIX_FADV_DONTNEED of one page
+ *   uring_submit    io_uring_enter() submitting an IORING_OP_READ of one page
+ *   uring_complete  from that submission until its completion is seen
+ * For the page primitives hot and cold is the state of a random page of
+ * the file, primed with a read or evicted with cache_reset() before every
+ * iteration. For open and fstat it is the dentry and inode caches, cold
+ * drops them with drop_caches (needs root, not possible in most
+ * containers) and runs a tenth of the iterations.
+ *
+ * Writes one JSON document to stdout; `make bench` stores it as
+ * bench-<label>.json and bench_compare.py diffs two of them.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timing.h"
+#include "cache_reset.h"
+#include "hist.h"
+#include "lowjitter.h"
+#include "uring.h"
+
+#define DEFAULT_ITERATIONS 1000
+#define DEFAULT_WARMUP 100
+#define DEFAULT_SIZE_MIB 64
+#define DEFAULT_FILE "probe_bench.dat"
+// Dropping the dentry cache is slow, cold open/fstat run a fraction
+#define METADATA_COLD_DIVISOR 10
+
+enum bench_state { HOT, COLD };
+
+static const char *const state_names[] = { "hot", "cold" };
+
+struct bench {
+    const char *path;
+    int fd;
+    size_t pg_size;
+    size_t file_pgs;
+    char *buff;
+    struct uring ring;
+    bool have_uring;
+};
+
+// Times one primitive on page; UINT64_MAX if it failed.
+typedef uint64_t (*bench_fn)(struct bench *b, size_t page);
+
+struct primitive {
+    const char *name;
+    bench_fn fn;
+    bool metadata;  // hot/cold is the dentry cache, not the page
+    bool uring;
+};
+
+static uint64_t bench_open(struct bench *b, size_t page)
+{
+    (void)page;
+    uint64_t start = timing_start();
+    int fd = open(b->path, O_RDONLY);
+    if (fd != -1)
+        close(fd);
+    uint64_t end = timing_stop();
+
+    return fd == -1 ? UINT64_MAX : timing_elapsed(start, end);
+}
+
+static uint64_t bench_fstat(struct bench *b, size_t page)
+{
+    struct stat st;
+    (void)page;
+    int fd = open(b->path, O_RDONLY);
+
+    if (fd == -1)
+        return UINT64_MAX;
+    uint64_t start = timing_start();
+    int ret = fstat(fd, &st);
+    uint64_t end = timing_stop();
+    close(fd);
+    return ret == -1 ? UINT64_MAX : timing_elapsed(start, end);
+}
+
+static uint64_t bench_pread(struct bench *b, size_t page)
+{
+    uint64_t start = timing_start();
+    ssize_t ret = pread(b->fd, b->buff, b->pg_size, (off_t)(page * b->pg_size));
+    uint64_t end = timing_stop();
+
+    return ret < 0 ? UINT64_MAX : timing_elapsed(start, end);
+}
+
+static uint64_t bench_mmap_fault(struct bench *b, size_t page)
+{
+    char *map = mmap(NULL, b->pg_size, PROT_READ, MAP_SHARED, b->fd, (off_t)(page * b->pg_size));
+
+    if (map == MAP_FAILED)
+        return UINT64_MAX;
+    // Else the fault reads around the page, up to read_ahead_kb
+    madvise(map, b->pg_size, MADV_RANDOM);
+    uint64_t start = timing_start();
+    volatile int tmp = *(const int *)map;
+    (void)tmp; // Prevent optimization
+    uint64_t end = timing_stop();
+    munmap(map, b->pg_size);
+    return timing_elapsed(start, end);
+}
+
+static uint64_t bench_fadvise(struct bench *b, size_t page)
+{
+    uint64_t start = timing_start();
+    int ret = posix_fadvise(b->fd, (off_t)(page * b->pg_size), b->pg_size, POSIX_FADV_DONTNEED);
+    uint64_t end = timing_stop();
+
+    return ret != 0 ? UINT64_MAX : timing_elapsed(start, end);
+}
+
+// One read of page through the ring: *submit gets the io_uring_enter()
+// that submits it, *complete the time from before it until the CQE.
+static int bench_uring(struct bench *b, size_t page, uint64_t *submit, uint64_t *complete)
+{
+    struct uring *r = &b->ring;
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = b->fd;
+    sqe->addr = (uint64_t)(uintptr_t)b->buff;
+    sqe->len = b->pg_size;
+    sqe->off = (uint64_t)page * b->pg_size;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    uint64_t start = timing_start();
+    int ret = uring_enter(r, 1, 0);
+    uint64_t entered = timing_stop();
+    if (ret < 0)
+        return -1;
+
+    unsigned head = *r->cq_head;
+    while (__atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) == head)
+        uring_enter(r, 0, 1);
+    uint64_t end = timing_stop();
+    int res = r->cqes[head & *r->cq_mask].res;
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    *submit = timing_elapsed(start, entered);
+    *complete = timing_elapsed(start, end);
+    return res < 0 ? -1 : 0;
+}
+
+static uint64_t bench_uring_submit(struct bench *b, size_t page)
+{
+    uint64_t submit, complete;
+
+    return bench_uring(b, page, &submit, &complete) == -1 ? UINT64_MAX : submit;
+}
+
+static uint64_t bench_uring_complete(struct bench *b, size_t page)
+{
+    uint64_t submit, complete;
+
+    return bench_uring(b, page, &submit, &complete) == -1 ? UINT64_MAX : complete;
+}
+
+static const struct primitive primitives[] = {
+    { "open", bench_open, true, false },
+    { "fstat", bench_fstat, true, false },
+    { "pread", bench_pread, false, false },
+    { "mmap_fault", bench_mmap_fault, false, false },
+    { "fadvise", bench_fadvise, false, false },
+    { "uring_submit", bench_uring_submit, false, true },
+    { "uring_complete", bench_uring_complete, false, true },
+};
+
+static int drop_metadata_caches(void)
+{
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+
+    if (fd == -1)
+        return -1;
+    ssize_t ret = write(fd, "2\n", 2);
+    close(fd);
+    return ret == 2 ? 0 : -1;
+}
+
+// Bring page into the state the next timed iteration expects.
+static int prepare(struct bench *b, const struct primitive *prim, enum bench_state state,
+                   size_t page)
+{
+    if (prim->metadata)
+        return state == COLD ? drop_metadata_caches() : 0;
+    if (state == HOT)
+        return pread(b->fd, b->buff, b->pg_size, (off_t)(page * b->pg_size)) < 0 ? -1 : 0;
+    // Verified: a single unchecked DONTNEED often leaves the page behind
+    return cache_reset(b->fd, page, 1, true) != 0 ? -1 : 0;
+}
+
+static void json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+static void json_stats(const char *name, const struct hist *h, bool ns)
+{
+    static const double quantiles[] = { 0.5, 0.9, 0.99 };
+    static const char *const quantile_names[] = { "p50", "p90", "p99" };
+    double scale = ns ? timing.ns_per_tick : 1.0;
+
+    printf("\"%s\": {\"mean\": %.1f, \"stddev\": %.1f, \"min\": %.1f", name, h->mean * scale,
+           hist_stddev(h) * scale, (h->count ? h->min : 0) * scale);
+    for (int i = 0; i < 3; i++)
+        printf(", \"%s\": %.1f", quantile_names[i], hist_quantile(h, quantiles[i]) * scale);
+    printf(", \"max\": %.1f}", h->max * scale);
+}
+
+// Run one primitive in one state and print its JSON result object.
+static void run(struct bench *b, const struct primitive *prim, enum bench_state state,
+                unsigned iterations, unsigned warmup, bool verbose)
+{
+    const char *error = NULL;
+    struct hist h;
+    unsigned failures = 0;
+
+    hist_init(&h);
+    if (prim->metadata && state == COLD) {
+        iterations = (iterations + METADATA_COLD_DIVISOR - 1) / METADATA_COLD_DIVISOR;
+        warmup = 0;
+        if (drop_metadata_caches() == -1)
+            error = "cannot write /proc/sys/vm/drop_caches";
+    }
+    if (prim->uring && !b->have_uring)
+        error = "io_uring unavailable";
+
+    for (unsigned i = 0; !error && i < warmup + iterations; i++) {
+        size_t page = (size_t)rand() % b->file_pgs;
+
+        if (prepare(b, prim, state, page) == -1) {
+            failures++;
+            continue;
+        }
+        uint64_t cycles = prim->fn(b, page);
+        if (i < warmup)
+            continue;
+        if (cycles == UINT64_MAX)
+            failures++;
+        else
+            hist_add(&h, cycles);
+    }
+
+    if (verbose) {
+        char name[64];
+        snprintf(name, sizeof(name), "%s %s", prim->name, state_names[state]);
+        if (error)
+            fprintf(stderr, "%s: %s\n", name, error);
+        else
+            hist_print(stderr, name, &h);
+    }
+
+    printf("    {\"primitive\": \"%s\", \"state\": \"%s\", ", prim->name, state_names[state]);
+    if (error) {
+        printf("\"error\": ");
+        json_string(error);
+        printf("}");
+        return;
+    }
+    printf("\"samples\": %lu, \"failures\": %u,\n      ", h.count, failures);
+    json_stats("cycles", &h, false);
+    printf(",\n      ");
+    json_stats("ns", &h, true);
+    printf("}");
+}
+
+// Fill path with size bytes of random data unless it is already that big.
+static int make_scratch(const char *path, size_t size)
+{
+    struct stat st;
+    char block[1 << 16];
+
+    if (stat(path, &st) == 0 && (size_t)st.st_size >= size)
+        return 0;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to create file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    // Real data: reads of a sparse or unwritten range never go to the disk
+    for (size_t off = 0; off < size; off += sizeof(block)) {
+        size_t n = size - off < sizeof(block) ? size - off : sizeof(block);
+        if (getrandom(block, n, 0) != (ssize_t)n || write(fd, block, n) != (ssize_t)n) {
+            perror("write");
+            close(fd);
+            return -1;
+        }
+    }
+    if (fdatasync(fd) == -1)
+        perror("fdatasync");
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = DEFAULT_ITERATIONS;
+    unsigned warmup = DEFAULT_WARMUP;
+    size_t size_mib = DEFAULT_SIZE_MIB;
+    const char *path = NULL;
+    char label[256] = "";
+    bool verbose = false;
+    int arg_idx = 1;
+    struct bench b = { .fd = -1 };
+    struct utsname uts;
+    struct stat st;
+    struct low_jitter low_jitter = { .cpu = -1 };
+
+    while (arg_idx < argc && argv[arg_idx][0] == '-') {
+        if (strcmp(argv[arg_idx], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg_idx], "-n") == 0 && arg_idx + 1 < argc) {
+            iterations = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-w") == 0 && arg_idx + 1 < argc) {
+            warmup = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-s") == 0 && arg_idx + 1 < argc) {
+            size_mib = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-f") == 0 && arg_idx + 1 < argc) {
+            path = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-l") == 0 && arg_idx + 1 < argc) {
+            snprintf(label, sizeof(label), "%s", argv[++arg_idx]);
+        } else if (strcmp(argv[arg_idx], "--low-jitter") == 0 && arg_idx + 1 < argc) {
+            if (low_jitter_parse(argv[++arg_idx], &low_jitter) == -1)
+                exit(EINVAL);
+        } else {
+            fprintf(stderr, "Usage: %s [-v] [-n iterations] [-w warmup] [-s size_mib] "
+                            "[-f file] [-l label] [--low-jitter cpu[:rt_prio]]\n", argv[0]);
+            fprintf(stderr, "  -n: timed iterations per primitive and state (default: %d)\n",
+                    DEFAULT_ITERATIONS);
+            fprintf(stderr, "  -w: untimed warmup iterations (default: %d)\n", DEFAULT_WARMUP);
+            fprintf(stderr, "  -s: scratch file size in MiB (default: %d)\n", DEFAULT_SIZE_MIB);
+            fprintf(stderr, "  -f: file to probe (default: ./%s)\n", DEFAULT_FILE);
+            fprintf(stderr, "  -l: label for the results (default: hostname)\n");
+            fprintf(stderr, "  --low-jitter: pin to cpu, SCHED_FIFO at rt_prio, lock and prefault memory\n");
+            exit(EINVAL);
+        }
+        arg_idx++;
+    }
+    if (iterations == 0 || size_mib == 0) {
+        fprintf(stderr, "Error: iterations and size must be positive\n");
+        exit(EINVAL);
+    }
+
+    if (!path) {
+        path = DEFAULT_FILE;
+        if (make_scratch(path, size_mib << 20) == -1)
+            exit(errno ? errno : 1);
+    }
+    if (uname(&uts) == -1)
+        memset(&uts, 0, sizeof(uts));
+    if (!label[0])
+        snprintf(label, sizeof(label), "%s", uts.nodename);
+
+    if (low_jitter.cpu >= 0)
+        low_jitter_enter(&low_jitter, argv, verbose);
+    timing_init();
+    srand(timing_monotonic_ns());
+
+    b.path = path;
+    b.pg_size = sysconf(_SC_PAGESIZE);
+    b.fd = open(path, O_RDONLY);
+    if (b.fd == -1 || fstat(b.fd, &st) == -1) {
+        fprintf(stderr, "Failed to open file %s: %s\n", path, strerror(errno));
+        exit(errno);
+    }
+    // Only the last, possibly partial page is left out
+    b.file_pgs = st.st_size / b.pg_size;
+    if (b.file_pgs == 0) {
+        fprintf(stderr, "Error: %s is smaller than a page\n", path);
+        exit(EINVAL);
+    }
+    // No readahead: priming or probing one page leaves its neighbours alone
+    posix_fadvise(b.fd, 0, 0, POSIX_FADV_RANDOM);
+    b.buff = malloc(b.pg_size);
+    if (!b.buff) {
+        perror("malloc");
+        exit(1);
+    }
+    b.have_uring = uring_setup(&b.ring, 1) == 0;
+
+    printf("{\n  \"tool\": \"probe_bench\",\n  \"label\": ");
+    json_string(label);
+    printf(",\n  \"kernel\": ");
+    json_string(uts.release);
+    printf(",\n  \"host\": ");
+    json_string(uts.nodename);
+    printf(",\n  \"machine\": ");
+    json_string(uts.machine);
+    printf(",\n  \"timing\": {\"source\": \"%s\", \"ns_per_tick\": %.6f, \"overhead\": %lu},\n",
+           timing.source, timing.ns_per_tick, timing.overhead);
+    if (low_jitter.cpu >= 0)
+        printf("  \"low_jitter\": {\"cpu\": %d, \"fifo\": %s},\n", low_jitter.cpu,
+               sched_getscheduler(0) == SCHED_FIFO ? "true" : "false");
+    printf("  \"page_size\": %zu,\n  \"iterations\": %u,\n  \"warmup\": %u,\n  \"file\": ",
+           b.pg_size, iterations, warmup);
+    json_string(path);
+    printf(",\n  \"file_pages\": %zu,\n  \"results\": [\n", b.file_pgs);
+
+    size_t num_primitives = sizeof(primitives) / sizeof(primitives[0]);
+    for (size_t i = 0; i < num_primitives; i++) {
+        for (int state = HOT; state <= COLD; state++) {
+            run(&b, &primitives[i], state, iterations, warmup, verbose);
+            printf(i + 1 < num_primitives || state != COLD ? ",\n" : "\n");
+            fflush(stdout);
+        }
+    }
+    printf("  ]\n}\n");
+
+    if (b.have_uring)
+        uring_teardown(&b.ring);
+    free(b.buff);
+    close(b.fd);
+    return 0;
+}
@@ -14,43 +14,180 @@
 
 #include <sys/types.h>
 
-#define USE_RDTSC
-
-
-static int PAGE_SIZE;
-
+#include "timing.h"
+#include "cache_reset.h"
+#include "carrier.h"
+#include "codebook.h"
+#include "pairs.h"
+#include "trace.h"
+#include "lowjitter.h"
+
+// Every priming read goes here with -T
+static struct trace trace_state;
+static struct trace *trace = NULL;
+
+// Prime the (file, page) slots of one symbol of the codebook (see codebook.h).
+static int send_symbol(const char *codebook_path, const char *symbol_arg, bool verbose)
+{
+    struct codebook cb;
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    char buff[pg_size];
+    uint64_t symbol = strtoull(symbol_arg, NULL, 10);
+    uint64_t mask;
+    size_t slots_primed = 0;
+    uint64_t total_read_cycles = 0;
+
+    timing_init();
+    if (codebook_load(&cb, codebook_path) == -1 || codebook_open(&cb) == -1)
+        exit(1);
+    if (codebook_encode(&cb, symbol, &mask) == -1) {
+        fprintf(stderr, "Error: symbol %lu out of range (%u bits)\n", symbol, cb.symbol_bits);
+        exit(1);
+    }
 
-static inline uint64_t rdtsc(void) {
-    unsigned hi, lo;
-    // serialize before reading tsc
-    asm volatile("lfence" ::: "memory");
-    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
-    return ((uint64_t)hi << 32) | lo;
-}
+    uint16_t file_ids[CODEBOOK_MAX_FILES];
+    for (size_t f = 0; f < cb.num_files; f++)
+        file_ids[f] = trace ? trace_file_id(trace, cb.files[f].path) : 0;
+
+    uint64_t total_begin_ns = timing_monotonic_ns();
+    for (size_t i = 0; i < cb.num_slots; i++) {
+        if (!((mask >> i) & 1))
+            continue;
+
+        struct codebook_slot *slot = &cb.slots[i];
+        uint64_t ts = trace ? timing_realtime_ns() : 0;
+        uint64_t begin = timing_start();
+        ssize_t ret = pread(cb.files[slot->file].fd, buff, pg_size, (off_t)(slot->page * pg_size));
+        uint64_t end = timing_stop();
+
+        if (ret < 0) {
+            fprintf(stderr, "Warning: Read error at %s page %zu: %s\n",
+                    cb.files[slot->file].path, slot->page, strerror(errno));
+            continue;
+        }
+        total_read_cycles += timing_elapsed(begin, end);
+        slots_primed++;
+        if (trace)
+            trace_add(trace, ts, file_ids[slot->file], slot->page, timing_elapsed(begin, end), 0,
+                      TRACE_LABEL_PRIME);
+        if (verbose)
+            fprintf(stderr, "Primed slot %zu: %s page %zu\n", i, cb.files[slot->file].path,
+                    slot->page);
+    }
+    uint64_t total_end_ns = timing_monotonic_ns();
+
+    if (verbose)
+        printf("codebook,symbol_bits,symbol,slot_mask,slots_primed,avg_read_cycles,total_ns\n");
+    printf("%s,%u,%lu,0x%lx,%zu,%lu,%lu\n",
+           codebook_path,
+           cb.symbol_bits,
+           symbol,
+           mask,
+           slots_primed,
+           slots_primed > 0 ? total_read_cycles / slots_primed : 0,
+           total_end_ns - total_begin_ns);
 
-/* -------------------------------
-   CLOCK_REALTIME in nanoseconds
-   ------------------------------- */
-static inline uint64_t realtime_ns(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    fflush(stdout);
+    codebook_close(&cb);
+    return 0;
 }
 
-#ifdef USE_RDTSC
-
-#define CLOCK_FUNC() \
-    realtime_ns()
-
-#else
-#define CLOCK_FUNC() \
-    rdtsc()
+// Prime one page of every pair (see pairs.h), the first for a '0' and the
+// second for a '1', then evict the partners (verified, see cache_reset.h),
+// leaving the pairs as the pattern says whatever the last message left.
+// Fails if a partner stays cached (e.g. under runsc, where the eviction
+// cannot be verified): the pair would decode as noise.
+static int send_pairs(const char *bit_pattern, char **files, size_t num_files, size_t stride,
+                      const char *manifest, bool verbose)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    char buff[pg_size];
+    size_t num_bits = strlen(bit_pattern);
+    int fds[PAIRS_MAX_FILES];
+    size_t file_pgs[PAIRS_MAX_FILES];
+    uint16_t file_ids[PAIRS_MAX_FILES];
+    size_t pages_primed = 0;
+    uint64_t total_read_cycles = 0;
+
+    if (strspn(bit_pattern, "01") != num_bits || num_bits == 0) {
+        fprintf(stderr, "Error: bit_pattern must contain only 0s and 1s\n");
+        exit(1);
+    }
+    timing_init();
+    for (size_t f = 0; f < num_files; f++) {
+        fds[f] = open(files[f], O_RDONLY);
+        if (fds[f] == -1 || (file_pgs[f] = carrier_pages(fds[f], manifest, files[f])) == (size_t)-1) {
+            fprintf(stderr, "Failed to open file %s: %s\n", files[f], strerror(errno));
+            exit(errno);
+        }
+        // Readahead would warm the partner pages
+        posix_fadvise(fds[f], 0, 0, POSIX_FADV_RANDOM);
+        file_ids[f] = trace ? trace_file_id(trace, files[f]) : 0;
+    }
+    size_t capacity = pairs_capacity(file_pgs, num_files, stride);
+    if (num_bits > capacity) {
+        fprintf(stderr, "Error: %zu bits at stride %zu need more pages, the files hold %zu\n",
+                num_bits, stride, capacity);
+        exit(EINVAL);
+    }
 
-#endif
+    uint64_t total_begin_ns = timing_monotonic_ns();
+    for (size_t i = 0; i < num_bits; i++) {
+        int side = bit_pattern[i] == '1';
+        size_t f = pair_file(i, num_files);
+        size_t page = pair_page(i, num_files, stride, side);
+        uint64_t ts = trace ? timing_realtime_ns() : 0;
+        uint64_t begin = timing_start();
+        ssize_t ret = pread(fds[f], buff, pg_size, (off_t)(page * pg_size));
+        uint64_t end = timing_stop();
+
+        if (ret < 0) {
+            fprintf(stderr, "Warning: Read error at %s page %zu: %s\n", files[f], page,
+                    strerror(errno));
+            continue;
+        }
+        if (ret == 0) {
+            carrier_short_read(page);
+            continue;
+        }
+        total_read_cycles += timing_elapsed(begin, end);
+        pages_primed++;
+        if (trace)
+            trace_add(trace, ts, file_ids[f], page, timing_elapsed(begin, end), 0,
+                      TRACE_LABEL_PRIME);
+        if (verbose)
+            fprintf(stderr, "Bit %zu: primed %s page %zu\n", i, files[f], page);
+    }
 
-#define COUNTER_FUNC() \
-    rdtsc()
+    // The last decode read both pages of every pair
+    size_t left = 0;
+    for (size_t i = 0; i < num_bits; i++) {
+        size_t f = pair_file(i, num_files);
+        left += cache_reset(fds[f], pair_page(i, num_files, stride, bit_pattern[i] != '1'), 1,
+                            true) != 0;
+    }
+    uint64_t total_end_ns = timing_monotonic_ns();
+
+    if (verbose)
+        printf("files,bit_pattern,stride,pages_primed,avg_read_cycles,total_ns\n");
+    printf("%zu,%s,%zu,%zu,%lu,%lu\n",
+           num_files,
+           bit_pattern,
+           stride,
+           pages_primed,
+           pages_primed > 0 ? total_read_cycles / pages_primed : 0,
+           total_end_ns - total_begin_ns);
 
+    fflush(stdout);
+    for (size_t f = 0; f < num_files; f++)
+        close(fds[f]);
+    if (left) {
+        fprintf(stderr, "Error: %zu partner pages could not be evicted, their bits will not decode\n",
+                left);
+        return 1;
+    }
+    return 0;
+}
 
 
 int main(int argc, char *argv[]) {
@@ -64,21 +201,71 @@ int main(int argc, char *argv[]) {
     char buff[pg_size];
     bool verbose = false;
     int arg_idx = 1;
+    const char *trace_path = NULL;
+    const char *manifest = NULL;
+    size_t pair_stride = PAIRS_DEFAULT_STRIDE;
+    bool map_file = false;
+    struct low_jitter low_jitter = { .cpu = -1 };
     
     // Declare timing variables at function scope
-    clock_t seek_begin = 0, seek_end = 0;
+    uint64_t seek_begin = 0, seek_end = 0;
     uint64_t seek_begin_ns = 0, seek_end_ns = 0;
-    clock_t map_end = 0;
+    uint64_t map_end = 0;
     uint64_t map_end_ns = 0;
 
-    // Check for -v flag
-    if (argc >= 2 && strcmp(argv[1], "-v") == 0) {
-        verbose = true;
-        arg_idx = 2;
+    // Check for -v, -m, -T, -p, -M and --low-jitter flags
+    while (arg_idx < argc) {
+        if (strcmp(argv[arg_idx], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg_idx], "-m") == 0) {
+            map_file = true;
+        } else if (strcmp(argv[arg_idx], "-T") == 0 && arg_idx + 1 < argc) {
+            trace_path = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-p") == 0 && arg_idx + 1 < argc) {
+            pair_stride = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-M") == 0 && arg_idx + 1 < argc) {
+            manifest = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "--low-jitter") == 0 && arg_idx + 1 < argc) {
+            if (low_jitter_parse(argv[++arg_idx], &low_jitter) == -1)
+                exit(EINVAL);
+        } else {
+            break;
+        }
+        arg_idx++;
+    }
+
+    // Before the trace is opened, this may re-execute the tool
+    if (low_jitter.cpu >= 0)
+        low_jitter_enter(&low_jitter, argv, verbose);
+    if (trace_path) {
+        if (trace_open(&trace_state, trace_path) == -1)
+            exit(1);
+        trace = &trace_state;
     }
 
-    if (argc < arg_idx + 1) {
-        fprintf(stderr, "Usage: %s [-v] <file> [page_number]\n", argv[0]);
+    if (argc == arg_idx + 3 && strcmp(argv[arg_idx], "-S") == 0) {
+        int ret = send_symbol(argv[arg_idx + 1], argv[arg_idx + 2], verbose);
+        if (trace)
+            trace_close(trace);
+        return ret;
+    }
+
+    if (argc >= arg_idx + 3 && argc <= arg_idx + 2 + PAIRS_MAX_FILES && pair_stride > 0 &&
+        strcmp(argv[arg_idx], "-D") == 0) {
+        int ret = send_pairs(argv[arg_idx + 1], &argv[arg_idx + 2], argc - arg_idx - 2,
+                             pair_stride, manifest, verbose);
+        if (trace)
+            trace_close(trace);
+        return ret;
+    }
+
+    if (argc < arg_idx + 1 || pair_stride == 0) {
+        fprintf(stderr, "Usage: %s [-v] [-m] [-T trace_file] [--low-jitter cpu[:rt_prio]] <file> [page_number]\n", argv[0]);
+        fprintf(stderr, "       %s [-v] [-T trace_file] [--low-jitter cpu[:rt_prio]] -S <codebook> <symbol>\n", argv[0]);
+        fprintf(stderr, "       %s [-v] [-T trace_file] [-p stride] [-M manifest] [--low-jitter cpu[:rt_prio]] -D <bit_pattern> <file> [<file> ...]\n", argv[0]);
+        fprintf(stderr, "  -m: map the whole file before reading and time the mmap (map_* columns)\n");
+        fprintf(stderr, "  -D: prime one page of each pair for spy_on_diff -n (see pairs.h), -p: pair stride (default: %d)\n",
+                PAIRS_DEFAULT_STRIDE);
         exit(EBADF);
     }
     
@@ -86,18 +273,17 @@ int main(int argc, char *argv[]) {
 	page_to_read = atoi(argv[arg_idx + 1]);
     }
 
-    //warm up timers
-    CLOCK_FUNC();
-    COUNTER_FUNC();
+    //calibrate and warm up timers
+    timing_init();
 
 
 
     //time the open
-    clock_t open_begin = COUNTER_FUNC();
-    uint64_t open_begin_ns = CLOCK_FUNC();
+    uint64_t open_begin = timing_start();
+    uint64_t open_begin_ns = timing_monotonic_ns();
     f_map = open(argv[arg_idx], O_RDONLY );//| O_DIRECT | O_SYNC);
-    clock_t open_end = COUNTER_FUNC();
-    uint64_t open_end_ns = CLOCK_FUNC();
+    uint64_t open_end = timing_stop();
+    uint64_t open_end_ns = timing_monotonic_ns();
 
 
     if (f_map == -1) {
@@ -105,11 +291,11 @@ int main(int argc, char *argv[]) {
         exit(errno);
     }
 
-    clock_t stat_begin = COUNTER_FUNC();
-    uint64_t stat_begin_ns = CLOCK_FUNC();
+    uint64_t stat_begin = timing_start();
+    uint64_t stat_begin_ns = timing_monotonic_ns();
     fstat(f_map, &f_map_stat);
-    clock_t stat_end = COUNTER_FUNC();
-    uint64_t stat_end_ns = CLOCK_FUNC();
+    uint64_t stat_end = timing_stop();
+    uint64_t stat_end_ns = timing_monotonic_ns();
 
     file_pgs = (f_map_stat.st_size + (pg_size - 1)) / pg_size;
 
@@ -119,50 +305,57 @@ int main(int argc, char *argv[]) {
     // is to maximize the probability of being reclaimed. At the end
     // of the day, the main reclaim decision is made by LRU
     // priniciple.
-    clock_t map_begin = COUNTER_FUNC();
-    uint64_t map_begin_ns = CLOCK_FUNC();
-
-#if MMAP_FILE
-    void *mapped_to = mmap(NULL, f_map_stat.st_size,
-                           PROT_EXEC, MAP_SHARED, f_map, 0);
-
-    map_end = COUNTER_FUNC();
-    map_end_ns = CLOCK_FUNC();
-#endif
+    uint64_t map_begin = timing_start();
+    uint64_t map_begin_ns = timing_monotonic_ns();
+
+    void *mapped_to = MAP_FAILED;
+    if (map_file) {
+        mapped_to = mmap(NULL, f_map_stat.st_size, PROT_EXEC, MAP_SHARED, f_map, 0);
+        map_end = timing_stop();
+        map_end_ns = timing_monotonic_ns();
+        if (mapped_to == MAP_FAILED) {
+            perror("mmap");
+            exit(errno);
+        }
+    }
     if (argc == arg_idx + 2)
     {
-        seek_begin = COUNTER_FUNC();
-        seek_begin_ns = CLOCK_FUNC();
+        seek_begin = timing_start();
+        seek_begin_ns = timing_monotonic_ns();
         file_pgs = 1;
 	    lseek(f_map, pg_size * page_to_read, SEEK_SET);
-        seek_end = COUNTER_FUNC();
-        seek_end_ns = CLOCK_FUNC();
+        seek_end = timing_stop();
+        seek_end_ns = timing_monotonic_ns();
     }
     
+    uint16_t file_id = trace ? trace_file_id(trace, argv[arg_idx]) : 0;
     for (size_t i = 0; i < file_pgs; i++)
     {
+        uint64_t ts = trace ? timing_realtime_ns() : 0;
         
         //double time_spent = 0.0;
-        clock_t begin = COUNTER_FUNC();
-        uint64_t begin_ns = CLOCK_FUNC();
+        uint64_t begin = timing_start();
+        uint64_t begin_ns = timing_monotonic_ns();
     
             read(f_map, buff, pg_size);
 
-        clock_t end = COUNTER_FUNC();
-        uint64_t end_ns = CLOCK_FUNC();
+        uint64_t end = timing_stop();
+        uint64_t end_ns = timing_monotonic_ns();
+        if (trace)
+            trace_add(trace, ts, file_id, argc == arg_idx + 2 ? (size_t)page_to_read : i,
+                      timing_elapsed(begin, end), end_ns - begin_ns, TRACE_LABEL_PRIME);
         
         usleep(3000);
 
     }
-    clock_t total_end = COUNTER_FUNC();
-    uint64_t total_end_ns = CLOCK_FUNC();
+    uint64_t total_end = timing_stop();
+    uint64_t total_end_ns = timing_monotonic_ns();
 
     // Print CSV header if verbose
     if (verbose) {
         printf("page_size,filename,open_cycles,open_ns,open_ratio,stat_cycles,stat_ns,stat_ratio,file_pages");
-#if MMAP_FILE
-        printf(",map_cycles,map_ns,map_ratio");
-#endif
+        if (map_file)
+            printf(",map_cycles,map_ns,map_ratio");
         if (argc == arg_idx + 2) {
             printf(",seek_pos,page_number,seek_cycles,seek_ns,seek_ratio");
         }
@@ -173,26 +366,26 @@ int main(int argc, char *argv[]) {
     printf("%zu,%s,%lu,%lu,%f,%lu,%lu,%f,%lu",
            pg_size,
            argv[arg_idx],
-           (open_end - open_begin),
+           timing_elapsed(open_begin, open_end),
            (open_end_ns - open_begin_ns),
-           (double)(open_end - open_begin) / (double)(open_end_ns - open_begin_ns),
-           (stat_end - stat_begin),
+           (double)timing_elapsed(open_begin, open_end) / (double)(open_end_ns - open_begin_ns),
+           timing_elapsed(stat_begin, stat_end),
            (stat_end_ns - stat_begin_ns),
-           (double)(stat_end - stat_begin) / (double)(stat_end_ns - stat_begin_ns),
+           (double)timing_elapsed(stat_begin, stat_end) / (double)(stat_end_ns - stat_begin_ns),
            file_pgs);
-#if MMAP_FILE
-    printf(",%lu,%lu,%f",
-           (map_end - map_begin),
-           (map_end_ns - map_begin_ns),
-           (double)(map_end - map_begin) / (double)(map_end_ns - map_begin_ns));
-#endif
+    if (map_file) {
+        printf(",%lu,%lu,%f",
+               timing_elapsed(map_begin, map_end),
+               (map_end_ns - map_begin_ns),
+               (double)timing_elapsed(map_begin, map_end) / (double)(map_end_ns - map_begin_ns));
+    }
     if (argc == arg_idx + 2) {
         printf(",0x%llx,%d,%lu,%lu,%f",
                (unsigned long long)(pg_size * page_to_read),
                page_to_read,
-               (seek_end - seek_begin),
+               timing_elapsed(seek_begin, seek_end),
                (seek_end_ns - seek_begin_ns),
-               (double)(seek_end - seek_begin) / (double)(seek_end_ns - seek_begin_ns));
+               (double)timing_elapsed(seek_begin, seek_end) / (double)(seek_end_ns - seek_begin_ns));
     }
     printf(",%lu,%lu,%f\n",
            (total_end - map_begin),
@@ -200,7 +393,11 @@ int main(int argc, char *argv[]) {
            (double)(total_end - map_begin) / (double)(total_end_ns - map_begin_ns));
 
     fflush(stdout);
+    if (trace)
+        trace_close(trace);
 
+    if (mapped_to != MAP_FAILED)
+        munmap(mapped_to, f_map_stat.st_size);
     close(f_map);
     return 0;
 }
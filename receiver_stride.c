@@ -2,10 +2,63 @@
  * Receiver for strided page cache covert channel
  * Times access to every Nth page of a file to detect cached pages
  * 
- * Usage: ./receiver_stride <file> [num_bits] [cycle_threshold] [stride]
+ * Usage: ./receiver_stride [-v] [-u] [-N] [-w window] [-t threads] [-a endpoint] [-c calib_file [-C]]
+ *                         [-d] [-e code] [-s interval_us [-n max_frames]] [-M manifest]
+ *                         [-T trace_file] [-H stats_file] [-J jump_ns] [-g gap_us]
+ *                         [--low-jitter cpu[:rt_prio]]
+ *                         <file> [num_bits] [cycle_threshold] [stride]
  *   num_bits: number of strided pages to check (default: auto-detect)
- *   cycle_threshold: cycles threshold for cached vs not cached (default: 100000)
+ *   cycle_threshold: threshold for cached vs not cached in timing ticks
+ *       (default: DEFAULT_THRESHOLD_NS, 100000 cycles of a 2.5 GHz TSC)
  *   stride: page stride size (default: 32)
+ *   -u: submit the strided reads through io_uring instead of lseek()/read()
+ *   -N: ask the kernel whether each page is cached instead of reading it
+ *       (cachestat() or preadv2(RWF_NOWAIT), see probe.h), so probing
+ *       leaves the bits as they are; the query latency is still recorded.
+ *       Falls back to reads where the runtime supports neither.
+ *   -w: number of reads in flight per io_uring submission (default: 64)
+ *   -t: split the bits into contiguous slices probed by this many threads,
+ *       each pinned to its own core with its own descriptor (default: 1)
+ *   -a: run as an agent on a control socket (see agent.h) and serve
+ *       "RECV [num_bits] [cycle_threshold] [stride] [gap_us]" requests,
+ *       the command line values act as defaults for omitted fields; a
+ *       num_bits whose encoding the carrier cannot hold gets an ERR reply
+ *   -c: take the threshold from calib_file, calibrating on the spare pages
+ *       between the strided ones first if the file is missing or stale
+ *       (see calib.h), and track its drift while decoding; overrides
+ *       cycle_threshold. -C forces a new calibration.
+ *   -d: dense mode for small strides: readahead off on every probing
+ *       descriptor (POSIX_FADV_RANDOM) and probing (serial or -u) from the
+ *       last bit down, so readahead cannot warm bits that are still to be
+ *       read; not with -t, whose slices run side by side
+ *   -e: decode an error correcting code (none, hamming, conv; see fec.h)
+ *       from soft values derived from the cycle times. num_bits then counts
+ *       payload bits, the num_bits column the carrier bits probed and
+ *       bit_pattern holds the decoded payload.
+ *   -s: stream mode, decode one frame (see frame.h) per interval and write
+ *       the payloads to stdout until interrupted or -n frames arrived;
+ *       frame statistics go to stderr. num_bits is ignored.
+ *   -M: take the file geometry from a carrier manifest (see carrier.h)
+ *   -T: append every probed page to a binary sample trace (see trace.h),
+ *       labelled with its hard decision; the timestamp is the start of the
+ *       probe pass
+ *   -H: save latency statistics and histograms of the cached and uncached
+ *       bits (see hist.h) after every probe pass, cumulative since start;
+ *       -v prints the summaries
+ *   -J: run the interference monitor (see monitor.h) on a spare core and
+ *       treat bits probed while it saw a gap of more than jump_ns (0: 2000)
+ *       as tainted: kept out of the statistics and calibration, labelled in
+ *       the trace, erasures for -e when they look uncached
+ *   -g: pause between two serial probes in microseconds (default: 100,
+ *       0: none), the knob the pacing controller of run_stride_channel.py
+ *       turns per RECV request
+ *   --low-jitter: pin to cpu (worker threads included), SCHED_FIFO at
+ *       rt_prio if given, memory locked and prefaulted (see lowjitter.h)
+ *
+ * With -u the reads of a window are submitted at once. Cached pages complete
+ * inline during submission and get the submit cost split between them;
+ * uncached ones are punted to the kernel's async workers and get the TSC
+ * delta from submission to their completion, so the threshold still applies.
  */
 
 #define _GNU_SOURCE
@@ -21,18 +74,55 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <time.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+
+#include "agent.h"
+#include "carrier.h"
+#include "timing.h"
+#include "calib.h"
+#include "hist.h"
+#include "probe.h"
+#include "trace.h"
+#include "uring.h"
+#include "monitor.h"
+#include "lowjitter.h"
+#include "frame.h"
+#include "fec.h"
 
 #define DEFAULT_PAGE_STRIDE 32
-#define USE_READ_FOR_PROBING 1
-#define DEFAULT_CYCLE_THRESHOLD (100ULL * 1000ULL) //100k cycles as default threshold for cached vs not cached
+#define DEFAULT_URING_WINDOW 64
+#define DEFAULT_PROBE_GAP_US 100
+#define MAX_CALIBRATION_PAGES 256
+// Default threshold for cached vs not cached in ns, turned into ticks of
+// the timing source at start (TSC cycles or, with the clock fallback, ns)
+#define DEFAULT_THRESHOLD_NS (40ULL * 1000ULL)
+
+// Raw samples go here with -T
+static struct trace trace_state;
+static struct trace *trace = NULL;
+
+// Latencies by hard decision, saved to stats_path with -H
+static struct hist hist_hot, hist_cold;
+static const char *stats_path = NULL;
 
-static inline uint64_t rdtsc(void)
+// Interference monitor with -J, NULL without
+static struct monitor monitor_state;
+static struct monitor *monitor = NULL;
+
+static void save_stats(bool verbose)
 {
-    unsigned int lo, hi;
-    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
-    return ((uint64_t)hi << 32) | lo;
+    if (verbose) {
+        hist_print(stderr, "hot", &hist_hot);
+        hist_print(stderr, "cold", &hist_cold);
+    }
+    if (stats_path)
+        hist_save(stats_path, &hist_hot, &hist_cold);
 }
 
+
 static inline uint64_t measure_page_access_cycles(int f_map, size_t pg_size, 
                                                     char* buff, size_t page_to_read,
                                                     uint64_t *read_ns)
@@ -49,9 +139,9 @@ static inline uint64_t measure_page_access_cycles(int f_map, size_t pg_size,
     }
     
     // Time the read operation
-    start = rdtsc();
+    start = timing_start();
     ssize_t bytes_read = read(f_map, buff, pg_size);
-    end = rdtsc();
+    end = timing_stop();
     
     clock_gettime(CLOCK_REALTIME, &ts_end);
     
@@ -59,37 +149,822 @@ static inline uint64_t measure_page_access_cycles(int f_map, size_t pg_size,
         perror("read");
         return UINT64_MAX;
     }
+    if (bytes_read == 0) {
+        carrier_short_read(page_to_read);
+        return UINT64_MAX;
+    }
     
     if (read_ns) {
         *read_ns = (ts_end.tv_sec - ts_start.tv_sec) * 1000000000 +
                    (ts_end.tv_nsec - ts_start.tv_nsec);
     }
     
-    return end - start;
+    return timing_elapsed(start, end);
+}
+
+// Serial backend: one lseek()/read() per strided page with a gap_us pause.
+// Bits [first_bit, first_bit + num_bits) land in cycle_times[0 .. num_bits).
+// Descending order keeps any readahead behind the probe, on bits already read.
+// With nowait the kernel's answer goes to resident, the query is timed.
+// windows, if set, gets the span of every probe for the interference monitor.
+static void probe_serial(int f_map, size_t pg_size, char *buff, size_t first_bit, size_t num_bits,
+                         size_t page_stride, bool descending, unsigned gap_us,
+                         const enum probe_via *nowait, uint64_t *cycle_times, uint64_t *ns_times,
+                         signed char *resident, struct monitor_window *windows)
+{
+    for (size_t i = 0; i < num_bits; i++) {
+        size_t bit_idx = descending ? num_bits - 1 - i : i;
+        size_t page = (first_bit + bit_idx) * page_stride;
+        uint64_t read_ns_val = 0;
+        uint64_t window_start = windows ? timing_start() : 0;
+
+        if (nowait) {
+            uint64_t begin_ns = timing_monotonic_ns();
+            resident[bit_idx] = probe_residency(f_map, *nowait, page, pg_size, buff,
+                                                &cycle_times[bit_idx]);
+            read_ns_val = timing_monotonic_ns() - begin_ns;
+        } else {
+            cycle_times[bit_idx] = measure_page_access_cycles(f_map, pg_size, buff, page,
+                                                              &read_ns_val);
+        }
+        ns_times[bit_idx] = read_ns_val;
+        if (windows)
+            windows[bit_idx] = (struct monitor_window){ window_start, timing_stop() };
+
+        // Pause between measurements
+        if (gap_us > 0)
+            usleep(gap_us);
+    }
+}
+
+// Batched backend: submit windows of strided reads through io_uring and
+// timestamp each completion against its window's submit time. Descending
+// submits the windows, and the reads within each, from the last bit down.
+// Returns -1 if the kernel/runtime does not provide io_uring.
+static int probe_uring(int f_map, size_t pg_size, size_t first_bit, size_t num_bits,
+                       size_t page_stride, unsigned window, bool descending,
+                       uint64_t *cycle_times, uint64_t *ns_times,
+                       struct monitor_window *windows)
+{
+    struct uring ring;
+
+    if (uring_setup(&ring, window) == -1)
+        return -1;
+
+    char *bufs = malloc((size_t)window * pg_size);
+    if (!bufs) {
+        perror("malloc");
+        uring_teardown(&ring);
+        exit(1);
+    }
+
+    for (size_t done = 0; done < num_bits; done += window) {
+        unsigned n = (num_bits - done) < window ? (unsigned)(num_bits - done) : window;
+        size_t base = descending ? num_bits - done - n : done;
+        unsigned tail = *ring.sq_tail;
+        unsigned mask = *ring.sq_mask;
+
+        for (unsigned i = 0; i < n; i++, tail++) {
+            unsigned idx = tail & mask;
+            struct io_uring_sqe *sqe = &ring.sqes[idx];
+            size_t bit_idx = base + (descending ? n - 1 - i : i);
+
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = f_map;
+            sqe->addr = (uint64_t)(uintptr_t)(bufs + (size_t)i * pg_size);
+            sqe->len = pg_size;
+            sqe->off = (uint64_t)(first_bit + bit_idx) * page_stride * pg_size;
+            sqe->user_data = bit_idx;
+            ring.sq_array[idx] = idx;
+        }
+        __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+        uint64_t submit_cycles = timing_start();
+        uint64_t submit_ns = timing_realtime_ns();
+        if (uring_enter(&ring, n, 0) < 0) {
+            perror("io_uring_enter");
+            free(bufs);
+            uring_teardown(&ring);
+            return -1;
+        }
+        uint64_t enter_cycles = timing_stop();
+        uint64_t enter_ns = timing_realtime_ns();
+
+        // Completions already posted when io_uring_enter() returns were
+        // served inline from the page cache; they share the submit cost.
+        unsigned head = *ring.cq_head;
+        unsigned inline_done = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE) - head;
+        bool first_pass = true;
+
+        unsigned reaped = 0;
+        while (reaped < n) {
+            unsigned cq_tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+            if (head == cq_tail) {
+                uring_enter(&ring, 0, 1);
+                first_pass = false;
+                continue;
+            }
+
+            uint64_t now_cycles = timing_stop();
+            uint64_t now_ns = timing_realtime_ns();
+            for (; head != cq_tail; head++, reaped++) {
+                struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+                size_t bit_idx = cqe->user_data;
+
+                if (cqe->res <= 0) {
+                    if (cqe->res < 0)
+                        fprintf(stderr, "io_uring read: %s\n", strerror(-cqe->res));
+                    else
+                        carrier_short_read((first_bit + bit_idx) * page_stride);
+                    cycle_times[bit_idx] = UINT64_MAX;
+                    ns_times[bit_idx] = 0;
+                } else if (first_pass && reaped < inline_done) {
+                    cycle_times[bit_idx] = timing_elapsed(submit_cycles, enter_cycles) / inline_done;
+                    ns_times[bit_idx] = (enter_ns - submit_ns) / inline_done;
+                    if (windows)
+                        windows[bit_idx] = (struct monitor_window){ submit_cycles, enter_cycles };
+                } else {
+                    cycle_times[bit_idx] = timing_elapsed(submit_cycles, now_cycles);
+                    ns_times[bit_idx] = now_ns - submit_ns;
+                    if (windows)
+                        windows[bit_idx] = (struct monitor_window){ submit_cycles, now_cycles };
+                }
+            }
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+            first_pass = false;
+        }
+    }
+
+    free(bufs);
+    uring_teardown(&ring);
+    return 0;
+}
+
+struct probe_opts {
+    bool use_uring;
+    bool nowait;
+    enum probe_via via;     // with nowait
+    unsigned uring_window;
+    unsigned num_threads;
+    unsigned gap_us;        // serial backend only
+    bool dense;
+};
+
+// Probe one contiguous range of bits with the selected backend.
+// resident[i] is the kernel's answer with nowait, else -1.
+static void probe_range(int f_map, size_t first_bit, size_t num_bits, size_t page_stride,
+                        const struct probe_opts *opts, uint64_t *cycle_times, uint64_t *ns_times,
+                        signed char *resident, struct monitor_window *windows)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    char buff[pg_size];
+
+    memset(resident, -1, num_bits);
+
+    // Readahead state is per open file, so every descriptor needs this
+    if (opts->dense)
+        posix_fadvise(f_map, 0, 0, POSIX_FADV_RANDOM);
+
+    if (opts->use_uring && !opts->nowait &&
+        probe_uring(f_map, pg_size, first_bit, num_bits, page_stride, opts->uring_window,
+                    opts->dense, cycle_times, ns_times, windows) == 0)
+        return;
+    if (opts->use_uring && !opts->nowait)
+        fprintf(stderr, "Warning: io_uring unavailable (%s), falling back to serial reads\n",
+                strerror(errno));
+    probe_serial(f_map, pg_size, buff, first_bit, num_bits, page_stride, opts->dense, opts->gap_us,
+                 opts->nowait ? &opts->via : NULL, cycle_times, ns_times, resident, windows);
+}
+
+// One receiver worker: its own core, descriptor and slice of the results.
+struct probe_worker {
+    pthread_t thread;
+    const char *filename;
+    int cpu;
+    size_t first_bit;
+    size_t num_bits;
+    size_t page_stride;
+    const struct probe_opts *opts;
+    uint64_t *cycle_times;
+    uint64_t *ns_times;
+    signed char *resident;
+    struct monitor_window *windows;
+};
+
+static void *probe_worker_main(void *arg)
+{
+    struct probe_worker *w = arg;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        fprintf(stderr, "Warning: cannot pin worker to cpu %d\n", w->cpu);
+
+    int fd = open(w->filename, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Worker failed to open %s: %s\n", w->filename, strerror(errno));
+        for (size_t i = 0; i < w->num_bits; i++) {
+            w->cycle_times[i] = UINT64_MAX;
+            w->resident[i] = -1;
+        }
+        return NULL;
+    }
+
+    probe_range(fd, w->first_bit, w->num_bits, w->page_stride, w->opts,
+                w->cycle_times, w->ns_times, w->resident, w->windows);
+    close(fd);
+    return NULL;
+}
+
+// Split the bit range into contiguous slices, one pinned worker per slice,
+// cycling through the CPUs this process may run on.
+static void probe_threaded(const char *filename, size_t first_bit, size_t num_bits,
+                           size_t page_stride, const struct probe_opts *opts,
+                           uint64_t *cycle_times, uint64_t *ns_times, signed char *resident,
+                           struct monitor_window *windows)
+{
+    unsigned num_threads = opts->num_threads < num_bits ? opts->num_threads : (unsigned)num_bits;
+    struct probe_worker *workers = calloc(num_threads, sizeof(*workers));
+    int cpus[CPU_SETSIZE];
+    int num_cpus = 0;
+    cpu_set_t allowed;
+
+    if (!workers) {
+        perror("calloc");
+        exit(1);
+    }
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &allowed))
+                cpus[num_cpus++] = c;
+        }
+    }
+    if (num_cpus == 0)
+        cpus[num_cpus++] = 0;
+
+    size_t done = 0;
+    for (unsigned t = 0; t < num_threads; t++) {
+        struct probe_worker *w = &workers[t];
+        size_t slice = num_bits / num_threads + (t < num_bits % num_threads ? 1 : 0);
+
+        w->filename = filename;
+        w->cpu = cpus[t % num_cpus];
+        w->first_bit = first_bit + done;
+        w->num_bits = slice;
+        w->page_stride = page_stride;
+        w->opts = opts;
+        w->cycle_times = cycle_times + done;
+        w->ns_times = ns_times + done;
+        w->resident = resident + done;
+        w->windows = windows ? windows + done : NULL;
+        done += slice;
+
+        if (pthread_create(&w->thread, NULL, probe_worker_main, w) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    for (unsigned t = 0; t < num_threads; t++)
+        pthread_join(workers[t].thread, NULL);
+    free(workers);
+}
+
+// Hard decision for one bit: the kernel's answer where there is one, else
+// the latency. Tainted samples do not move the calibration.
+static bool bit_cached(signed char answer, uint64_t cycles, bool tainted, struct calib *calib,
+                       uint64_t cycle_threshold)
+{
+    if (answer >= 0)
+        return answer;
+    if (!calib)
+        return cycles < cycle_threshold;
+    return tainted ? cycles < calib->threshold : calib_update(calib, cycles);
+}
+
+// Flag the timed bits whose probe overlapped an interference event (-J),
+// returns how many. Without the monitor nothing is tainted.
+static size_t tag_interference(const struct monitor_window *windows, const uint64_t *cycle_times,
+                               const signed char *answers, size_t num_bits,
+                               unsigned char *tainted)
+{
+    size_t count = 0;
+
+    memset(tainted, 0, num_bits);
+    if (!monitor)
+        return 0;
+    for (size_t i = 0; i < num_bits; i++) {
+        if (answers[i] >= 0 || cycle_times[i] == UINT64_MAX)
+            continue;
+        tainted[i] = monitor_tainted(monitor, windows[i].start, windows[i].end);
+        count += tainted[i];
+    }
+    return count;
+}
+
+// Replace the hard decisions in bits[0 .. data_bits) with the decoded payload.
+// The kernel's answers, where there are any, are certain; tainted bits that
+// look uncached are erasures, the delay may be the interference's.
+static void decode_bits(enum fec_code code, const uint64_t *cycle_times,
+                        const signed char *resident, const unsigned char *tainted,
+                        size_t num_bits, size_t data_bits, uint64_t cycle_threshold,
+                        const struct calib *calib, unsigned char *bits)
+{
+    double *soft = malloc(num_bits * sizeof(double));
+
+    if (data_bits > num_bits) {
+        fprintf(stderr, "Error: %zu data bits do not fit in %zu carrier bits\n",
+                data_bits, num_bits);
+        exit(EINVAL);
+    }
+    if (!soft) {
+        perror("malloc");
+        exit(1);
+    }
+    for (size_t i = 0; i < num_bits; i++) {
+        soft[i] = resident[i] >= 0 ? (resident[i] ? 1.0 : -1.0)
+                                   : calib_soft(calib, cycle_threshold, cycle_times[i]);
+        if (tainted[i] && soft[i] < 0)
+            soft[i] = 0.0;
+    }
+    if (fec_decode(code, soft, data_bits, bits) == -1) {
+        perror("fec_decode");
+        exit(1);
+    }
+    free(soft);
+}
+
+// Probe the strided pages carrying data_bits (after -e encoding) of f_map
+// and print the CSV record to out. With calib set, the threshold follows
+// its drift tracking instead of cycle_threshold.
+static void receive_pattern(int f_map, const char *filename, size_t data_bits,
+                            uint64_t cycle_threshold, size_t page_stride, enum fec_code code,
+                            const struct probe_opts *opts, struct calib *calib, bool verbose,
+                            FILE *out)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    size_t num_bits = fec_encoded_bits(code, data_bits);
+    
+    // Arrays to store results
+    unsigned char *resident_bits = malloc(num_bits);
+    uint64_t *cycle_times = malloc(num_bits * sizeof(uint64_t));
+    uint64_t *ns_times = malloc(num_bits * sizeof(uint64_t));
+    signed char *answers = malloc(num_bits);
+    unsigned char *tainted = malloc(num_bits);
+    struct monitor_window *windows = monitor ? malloc(num_bits * sizeof(*windows)) : NULL;
+    
+    if (!resident_bits || !cycle_times || !ns_times || !answers || !tainted ||
+        (monitor && !windows)) {
+        perror("malloc");
+        exit(1);
+    }
+    
+    uint64_t min_cycles = UINT64_MAX;
+    uint64_t max_cycles = 0;
+    uint64_t total_cycles = 0;
+    uint64_t total_ns = 0;
+    size_t cached_count = 0;
+    
+    uint64_t pass_ns = trace ? timing_realtime_ns() : 0;
+    uint16_t file_id = trace ? trace_file_id(trace, filename) : 0;
+    uint64_t measurement_start = timing_start();
+    
+    // Measure each strided page
+    if (opts->num_threads > 1)
+        probe_threaded(filename, 0, num_bits, page_stride, opts, cycle_times, ns_times, answers,
+                       windows);
+    else
+        probe_range(f_map, 0, num_bits, page_stride, opts, cycle_times, ns_times, answers,
+                    windows);
+    
+    uint64_t measurement_end = timing_stop();
+    size_t tainted_count = tag_interference(windows, cycle_times, answers, num_bits, tainted);
+    
+    for (size_t bit_idx = 0; bit_idx < num_bits; bit_idx++) {
+        size_t page_num = bit_idx * page_stride;
+        uint64_t cycles = cycle_times[bit_idx];
+        
+        if (cycles == UINT64_MAX) {
+            fprintf(stderr, "Warning: Failed to measure page %zu (bit %zu)\n", page_num, bit_idx);
+            if (trace)
+                trace_add(trace, pass_ns, file_id, page_num, 0, 0, TRACE_LABEL_NONE);
+            resident_bits[bit_idx] = 0;
+            cycle_times[bit_idx] = 0;
+            ns_times[bit_idx] = 0;
+            continue;
+        }
+        
+        total_cycles += cycles;
+        total_ns += ns_times[bit_idx];
+        
+        if (cycles < min_cycles) min_cycles = cycles;
+        if (cycles > max_cycles) max_cycles = cycles;
+        
+        // Determine if page is cached, the kernel knows best
+        if (bit_cached(answers[bit_idx], cycles, tainted[bit_idx], calib, cycle_threshold)) {
+            resident_bits[bit_idx] = 1;
+            cached_count++;
+        } else {
+            resident_bits[bit_idx] = 0;
+        }
+        // Interference is kept out of the statistics
+        if (!tainted[bit_idx])
+            hist_add(resident_bits[bit_idx] ? &hist_hot : &hist_cold, cycles);
+        if (trace)
+            trace_add(trace, pass_ns, file_id, page_num, cycles, ns_times[bit_idx],
+                      tainted[bit_idx] ? TRACE_LABEL_TAINTED : resident_bits[bit_idx]);
+        
+        if (verbose) {
+            fprintf(stderr, "Bit %zu (page %zu): %lu cycles, %lu ns -> %s%s\n",
+                    bit_idx, page_num, cycles, ns_times[bit_idx],
+                    resident_bits[bit_idx] ? "CACHED" : "not cached",
+                    tainted[bit_idx] ? " (tainted)" : "");
+        }
+    }
+    if (monitor && verbose)
+        fprintf(stderr, "Interference: %zu of %zu bits tainted, %lu jumps so far\n",
+                tainted_count, num_bits, monitor_events(monitor));
+    
+    // Raw cycle times stay in the record, the pattern becomes the payload
+    if (code != FEC_NONE)
+        decode_bits(code, cycle_times, answers, tainted, num_bits, data_bits, cycle_threshold,
+                    calib, resident_bits);
+    
+    // Print CSV data
+    uint64_t avg_cycles = num_bits > 0 ? total_cycles / num_bits : 0;
+    uint64_t avg_ns = num_bits > 0 ? total_ns / num_bits : 0;
+    
+    fprintf(out, "%s,%zu,%zu,%zu,%zu,%lu,%lu,%lu,%lu,%lu,%lu,",
+           filename,
+           pg_size,
+           num_bits,
+           page_stride,
+           cached_count,
+           calib ? calib->threshold : cycle_threshold,
+           min_cycles,
+           max_cycles,
+           avg_cycles,
+           avg_ns,
+           measurement_end - measurement_start);
+    
+    // Print bit pattern
+    for (size_t i = 0; i < data_bits; i++) {
+        fputc('0' + resident_bits[i], out);
+    }
+    fputc(',', out);
+    
+    // Print cycle values (space-separated)
+    for (size_t i = 0; i < num_bits; i++) {
+        fprintf(out, "%lu", cycle_times[i]);
+        if (i < num_bits - 1) fputc(' ', out);
+    }
+    fputc('\n', out);
+    
+    // Agents run until killed, keep the trace and statistics current per request
+    if (trace)
+        trace_flush(trace);
+    save_stats(verbose);
+    free(resident_bits);
+    free(cycle_times);
+    free(ns_times);
+    free(answers);
+    free(tainted);
+    free(windows);
+}
+
+struct receiver_agent {
+    int f_map;
+    const char *filename;
+    size_t file_pgs;
+    size_t num_bits;
+    uint64_t cycle_threshold;
+    size_t page_stride;
+    enum fec_code code;
+    struct probe_opts opts;
+    struct calib *calib;
+    bool verbose;
+};
+
+static void receiver_agent_handle(char *line, FILE *out, void *ctx)
+{
+    struct receiver_agent *agent = ctx;
+    char *cmd = strtok(line, " ");
+    char *bits_arg = strtok(NULL, " ");
+    char *threshold_arg = strtok(NULL, " ");
+    char *stride_arg = strtok(NULL, " ");
+    char *gap_arg = strtok(NULL, " ");
+    struct probe_opts opts = agent->opts;
+    size_t num_bits = agent->num_bits;
+    uint64_t cycle_threshold = agent->cycle_threshold;
+    size_t page_stride = agent->page_stride;
+
+    if (!cmd || strcmp(cmd, "RECV") != 0) {
+        fprintf(out, "ERR usage: RECV [num_bits] [cycle_threshold] [stride] [gap_us]\n");
+        return;
+    }
+    if (gap_arg)
+        opts.gap_us = strtoul(gap_arg, NULL, 10);
+    if (threshold_arg && strtoull(threshold_arg, NULL, 10) > 0)
+        cycle_threshold = strtoull(threshold_arg, NULL, 10);
+    if (stride_arg && strtoul(stride_arg, NULL, 10) > 0)
+        page_stride = strtoul(stride_arg, NULL, 10);
+    size_t max_bits = fec_data_bits(agent->code, agent->file_pgs / page_stride);
+    if (bits_arg && strtoul(bits_arg, NULL, 10) > 0) {
+        num_bits = strtoul(bits_arg, NULL, 10);
+        // A shorter pattern than asked for would only show up as bit errors
+        if (num_bits > max_bits) {
+            fprintf(out, "ERR %zu bits need %zu pages at stride %zu, %s holds %zu bits\n",
+                    num_bits, fec_encoded_bits(agent->code, num_bits) * page_stride, page_stride,
+                    fec_names[agent->code], max_bits);
+            return;
+        }
+    }
+    if (num_bits == 0 || num_bits > max_bits)
+        num_bits = max_bits;
+    if (num_bits == 0) {
+        fprintf(out, "ERR stride %zu leaves no pages to probe\n", page_stride);
+        return;
+    }
+
+    receive_pattern(agent->f_map, agent->filename, num_bits, cycle_threshold, page_stride,
+                    agent->code, &opts, agent->calib, agent->verbose, out);
+}
+
+static volatile sig_atomic_t stream_stop;
+
+static void stream_handle_signal(int sig)
+{
+    (void)sig;
+    stream_stop = 1;
+}
+
+struct stream_stats {
+    size_t slots;
+    size_t frames;
+    size_t corrupt;
+    size_t empty;
+    size_t lost;       // sequence numbers skipped between good frames
+    size_t late;       // slots passed over because probing fell behind
+    size_t tainted;    // bits probed during interference (-J)
+    size_t payload_bytes;
+};
+
+static void print_stream_stats(const struct stream_stats *st, size_t slot_bits,
+                               uint64_t interval_ns, uint64_t elapsed_ns)
+{
+    double seconds = (double)elapsed_ns / 1e9;
+
+    fprintf(stderr, "Stream: %zu slots, %zu frames ok, %zu corrupt, %zu empty, %zu lost, "
+                    "%zu late, %zu payload bytes in %.2f s\n",
+            st->slots, st->frames, st->corrupt, st->empty, st->lost, st->late,
+            st->payload_bytes, seconds);
+    fprintf(stderr, "Stream: payload %.1f bps, raw %.1f bps\n",
+            seconds > 0 ? st->payload_bytes * 8 / seconds : 0.0,
+            slot_bits * 1e9 / (double)interval_ns);
+    if (monitor)
+        fprintf(stderr, "Stream: %zu bits tainted by interference, %lu jumps\n", st->tainted,
+                monitor_events(monitor));
+}
+
+// Decode frames slot by slot and write their payloads to stdout.
+static int run_stream(int f_map, const char *filename, size_t file_pgs, uint64_t cycle_threshold,
+                      size_t page_stride, enum fec_code code, uint64_t interval_ns,
+                      size_t max_frames, const struct probe_opts *opts, struct calib *calib,
+                      bool verbose)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    size_t slot_bits = fec_encoded_bits(code, FRAME_SLOT_BITS);
+    size_t num_regions = file_pgs / page_stride / slot_bits;
+    unsigned char *bits = malloc(slot_bits);
+    uint64_t *cycle_times = malloc(slot_bits * sizeof(uint64_t));
+    uint64_t *ns_times = malloc(slot_bits * sizeof(uint64_t));
+    signed char *answers = malloc(slot_bits);
+    unsigned char *tainted = malloc(slot_bits);
+    struct monitor_window *windows = monitor ? malloc(slot_bits * sizeof(*windows)) : NULL;
+    uint8_t payload[FRAME_MAX_PAYLOAD], seq, len;
+    uint8_t last_seq = 0;
+    bool have_seq = false;
+    struct stream_stats st = {0};
+
+    if (!bits || !cycle_times || !ns_times || !answers || !tainted || (monitor && !windows)) {
+        perror("malloc");
+        exit(1);
+    }
+    // The sender writes the next region while this one is read
+    if (num_regions < 2) {
+        fprintf(stderr, "Error: %s too small for two frames (%zu strided pages each at stride %zu)\n",
+                filename, slot_bits, page_stride);
+        return 1;
+    }
+
+    signal(SIGINT, stream_handle_signal);
+    signal(SIGTERM, stream_handle_signal);
+    posix_fadvise(f_map, 0, 0, POSIX_FADV_RANDOM);
+    uint16_t file_id = trace ? trace_file_id(trace, filename) : 0;
+
+    uint64_t begin_ns = timing_realtime_ns();
+    uint64_t slot = begin_ns / interval_ns;
+    if (verbose)
+        fprintf(stderr, "Streaming from %s: %zu regions, %lu us per frame\n",
+                filename, num_regions, interval_ns / 1000);
+
+    while (!stream_stop && (max_frames == 0 || st.frames < max_frames)) {
+        // Read slot s a quarter into slot s+1, once its priming is done
+        frame_sleep_until((slot + 1) * interval_ns + interval_ns / 4);
+        if (stream_stop)
+            break;
+
+        size_t region = slot % num_regions;
+        size_t first_bit = region * slot_bits;
+        uint64_t pass_ns = trace ? timing_realtime_ns() : 0;
+        if (opts->num_threads > 1)
+            probe_threaded(filename, first_bit, slot_bits, page_stride, opts,
+                           cycle_times, ns_times, answers, windows);
+        else
+            probe_range(f_map, first_bit, slot_bits, page_stride, opts,
+                        cycle_times, ns_times, answers, windows);
+        st.tainted += tag_interference(windows, cycle_times, answers, slot_bits, tainted);
+
+        for (size_t i = 0; i < slot_bits; i++) {
+            uint64_t cycles = cycle_times[i];
+            bits[i] = cycles != UINT64_MAX &&
+                      bit_cached(answers[i], cycles, tainted[i], calib, cycle_threshold);
+            if (cycles != UINT64_MAX && !tainted[i])
+                hist_add(bits[i] ? &hist_hot : &hist_cold, cycles);
+            if (trace) {
+                uint8_t label = cycles == UINT64_MAX ? TRACE_LABEL_NONE
+                                : tainted[i] ? TRACE_LABEL_TAINTED : bits[i];
+                trace_add(trace, pass_ns, file_id, (first_bit + i) * page_stride,
+                          cycles == UINT64_MAX ? 0 : cycles, ns_times[i], label);
+            }
+            // Leave the region cold for the sender's next pass over it
+            posix_fadvise(f_map, (off_t)frame_page(region, slot_bits, i, page_stride) * pg_size,
+                          pg_size, POSIX_FADV_DONTNEED);
+        }
+        if (code != FEC_NONE)
+            decode_bits(code, cycle_times, answers, tainted, slot_bits, FRAME_SLOT_BITS,
+                        cycle_threshold, calib, bits);
+
+        st.slots++;
+        int ret = frame_decode(bits, FRAME_SLOT_BITS, &seq, payload, &len);
+        if (ret == 0) {
+            if (have_seq && seq != (uint8_t)(last_seq + 1))
+                st.lost += (uint8_t)(seq - last_seq - 1);
+            last_seq = seq;
+            have_seq = true;
+            st.frames++;
+            st.payload_bytes += len;
+            fwrite(payload, 1, len, stdout);
+            fflush(stdout);
+        } else if (ret == -2) {
+            st.corrupt++;
+        } else {
+            st.empty++;
+        }
+        if (verbose)
+            fprintf(stderr, "Slot %lu (region %zu): %s seq %u len %u\n", slot, region,
+                    ret == 0 ? "frame" : ret == -2 ? "corrupt" : "empty",
+                    ret == 0 ? seq : 0, ret == 0 ? len : 0);
+
+        // Skip slots whose read window has already closed
+        uint64_t next = slot + 1;
+        uint64_t current = timing_realtime_ns() / interval_ns;
+        if (current > next + 1) {
+            st.late += current - next - 1;
+            next = current - 1;
+        }
+        slot = next;
+    }
+
+    print_stream_stats(&st, slot_bits, interval_ns, timing_realtime_ns() - begin_ns);
+    save_stats(verbose);
+    free(bits);
+    free(cycle_times);
+    free(ns_times);
+    free(answers);
+    free(tainted);
+    free(windows);
+    return 0;
 }
 
 int main(int argc, char *argv[])
 {
     int f_map;
-    struct stat f_map_stat;
     size_t pg_size = sysconf(_SC_PAGESIZE);
-    char buff[pg_size];
     bool verbose = false;
     int arg_idx = 1;
-    uint64_t cycle_threshold = DEFAULT_CYCLE_THRESHOLD;
+    uint64_t cycle_threshold = 0;
     size_t page_stride = DEFAULT_PAGE_STRIDE;
+    struct probe_opts opts = {
+        .uring_window = DEFAULT_URING_WINDOW,
+        .num_threads = 1,
+        .gap_us = DEFAULT_PROBE_GAP_US,
+    };
+    const char *agent_endpoint = NULL;
+    const char *calib_path = NULL;
+    bool force_calibration = false;
+    uint64_t stream_interval_us = 0;
+    size_t stream_max_frames = 0;
+    enum fec_code code = FEC_NONE;
+    struct calib calib_state = {0};
+    struct calib *calib = NULL;
+    const char *manifest = NULL;
+    const char *trace_path = NULL;
+    bool use_monitor = false;
+    uint64_t jump_ns = 0;
+    struct low_jitter low_jitter = { .cpu = -1 };
     
-    // Check for -v flag
-    if (argc >= 2 && strcmp(argv[1], "-v") == 0) {
-        verbose = true;
-        arg_idx = 2;
+    // Check for -v, -u, -N, -w, -t, -a, -c, -C, -d, -e, -s, -n, -M, -T, -H, -J, -g and --low-jitter flags
+    while (arg_idx < argc && argv[arg_idx][0] == '-') {
+        if (strcmp(argv[arg_idx], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg_idx], "-u") == 0) {
+            opts.use_uring = true;
+        } else if (strcmp(argv[arg_idx], "-N") == 0) {
+            opts.nowait = true;
+        } else if (strcmp(argv[arg_idx], "-w") == 0 && arg_idx + 1 < argc) {
+            opts.uring_window = strtoul(argv[++arg_idx], NULL, 10);
+            if (opts.uring_window == 0)
+                opts.uring_window = DEFAULT_URING_WINDOW;
+        } else if (strcmp(argv[arg_idx], "-t") == 0 && arg_idx + 1 < argc) {
+            opts.num_threads = strtoul(argv[++arg_idx], NULL, 10);
+            if (opts.num_threads == 0)
+                opts.num_threads = 1;
+        } else if (strcmp(argv[arg_idx], "-a") == 0 && arg_idx + 1 < argc) {
+            agent_endpoint = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-c") == 0 && arg_idx + 1 < argc) {
+            calib_path = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-C") == 0) {
+            force_calibration = true;
+        } else if (strcmp(argv[arg_idx], "-d") == 0) {
+            opts.dense = true;
+        } else if (strcmp(argv[arg_idx], "-e") == 0 && arg_idx + 1 < argc) {
+            if (fec_parse(argv[++arg_idx], &code) == -1) {
+                fprintf(stderr, "Error: unknown code %s (none, hamming, conv)\n", argv[arg_idx]);
+                exit(1);
+            }
+        } else if (strcmp(argv[arg_idx], "-s") == 0 && arg_idx + 1 < argc) {
+            stream_interval_us = strtoull(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-n") == 0 && arg_idx + 1 < argc) {
+            stream_max_frames = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-M") == 0 && arg_idx + 1 < argc) {
+            manifest = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-T") == 0 && arg_idx + 1 < argc) {
+            trace_path = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-H") == 0 && arg_idx + 1 < argc) {
+            stats_path = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-J") == 0 && arg_idx + 1 < argc) {
+            use_monitor = true;
+            jump_ns = strtoull(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-g") == 0 && arg_idx + 1 < argc) {
+            opts.gap_us = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "--low-jitter") == 0 && arg_idx + 1 < argc) {
+            if (low_jitter_parse(argv[++arg_idx], &low_jitter) == -1)
+                exit(EINVAL);
+        } else {
+            break;
+        }
+        arg_idx++;
+    }
+    // Concurrent slices cannot keep the whole pass in descending order
+    if (opts.dense && opts.num_threads > 1) {
+        fprintf(stderr, "Error: -d probes from the last bit down, which -t cannot keep\n");
+        exit(EINVAL);
     }
 
+    if (low_jitter.cpu >= 0)
+        low_jitter_enter(&low_jitter, argv, verbose);
+    timing_init();
+    cycle_threshold = timing_from_ns(DEFAULT_THRESHOLD_NS);
+    hist_init(&hist_hot);
+    hist_init(&hist_cold);
+
     if (argc < arg_idx + 1) {
-        fprintf(stderr, "Usage: %s [-v] <file> [num_bits] [cycle_threshold] [stride]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-v] [-u] [-N] [-w window] [-t threads] [-a endpoint] [-c calib_file [-C]] [-d] [-e code] [-s interval_us [-n max_frames]] [-M manifest] [-T trace_file] [-H stats_file] [-J jump_ns] [-g gap_us] [--low-jitter cpu[:rt_prio]] <file> [num_bits] [cycle_threshold] [stride]\n", argv[0]);
         fprintf(stderr, "  num_bits: number of strided pages to check (default: all available)\n");
-        fprintf(stderr, "  cycle_threshold: threshold in cycles (default: %lu)\n", DEFAULT_CYCLE_THRESHOLD);
+        fprintf(stderr, "  cycle_threshold: threshold in timing ticks (default: %lu, %llu ns)\n",
+                cycle_threshold, DEFAULT_THRESHOLD_NS);
         fprintf(stderr, "  stride: page stride size (default: %d)\n", DEFAULT_PAGE_STRIDE);
+        fprintf(stderr, "  -u: batched io_uring probing, -w: reads per submission (default: %d)\n",
+                DEFAULT_URING_WINDOW);
+        fprintf(stderr, "  -N: query residency (cachestat/RWF_NOWAIT) instead of reading, leaves bits intact\n");
+        fprintf(stderr, "  -t: probe with this many core-pinned threads (default: 1)\n");
+        fprintf(stderr, "  -a: serve RECV requests on unix:<path>, tcp:[addr:]<port> or vsock:<port>\n");
+        fprintf(stderr, "  -c: load or calibrate the threshold in calib_file, -C: force calibration\n");
+        fprintf(stderr, "  -d: suppress readahead for strides below %d\n", DEFAULT_PAGE_STRIDE);
+        fprintf(stderr, "  -e: decode error correcting code none, hamming or conv (default: none)\n");
+        fprintf(stderr, "  -s: decode a frame stream sent every interval_us to stdout, -n: stop after max_frames\n");
+        fprintf(stderr, "  -M: file geometry from a carrier manifest (see mkcarrier)\n");
+        fprintf(stderr, "  -T: append every probed page to a binary sample trace\n");
+        fprintf(stderr, "  -H: save hot/cold latency statistics and histograms\n");
+        fprintf(stderr, "  --low-jitter: pin to cpu, SCHED_FIFO at rt_prio, lock and prefault memory\n");
+        fprintf(stderr, "  -J: tag bits probed during timing jumps over jump_ns (0: %d)\n",
+                MONITOR_DEFAULT_JUMP_NS);
+        fprintf(stderr, "  -g: pause between serial probes in microseconds (default: %d)\n",
+                DEFAULT_PROBE_GAP_US);
         exit(1);
     }
     
@@ -102,19 +977,31 @@ int main(int argc, char *argv[])
         exit(errno);
     }
 
-    if (fstat(f_map, &f_map_stat) == -1) {
+    // From the manifest if it lists the file, else fstat()
+    size_t file_pgs = carrier_pages(f_map, manifest, filename);
+    if (file_pgs == (size_t)-1) {
         perror("fstat");
         close(f_map);
         exit(errno);
     }
 
-    if (f_map_stat.st_size == 0) {
+    if (file_pgs == 0) {
         fprintf(stderr, "File is empty.\n");
         close(f_map);
         return 1;
     }
+
+    if (opts.nowait) {
+        opts.via = probe_nowait_via(f_map, file_pgs * pg_size, pg_size);
+        if (opts.via == PROBE_VIA_TIMING)
+            fprintf(stderr, "Warning: no cachestat() or RWF_NOWAIT for %s, probing by reads\n",
+                    filename);
+        else if (verbose)
+            fprintf(stderr, "Residency via %s\n", probe_via_names[opts.via]);
+        if (opts.use_uring)
+            fprintf(stderr, "Warning: -N probes serially, -u ignored\n");
+    }
     
-    size_t file_pgs = (f_map_stat.st_size + (pg_size - 1)) / pg_size;
     size_t max_stride_pages = file_pgs / page_stride;
     size_t num_bits = max_stride_pages;
     
@@ -147,84 +1034,122 @@ int main(int argc, char *argv[])
         }
     }
     
+    // With -e, num_bits counts payload bits whose encoding must fit
+    if (num_bits > fec_data_bits(code, max_stride_pages))
+        num_bits = fec_data_bits(code, max_stride_pages);
+    
     if (num_bits == 0) {
         fprintf(stderr, "Error: num_bits is 0\n");
         close(f_map);
         return 1;
     }
     
-    if (verbose) {
-        fprintf(stderr, "File: %s\n", filename);
-        fprintf(stderr, "File size: %ld bytes\n", f_map_stat.st_size);
-        fprintf(stderr, "Page size: %zu bytes\n", pg_size);
-        fprintf(stderr, "Total pages: %zu\n", file_pgs);
-        fprintf(stderr, "Page stride: %zu\n", page_stride);
-        fprintf(stderr, "Max strided pages: %zu\n", max_stride_pages);
-        fprintf(stderr, "Testing bits: %zu\n", num_bits);
-        fprintf(stderr, "Cycle threshold: %lu\n", cycle_threshold);
+    if (calib_path) {
+        if (force_calibration || calib_load(&calib_state, calib_path) == -1) {
+            size_t *calib_pages = malloc(MAX_CALIBRATION_PAGES * sizeof(size_t));
+            size_t num_calib_pages = 0;
+            
+            if (!calib_pages) {
+                perror("malloc");
+                exit(1);
+            }
+            // Pages halfway between strided bits, or past the last bit for stride 1
+            for (size_t i = 0; i < max_stride_pages && num_calib_pages < MAX_CALIBRATION_PAGES; i++) {
+                size_t page = page_stride > 1 ? i * page_stride + page_stride / 2
+                                              : num_bits + 1 + 2 * i;
+                if (page < file_pgs)
+                    calib_pages[num_calib_pages++] = page;
+            }
+            
+            if (calib_run(&calib_state, f_map, calib_pages, num_calib_pages,
+                          CALIB_DEFAULT_ROUNDS, verbose) == 0) {
+                calib_save(&calib_state, calib_path);
+            }
+            free(calib_pages);
+        }
+        
+        if (calib_state.valid) {
+            calib = &calib_state;
+            if (verbose)
+                fprintf(stderr, "Calibrated threshold: %lu (hot 2^%.2f, cold 2^%.2f ticks)\n",
+                        calib->threshold, calib->hot_center, calib->cold_center);
+        } else {
+            fprintf(stderr, "Warning: no calibration, using threshold %lu\n", cycle_threshold);
+        }
     }
     
-    // Arrays to store results
-    unsigned char *resident_bits = malloc(num_bits);
-    uint64_t *cycle_times = malloc(num_bits * sizeof(uint64_t));
-    uint64_t *ns_times = malloc(num_bits * sizeof(uint64_t));
-    
-    if (!resident_bits || !cycle_times || !ns_times) {
-        perror("malloc");
-        close(f_map);
-        exit(1);
+    if (trace_path) {
+        if (trace_open(&trace_state, trace_path) == -1)
+            exit(1);
+        trace = &trace_state;
     }
     
-    uint64_t min_cycles = UINT64_MAX;
-    uint64_t max_cycles = 0;
-    uint64_t total_cycles = 0;
-    uint64_t total_ns = 0;
-    size_t cached_count = 0;
+    // Takes a core out of this process's mask, so after calibration
+    if (use_monitor && monitor_start(&monitor_state, jump_ns) == 0) {
+        monitor = &monitor_state;
+        if (verbose)
+            fprintf(stderr, "Interference monitor on cpu %d, jumps over %lu ticks\n",
+                    monitor->cpu, monitor->threshold);
+    }
     
-    uint64_t measurement_start = rdtsc();
+    if (stream_interval_us > 0) {
+        int ret = run_stream(f_map, filename, file_pgs, cycle_threshold, page_stride, code,
+                             stream_interval_us * 1000, stream_max_frames, &opts, calib, verbose);
+        if (calib)
+            calib_save(calib, calib_path);
+        if (trace)
+            trace_close(trace);
+        if (monitor)
+            monitor_stop(monitor);
+        close(f_map);
+        return ret;
+    }
     
-    // Measure each strided page
-    for (size_t bit_idx = 0; bit_idx < num_bits; bit_idx++) {
-        size_t page_num = bit_idx * page_stride;
-        uint64_t read_ns_val = 0;
-        
-        uint64_t cycles = measure_page_access_cycles(f_map, pg_size, buff, page_num, &read_ns_val);
-        
-        if (cycles == UINT64_MAX) {
-            fprintf(stderr, "Warning: Failed to measure page %zu (bit %zu)\n", page_num, bit_idx);
-            resident_bits[bit_idx] = 0;
-            cycle_times[bit_idx] = 0;
-            ns_times[bit_idx] = 0;
-            continue;
-        }
-        
-        cycle_times[bit_idx] = cycles;
-        ns_times[bit_idx] = read_ns_val;
-        total_cycles += cycles;
-        total_ns += read_ns_val;
-        
-        if (cycles < min_cycles) min_cycles = cycles;
-        if (cycles > max_cycles) max_cycles = cycles;
+    if (agent_endpoint) {
+        struct receiver_agent agent = {
+            .f_map = f_map,
+            .filename = filename,
+            .file_pgs = file_pgs,
+            .num_bits = num_bits,
+            .cycle_threshold = cycle_threshold,
+            .page_stride = page_stride,
+            .code = code,
+            .opts = opts,
+            .calib = calib,
+            .verbose = verbose,
+        };
+        int listen_fd = agent_listen(agent_endpoint);
+        if (listen_fd == -1)
+            exit(1);
+        if (verbose)
+            fprintf(stderr, "Receiver agent for %s listening on %s\n", filename, agent_endpoint);
         
-        // Determine if page is cached
-        if (cycles < cycle_threshold) {
-            resident_bits[bit_idx] = 1;
-            cached_count++;
-        } else {
-            resident_bits[bit_idx] = 0;
-        }
-        
-        if (verbose) {
-            fprintf(stderr, "Bit %zu (page %zu): %lu cycles, %lu ns -> %s\n",
-                    bit_idx, page_num, cycles, read_ns_val,
-                    resident_bits[bit_idx] ? "CACHED" : "not cached");
-        }
-        
-        // Small delay between measurements
-        usleep(100);
+        int ret = agent_serve(listen_fd, receiver_agent_handle, &agent);
+        if (calib)
+            calib_save(calib, calib_path);
+        if (trace)
+            trace_close(trace);
+        if (monitor)
+            monitor_stop(monitor);
+        close(listen_fd);
+        close(f_map);
+        return ret == 0 ? 0 : 1;
     }
     
-    uint64_t measurement_end = rdtsc();
+    if (verbose) {
+        fprintf(stderr, "File: %s\n", filename);
+        fprintf(stderr, "Page size: %zu bytes\n", pg_size);
+        fprintf(stderr, "Total pages: %zu%s\n", file_pgs, manifest ? " (manifest)" : "");
+        fprintf(stderr, "Page stride: %zu\n", page_stride);
+        fprintf(stderr, "Max strided pages: %zu\n", max_stride_pages);
+        fprintf(stderr, "Testing bits: %zu\n", num_bits);
+        fprintf(stderr, "Code: %s (%zu carrier bits)\n", fec_names[code], fec_encoded_bits(code, num_bits));
+        fprintf(stderr, "Cycle threshold: %lu\n", cycle_threshold);
+        fprintf(stderr, "Backend: %s, %u thread(s)%s\n", opts.use_uring ? "io_uring" : "serial",
+                opts.num_threads, opts.dense ? ", dense" : "");
+        fprintf(stderr, "Timing: %s, %.4f ns/tick, overhead %lu ticks\n",
+                timing.source, timing.ns_per_tick, timing.overhead);
+    }
     
     // Print CSV header if verbose
     if (verbose) {
@@ -233,41 +1158,17 @@ int main(int argc, char *argv[])
         printf("bit_pattern,cycle_values\n");
     }
     
-    // Print CSV data
-    uint64_t avg_cycles = num_bits > 0 ? total_cycles / num_bits : 0;
-    uint64_t avg_ns = num_bits > 0 ? total_ns / num_bits : 0;
-    
-    printf("%s,%zu,%zu,%zu,%zu,%lu,%lu,%lu,%lu,%lu,%lu,",
-           filename,
-           pg_size,
-           num_bits,
-           page_stride,
-           cached_count,
-           cycle_threshold,
-           min_cycles,
-           max_cycles,
-           avg_cycles,
-           avg_ns,
-           measurement_end - measurement_start);
-    
-    // Print bit pattern
-    for (size_t i = 0; i < num_bits; i++) {
-        fputc('0' + resident_bits[i], stdout);
-    }
-    printf(",");
+    receive_pattern(f_map, filename, num_bits, cycle_threshold, page_stride, code,
+                    &opts, calib, verbose, stdout);
     
-    // Print cycle values (space-separated)
-    for (size_t i = 0; i < num_bits; i++) {
-        printf("%lu", cycle_times[i]);
-        if (i < num_bits - 1) printf(" ");
-    }
-    printf("\n");
+    if (calib)
+        calib_save(calib, calib_path);
+    if (trace)
+        trace_close(trace);
+    if (monitor)
+        monitor_stop(monitor);
     
     fflush(stdout);
-    
-    free(resident_bits);
-    free(cycle_times);
-    free(ns_times);
     close(f_map);
     
     return 0;
@@ -8,6 +8,8 @@ TARGET_PAGE=0 # default value
 TARGET_PATH="../runsc" # default value
 VM_PATH="/home/fwilke/edu/BU/ec721"
 MEASURE_PAGE_COUNT=2
+CACHE_RESET=${CACHE_RESET:-./cache_reset}
+. "$(dirname "$0")/lib_evict.sh"
 
 
 #overload default values if arguments are provided
@@ -46,10 +48,7 @@ fi
 
 
 
-echo -e "\nEvicting page cache on the host..."
-sync
-echo 1 | sudo tee -a /proc/sys/vm/drop_caches
-echo "========> Entire OS Page Cache is now evicted."
+evict_vm_images
 
 
 
@@ -59,9 +58,9 @@ if [ ! -z "$3" ]; then
     echo -e "\n---> [VM1]: ./read_page $TARGET_PATH $TARGET_PAGE"
 
     ssh -p 2222 root@localhost << EOF
-    echo 1 | tee -a /proc/sys/vm/drop_caches
-
     cd ~/unionbuster
+    ./cache_reset $TARGET_PATH > /dev/null || echo 1 | tee -a /proc/sys/vm/drop_caches
+
     LD_BIND_NOW=1 ./read_page $TARGET_PATH $TARGET_PAGE
 EOF
 
@@ -70,9 +69,9 @@ fi
 echo -e "\n---> [VM2]: ./spy_on $TARGET_PATH $MEASURE_PAGE_COUNT"
 
 ssh -p 2223 root@localhost << EOF
-echo 1 | tee -a /proc/sys/vm/drop_caches
-
 cd ~/unionbuster
+./cache_reset $TARGET_PATH > /dev/null || echo 1 | tee -a /proc/sys/vm/drop_caches
+
 LD_BIND_NOW=1 ./spy_on $TARGET_PATH $MEASURE_PAGE_COUNT
 EOF
 
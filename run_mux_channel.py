@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""
+Multiplexed strided page channel: one logical link striped over K
+sub-channels
+
+Every sub-channel is a sender_stride/receiver_stride agent pair (see
+agent.h) with a carrier file of its own, each agent pinned to a core of
+its own with --low-jitter. A round cuts the next K * --bits bits of the
+payload into K chunks, chunk k for sub-channel k, primes all of them at
+once, reads all of them at once and resets the carriers; the receiver side
+puts the chunks back together in sub-channel order, so the link stays in
+order whatever sub-channel finishes first.
+
+    ./run_mux_channel.py -K 1,2,4 --carriers /workspace/rand{0,1,2,3}.bin
+    ./run_mux_channel.py -K 8 --rounds 20 --payload secret.txt --output received.bin \\
+        --carriers /tmp/carrier{0..7}.bin      # made with ./mkcarrier
+
+Prints one CSV row per sub-channel and round (header under -v) and a
+'#' summary per K: aggregate payload throughput, overall BER and the BER
+of the worst sub-channel, i.e. where cross-talk sets in as K grows. Runs
+wherever the tools are, natively or inside one container; the agents are
+started here and killed at the end.
+"""
+
+import argparse
+import os
+import random
+import subprocess
+import sys
+import threading
+import time
+
+from run_stride_channel import AgentConnection, calculate_bit_errors, fec_encoded_bits
+
+BIN_DIR = os.path.dirname(os.path.abspath(__file__))
+CARRIER_FILES = [f"/workspace/rand{i}.bin" for i in range(4)]
+CARRIER_MANIFEST = "/workspace/carriers.manifest"
+BASE_PORT = 7100  # Sub-channel k uses BASE_PORT + 2k (sender) and + 2k + 1 (receiver)
+BITS_PER_ROUND = 1024  # Per sub-channel
+ROUNDS = 10
+STRIDE = 32
+CYCLE_THRESHOLD = 0  # 0: the receiver's default (or its -c calibration)
+FEC_CODE = "none"
+RANDOM_SEED = 42
+
+CSV_HEADER = "k,round,subchannel,carrier,send_cpu,recv_cpu,bits,bit_errors,send_ns,recv_ns"
+
+
+class SubChannel:
+    """One sender/receiver agent pair on its own carrier and cores"""
+
+    def __init__(self, index, carrier, cpus, args):
+        self.index = index
+        self.carrier = carrier
+        self.cpus = cpus
+        self.args = args
+        self.procs = []
+        self.agents = []
+
+    def start(self):
+        for i, binary in enumerate(["sender_stride", "receiver_stride"]):
+            port = self.args.base_port + 2 * self.index + i
+            cmd = [os.path.join(self.args.bin_dir, binary), "--low-jitter", str(self.cpus[i]),
+                   "-e", self.args.fec]
+            if os.path.exists(self.args.manifest):
+                cmd += ["-M", self.args.manifest]
+            cmd += ["-a", f"tcp:127.0.0.1:{port}", self.carrier]
+            self.procs.append(subprocess.Popen(cmd))
+            self.agents.append(AgentConnection(port))
+
+    def stop(self):
+        for conn in self.agents:
+            conn.close()
+        for proc in self.procs:
+            proc.kill()
+            proc.wait()
+        self.agents, self.procs = [], []
+
+    def reset(self, bits):
+        """Evict the strided pages the chunk used, FEC parity included (see cache_reset.h)"""
+        last = fec_encoded_bits(self.args.fec, bits) * self.args.stride
+        subprocess.run([os.path.join(self.args.bin_dir, "cache_reset"),
+                        f"{self.carrier}:0-{last}"], capture_output=True)
+
+    def send(self, chunk):
+        begin = time.monotonic_ns()
+        try:
+            self.agents[0].request(f"SEND {chunk} {self.args.stride}")
+        except (RuntimeError, OSError) as e:
+            print(f"# sub-channel {self.index}: {e}", file=sys.stderr)
+        return time.monotonic_ns() - begin
+
+    def receive(self, bits):
+        """The received chunk, all '?' if the agent failed"""
+        begin = time.monotonic_ns()
+        try:
+            output = self.agents[1].request(f"RECV {bits} {self.args.threshold} {self.args.stride}")
+        except (RuntimeError, OSError) as e:
+            print(f"# sub-channel {self.index}: {e}", file=sys.stderr)
+            output = ""
+        elapsed = time.monotonic_ns() - begin
+        fields = output.split(',')
+        received = fields[11] if len(fields) >= 13 else "?" * bits
+        return received, elapsed
+
+
+def on_all(subchannels, fn, *per_channel):
+    """Run fn(sub, arg_k) on every sub-channel at once, results in sub-channel order"""
+    results = [None] * len(subchannels)
+
+    def run(k):
+        results[k] = fn(subchannels[k], *(arg[k] for arg in per_channel))
+
+    threads = [threading.Thread(target=run, args=(k,)) for k in range(len(subchannels))]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return results
+
+
+def assign_cpus(k):
+    """Two cores per sub-channel, wrapping around (and warning) when short"""
+    cpus = sorted(os.sched_getaffinity(0))
+    if len(cpus) < 2 * k:
+        print(f"# warning: {len(cpus)} cores for {k} sub-channels, agents share cores",
+              file=sys.stderr)
+    return [[cpus[(2 * i) % len(cpus)], cpus[(2 * i + 1) % len(cpus)]] for i in range(k)]
+
+
+def load_payload(args):
+    """The link's bits: the payload file MSB first, else seeded random bits"""
+    if args.payload:
+        with open(args.payload, 'rb') as f:
+            data = f.read()
+        return ''.join(f"{byte:08b}" for byte in data)
+    rng = random.Random(RANDOM_SEED)
+    return ''.join(rng.choice('01') for _ in range(max(args.k) * args.bits * args.rounds))
+
+
+def run_link(k, payload, args):
+    """Stripe payload over k sub-channels, returns the reassembled bits and the summary"""
+    if k > len(args.carriers):
+        sys.exit(f"{k} sub-channels need {k} carriers, got {len(args.carriers)} (see mkcarrier)")
+    cpus = assign_cpus(k)
+    subchannels = [SubChannel(i, args.carriers[i], cpus[i], args) for i in range(k)]
+    received_bits = []
+    errors = [0] * k
+    sent = [0] * k
+
+    try:
+        for sub in subchannels:
+            sub.start()
+        on_all(subchannels, SubChannel.reset, [args.bits] * k)
+
+        begin = time.monotonic()
+        rounds = 0
+        for offset in range(0, len(payload), k * args.bits):
+            if args.payload is None and rounds == args.rounds:
+                break
+            round_bits = payload[offset:offset + k * args.bits]
+            chunks = [round_bits[i * args.bits:(i + 1) * args.bits] for i in range(k)]
+            active = [i for i in range(k) if chunks[i]]
+            subs = [subchannels[i] for i in active]
+
+            send_ns = on_all(subs, SubChannel.send, [chunks[i] for i in active])
+            replies = on_all(subs, SubChannel.receive, [len(chunks[i]) for i in active])
+            on_all(subs, SubChannel.reset, [len(chunks[i]) for i in active])
+
+            # In order: sub-channel 0's chunk first, whoever answered first
+            for j, i in enumerate(active):
+                received, recv_ns = replies[j]
+                bit_errors = calculate_bit_errors(chunks[i], received)
+                errors[i] += bit_errors
+                sent[i] += len(chunks[i])
+                received_bits.append(received)
+                print(f"{k},{rounds},{i},{subchannels[i].carrier},{cpus[i][0]},{cpus[i][1]},"
+                      f"{len(chunks[i])},{bit_errors},{send_ns[j]},{recv_ns}", flush=True)
+            rounds += 1
+        elapsed = time.monotonic() - begin
+    finally:
+        for sub in subchannels:
+            sub.stop()
+
+    total_bits = sum(sent)
+    sub_ber = [errors[i] / sent[i] for i in range(k) if sent[i]]
+    print(f"# K={k}: {rounds} rounds, {total_bits} bits in {elapsed:.3f} s, "
+          f"{total_bits / elapsed if elapsed > 0 else 0:.1f} bps aggregate, "
+          f"BER {sum(errors) / total_bits if total_bits else 0:.4f}, "
+          f"worst sub-channel {max(sub_ber) if sub_ber else 0:.4f}", flush=True)
+    return ''.join(received_bits)
+
+
+def write_output(path, bits):
+    data = bytes(int(bits[i:i + 8].replace('?', '0'), 2)
+                 for i in range(0, len(bits) - len(bits) % 8, 8))
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def parse_args():
+    p = argparse.ArgumentParser(description="Strided page channel multiplexed over K sub-channels")
+    p.add_argument("-K", dest="k", type=lambda v: [int(x) for x in v.split(',')], default=[1],
+                   help="sub-channel counts to run, e.g. 1,2,4,8 (default: 1)")
+    p.add_argument("--carriers", nargs='+', default=CARRIER_FILES,
+                   help="one carrier file per sub-channel (default: %(default)s)")
+    p.add_argument("--manifest", default=CARRIER_MANIFEST, help="carrier manifest, if it exists")
+    p.add_argument("--bits", type=int, default=BITS_PER_ROUND,
+                   help="bits per sub-channel and round (default: %(default)s)")
+    p.add_argument("--rounds", type=int, default=ROUNDS,
+                   help="rounds of random bits without --payload (default: %(default)s)")
+    p.add_argument("--stride", type=int, default=STRIDE, help="page stride (default: %(default)s)")
+    p.add_argument("--threshold", type=int, default=CYCLE_THRESHOLD,
+                   help="cached/uncached cycle threshold, 0: the receiver's default")
+    p.add_argument("--fec", default=FEC_CODE, help="none, hamming or conv (default: %(default)s)")
+    p.add_argument("--payload", help="file to send instead of random bits")
+    p.add_argument("--output", help="write the reassembled payload of the last K here")
+    p.add_argument("--base-port", type=int, default=BASE_PORT,
+                   help="first agent TCP port (default: %(default)s)")
+    p.add_argument("--bin-dir", default=BIN_DIR, help="where the tools are (default: %(default)s)")
+    p.add_argument("-v", "--verbose", action="store_true", help="print the CSV header")
+    return p.parse_args()
+
+
+def main():
+    args = parse_args()
+    payload = load_payload(args)
+    if args.verbose:
+        print(CSV_HEADER)
+    received = ""
+    for k in args.k:
+        received = run_link(k, payload, args)
+    if args.output:
+        write_output(args.output, received)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -2,14 +2,36 @@
 """
 Covert channel experiment using strided pages
 Measures bandwidth and error rates using every 32nd page of a large file
+
+Scenarios (cache evict interval x runtime x stride) come from the matrix
+below or from a spec file (--spec), one scenario per line, '#' starts a
+comment:
+    [name=<tag>] evict=<R> runtime=<C> stride=<S> [reset=global]
+They run concurrently (-j), each in its own slot: a sender/receiver
+container pair with its own carrier file, agent ports and pinned cores.
+A scenario whose cache reset is global (drop_caches: reset=global, a
+runtime in GLOBAL_RESET_RUNTIMES, TARGETED_CACHE_RESET off, or a targeted
+reset that cannot be verified) runs alone. Every transmission is appended
+to one CSV tagged with its scenario; --resume keeps the scenarios that
+are complete there and reruns the rest.
+
+With --adaptive a pacing controller (PacingController) replaces the fixed
+pauses: it turns the sender's and receiver's inter-page gaps, the settle
+time between SEND and RECV and the stride after every transmission to
+hold --target-ber, and converges on the fastest settings the runtime holds.
 """
 
-import subprocess
-import time
+import argparse
 import csv
+import os
+import queue
+import socket
+import subprocess
 import sys
+import threading
+import time
+import math
 import random
-from datetime import datetime
 
 # Configuration
 # Evaluation Matrix Dimensions
@@ -18,15 +40,66 @@ RUNTIMES = ["runc"]  # C: Container runtimes to test (e.g., "runc", "runsc")
 STRIDE_SIZES = [32, 64, 128]  # S: Page stride sizes to test
 
 # Other Configuration
-TARGET_FILE = "/workspace/rand0.bin"
+CARRIER_FILES = [f"/workspace/rand{i}.bin" for i in range(4)]  # One per slot, see Dockerfile
+CARRIER_MANIFEST = "/workspace/carriers.manifest"  # Written by mkcarrier in the image (see Dockerfile)
 IMAGE_PATH = "union-buster:latest"
-CONTAINER_NAMES = ["sender_container", "receiver_container"]
+CONTAINER_NAMES = ["sender_container", "receiver_container"]  # Slot k appends _k
 OUTPUT_FILE = "stride_channel_results.csv"
 NUM_REPETITIONS = 3
-MESSAGE_LENGTH = 1024  # Number of bits per message (configurable)
+MESSAGE_LENGTH = 1024  # Number of bits per message (configurable), cut to what the carrier holds
+CARRIER_PAGES = 32768  # Pages per carrier file (mkcarrier in the Dockerfile)
 CYCLE_THRESHOLD = 100000
 NUM_RANDOM_PATTERNS = 5  # Number of random patterns to test
 RANDOM_SEED = 42  # For reproducibility (set to None for truly random)
+USE_AGENTS = True  # Talk to long-running sender/receiver agents instead of docker exec per transmission
+AGENT_PORTS = [7001, 7002]  # Published TCP control ports of the sender and receiver agents, slot k adds 2k
+TARGETED_CACHE_RESET = True  # Evict only the slot's carrier with cache_reset instead of drop_caches
+GLOBAL_RESET_RUNTIMES = ["runsc", "runsc-kvm"]  # cache_reset cannot verify there, drop_caches it is
+FEC_CODE = "none"  # Error correcting code of sender/receiver: "none", "hamming" or "conv" (see fec.h)
+DENSE = True  # Agents run with -d: readahead off, so strides below DEFAULT_PAGE_STRIDE decode
+DEFAULT_PAGE_STRIDE = 32  # Smallest stride that keeps readahead off the neighbouring bits without -d
+
+# Pacing, fixed unless --adaptive
+SENDER_GAP_US = 1000  # Pause after every primed page (sender_stride -g)
+RECEIVER_GAP_US = 100  # Pause between two probes (receiver_stride -g)
+SETTLE_MS = 50  # Pause between SEND and RECV
+TARGET_BER = 0.01  # Bit error rate the adaptive controller holds
+MIN_MARGIN = 0.3  # Decades between the samples closest to the threshold and the threshold
+MIN_STRIDE = 4 if DENSE else DEFAULT_PAGE_STRIDE  # Smallest stride the adaptive controller tries
+
+CSV_HEADER = [
+    'scenario',
+    'slot',
+    'carrier',
+    'experiment_start_time',
+    'cache_evict_interval',
+    'runtime',
+    'stride_size',
+    'pattern',
+    'repetition',
+    'received_pattern',
+    'bit_errors',
+    'duration_ms',
+    'send_cycles',
+    'send_ns',
+    'cached_count',
+    'avg_cycles',
+    'min_cycles',
+    'max_cycles',
+    'cycle_values',
+    'sender_gap_us',
+    'receiver_gap_us',
+    'settle_ms',
+    'margin',
+    'used_stride'
+]
+
+# Serializes console output of the concurrent scenarios
+print_lock = threading.Lock()
+
+def log(*args):
+    with print_lock:
+        print(*args, flush=True)
 
 def generate_random_patterns(num_patterns, message_length):
     """Generate random bit patterns"""
@@ -51,8 +124,7 @@ def run_command(cmd, capture_output=True, check=True):
         return result.stdout.strip() if capture_output else None
     except subprocess.CalledProcessError as e:
         if check:
-            print(f"Command failed: {cmd}")
-            print(f"Error: {e.stderr}")
+            log(f"Command failed: {cmd}\nError: {e.stderr}")
             raise
         return None
 
@@ -61,248 +133,598 @@ def docker_exec(container, command):
     cmd = f"sudo docker exec {container} {command}"
     return run_command(cmd)
 
-def clear_page_cache():
-    """Clear the system page cache"""
-    run_command("sync", capture_output=False)
-    run_command("echo 1 | sudo tee /proc/sys/vm/drop_caches > /dev/null 2>&1")
-
-def setup_containers(runtime):
-    """Setup Docker containers with specified runtime"""
-    print("Setting up containers...")
-    for name in CONTAINER_NAMES:
-        # Remove existing container
-        run_command(f"sudo docker rm --force {name}", check=False)
-        
-        # Start new container
-        print(f"  Starting container: {name}")
-        container_id = run_command(
-            f"sudo docker run --runtime={runtime} -d --name {name} {IMAGE_PATH}"
-        )
-        print(f"    {container_id}")
-    
-    print("\nContainers running:")
-    run_command(
-        f"sudo docker container ls | grep -E '{CONTAINER_NAMES[0]}|{CONTAINER_NAMES[1]}'",
-        capture_output=False
-    )
-
-def cleanup_containers():
-    """Remove Docker containers"""
-    print("Cleaning up containers...")
-    for name in CONTAINER_NAMES:
-        run_command(f"sudo docker rm --force {name}", check=False)
+class AgentConnection:
+    """Line-oriented connection to a sender_stride/receiver_stride agent (see agent.h)"""
+
+    def __init__(self, port, timeout=30):
+        deadline = time.time() + timeout
+        while True:
+            try:
+                self.sock = socket.create_connection(("127.0.0.1", port), timeout=timeout)
+                break
+            except OSError:
+                if time.time() > deadline:
+                    raise
+                time.sleep(0.1)
+        self.stream = self.sock.makefile('rw')
+
+    def request(self, line):
+        self.stream.write(line + "\n")
+        self.stream.flush()
+        reply = self.stream.readline().strip()
+        if not reply or reply.startswith("ERR"):
+            raise RuntimeError(f"Agent request '{line[:40]}' failed: {reply}")
+        return reply
+
+    def close(self):
+        try:
+            self.stream.write("QUIT\n")
+            self.stream.flush()
+        except OSError:
+            pass
+        self.sock.close()
+
+class GlobalResetNeeded(Exception):
+    """A targeted cache reset could not be verified, the scenario must run alone"""
+
+class Slot:
+    """Resources of one concurrently running scenario"""
+
+    def __init__(self, index, carrier, cpus):
+        self.index = index
+        self.carrier = carrier
+        self.cpus = cpus  # [sender cpu, receiver cpu], or None
+        self.containers = [f"{name}_{index}" for name in CONTAINER_NAMES]
+        self.ports = [port + 2 * index for port in AGENT_PORTS]
+        self.agents = [None, None]
+
+    def start_agents(self):
+        """Start the long-running agents and connect to their control ports"""
+        binaries = ["sender_stride", "receiver_stride"]
+        dense = "-d " if DENSE else ""
+        # Every interface of the container, docker publishes the port on host loopback only
+        for i, name in enumerate(self.containers):
+            run_command(
+                f"sudo docker exec -d {name} /workspace/{binaries[i]} "
+                f"{dense}-e {FEC_CODE} -M {CARRIER_MANIFEST} -a tcp:0.0.0.0:{self.ports[i]} {self.carrier}"
+            )
+            self.agents[i] = AgentConnection(self.ports[i])
+
+    def stop_agents(self):
+        """Close the agent connections"""
+        for i, conn in enumerate(self.agents):
+            if conn is not None:
+                conn.close()
+                self.agents[i] = None
+
+    def setup_containers(self, runtime):
+        """Setup Docker containers with specified runtime"""
+        for i, name in enumerate(self.containers):
+            # Remove existing container
+            run_command(f"sudo docker rm --force {name}", check=False)
+
+            publish = f"-p 127.0.0.1:{self.ports[i]}:{self.ports[i]}" if USE_AGENTS else ""
+            cpuset = f"--cpuset-cpus={self.cpus[i]}" if self.cpus else ""
+            container_id = run_command(
+                f"sudo docker run --runtime={runtime} -d {publish} {cpuset} --name {name} {IMAGE_PATH}"
+            )
+            log(f"  [slot {self.index}] started {name} ({runtime}): {container_id[:12]}")
+
+        if USE_AGENTS:
+            self.start_agents()
+
+    def cleanup_containers(self):
+        """Remove Docker containers"""
+        self.stop_agents()
+        for name in self.containers:
+            run_command(f"sudo docker rm --force {name}", check=False)
+
+    def clear_page_cache(self, global_reset):
+        """Evict the slot's carrier from the page cache, the whole cache only when running alone"""
+        # The containers share the host page cache for the image's carrier files
+        if TARGETED_CACHE_RESET and not global_reset:
+            cmd = f"sudo docker exec {self.containers[1]} /workspace/cache_reset {self.carrier}"
+            if subprocess.run(cmd, shell=True, capture_output=True).returncode == 0:
+                return
+            raise GlobalResetNeeded()
+        run_command("sync", capture_output=False)
+        run_command("echo 1 | sudo tee /proc/sys/vm/drop_caches > /dev/null 2>&1")
+
+    def send_pattern(self, pattern, stride, gap_us):
+        """Send a pattern by priming cache"""
+        if USE_AGENTS:
+            output = self.agents[0].request(f"SEND {pattern} {stride} {gap_us}")
+        else:
+            cmd = (f"/workspace/sender_stride -e {FEC_CODE} -M {CARRIER_MANIFEST} -g {gap_us} "
+                   f"{self.carrier} {pattern} {stride}")
+            output = docker_exec(self.containers[0], cmd)
+
+        # Parse CSV output from sender
+        # Format: page_size,filename,bit_pattern,num_bits,pages_primed,stride,open_cycles,open_ns,avg_read_cycles,avg_read_ns,total_cycles,total_ns
+        fields = output.split(',')
+        if len(fields) >= 12:
+            total_cycles = fields[10]
+            total_ns = fields[11]
+            return total_cycles, total_ns
+        else:
+            return "0", "0"
+
+    def receive_pattern(self, num_bits, stride, gap_us):
+        """Receive pattern by detecting cached pages"""
+        if USE_AGENTS:
+            output = self.agents[1].request(f"RECV {num_bits} {CYCLE_THRESHOLD} {stride} {gap_us}")
+        else:
+            cmd = (f"/workspace/receiver_stride -e {FEC_CODE} -M {CARRIER_MANIFEST} -g {gap_us} "
+                   f"{self.carrier} {num_bits} {CYCLE_THRESHOLD} {stride}")
+            output = docker_exec(self.containers[1], cmd)
+
+        # Parse CSV output
+        fields = output.split(',')
+        if len(fields) >= 13:
+            received = fields[11]  # bit_pattern field
+            cached_count = fields[4]
+            avg_cycles = fields[8]
+            min_cycles = fields[6]
+            max_cycles = fields[7]
+            cycle_values = fields[12].strip()  # individual cycle times (space-separated)
+            threshold = int(fields[5])  # calibrated one with -c
+            return received, cached_count, avg_cycles, min_cycles, max_cycles, cycle_values, threshold
+        else:
+            return "?" * num_bits, "0", "0", "0", "0", "", CYCLE_THRESHOLD
+
+def fec_encoded_bits(code, data_bits):
+    """Carrier bits data_bits of payload take (fec_encoded_bits() of fec.h)"""
+    if code == "hamming":
+        return (data_bits + 3) // 4 * 7
+    if code == "conv":
+        return 2 * (data_bits + 6)
+    return data_bits
+
+def fec_data_bits(code, coded_bits):
+    """Payload bits that fit into coded_bits carrier bits (fec_data_bits() of fec.h)"""
+    if code == "hamming":
+        return coded_bits // 7 * 4
+    if code == "conv":
+        return max(coded_bits // 2 - 6, 0)
+    return coded_bits
+
+def message_bits(stride):
+    """Bits of a message at stride: MESSAGE_LENGTH, or less if its FEC_CODE
+    encoding does not fit the carrier (the receiver would cut it anyway)"""
+    return min(MESSAGE_LENGTH, fec_data_bits(FEC_CODE, CARRIER_PAGES // stride))
 
 def calculate_bit_errors(sent, received):
     """Calculate number of bit errors between two binary strings"""
     if len(sent) != len(received):
         return len(sent)  # Complete mismatch
-    
+
     errors = sum(1 for i in range(len(sent)) if sent[i] != received[i])
     return errors
 
-def send_pattern(pattern, stride):
-    """Send a pattern by priming cache"""
-    cmd = f"/workspace/sender_stride {TARGET_FILE} {pattern} {stride}"
-    output = docker_exec(CONTAINER_NAMES[0], cmd)
-    
-    # Parse CSV output from sender
-    # Format: page_size,filename,bit_pattern,num_bits,pages_primed,stride,open_cycles,open_ns,avg_read_cycles,avg_read_ns,total_cycles,total_ns
-    fields = output.split(',')
-    if len(fields) >= 12:
-        total_cycles = fields[10]
-        total_ns = fields[11]
-        return total_cycles, total_ns
-    else:
-        return "0", "0"
-
-def receive_pattern(stride):
-    """Receive pattern by detecting cached pages"""
-    cmd = f"/workspace/receiver_stride {TARGET_FILE} {MESSAGE_LENGTH} {CYCLE_THRESHOLD} {stride}"
-    output = docker_exec(CONTAINER_NAMES[1], cmd)
-    
-    # Parse CSV output
-    fields = output.split(',')
-    if len(fields) >= 13:
-        received = fields[11]  # bit_pattern field
-        cached_count = fields[4]
-        avg_cycles = fields[8]
-        min_cycles = fields[6]
-        max_cycles = fields[7]
-        cycle_values = fields[12].strip()  # individual cycle times (space-separated)
-        return received, cached_count, avg_cycles, min_cycles, max_cycles, cycle_values
-    else:
-        return "?" * MESSAGE_LENGTH, "0", "0", "0", "0", ""
-
-def run_experiment():
+def hot_cold_margin(cycle_values, threshold):
+    """How far the samples closest to the threshold are from it, in decades
+    (5th percentile of |log10(cycles / threshold)|), no ground truth needed"""
+    if threshold <= 0:
+        return 0.0
+    distances = sorted(abs(math.log10(int(c) / threshold))
+                       for c in cycle_values.split() if int(c) > 0)
+    if not distances:
+        return 0.0
+    return distances[len(distances) // 20]
+
+class PacingController:
+    """Closed-loop pacing of one scenario (--adaptive)
+
+    The knobs are the sender's pause after every primed page, the
+    receiver's pause between probes, the settle time between SEND and RECV
+    and the stride; smaller is faster (denser for the stride). After every
+    transmission update() gets the bit error rate and the hot/cold margin:
+    a transmission within target_ber with margin to spare accepts the last
+    change and tries the next knob at a faster setting, one above target
+    restores the knob and keeps the failed setting as its bound. Each knob
+    so bisects between its fastest good and slowest bad setting. Errors at
+    accepted settings mean conditions changed: every knob backs off to twice
+    its value, at most its start value, and the bounds are forgotten.
+    """
+
+    KNOBS = ['sender_gap_us', 'receiver_gap_us', 'settle_ms', 'stride']
+
+    def __init__(self, stride, target_ber=TARGET_BER, min_margin=MIN_MARGIN):
+        self.target_ber = target_ber
+        self.min_margin = min_margin
+        self.start = {'sender_gap_us': SENDER_GAP_US, 'receiver_gap_us': RECEIVER_GAP_US,
+                      'settle_ms': SETTLE_MS, 'stride': stride}
+        self.floor = {'sender_gap_us': 0, 'receiver_gap_us': 0, 'settle_ms': 0,
+                      'stride': min(MIN_STRIDE, stride)}
+        self.value = dict(self.start)
+        self.bad = {knob: None for knob in self.KNOBS}
+        self.trial = None  # (knob, previous value) of the change under test
+        self.next_knob = 0
+
+    def settings(self):
+        return dict(self.value)
+
+    def _faster(self, knob):
+        """Next setting to try for knob, None once it has converged"""
+        value, bad = self.value[knob], self.bad[knob]
+        lowest = self.floor[knob] if bad is None else bad + 1
+        if value <= lowest:
+            return None
+        return max(lowest, (value + lowest) // 2) if bad is not None else max(lowest, value // 2)
+
+    def converged(self):
+        return self.trial is None and all(self._faster(k) is None for k in self.KNOBS)
+
+    def update(self, ber, margin):
+        """Feed back one transmission, returns what changed for the log"""
+        if ber > self.target_ber:
+            if self.trial:
+                knob, previous = self.trial
+                self.bad[knob] = self.value[knob]
+                self.value[knob] = previous
+                self.trial = None
+                return f"{knob} back to {previous}"
+            for knob in self.KNOBS:
+                self.value[knob] = min(self.start[knob], max(2 * self.value[knob], 1))
+                self.bad[knob] = None
+            return "backing off"
+        self.trial = None
+        if margin < self.min_margin:
+            return "holding, margin low"
+        for i in range(len(self.KNOBS)):
+            knob = self.KNOBS[(self.next_knob + i) % len(self.KNOBS)]
+            faster = self._faster(knob)
+            if faster is not None:
+                self.next_knob = (self.next_knob + i + 1) % len(self.KNOBS)
+                self.trial = (knob, self.value[knob])
+                self.value[knob] = faster
+                return f"trying {knob} {faster}"
+        return "converged"
+
+def scenario_name(evict, runtime, stride):
+    return f"R{evict}-{runtime}-S{stride}"
+
+def matrix_scenarios():
+    """The CACHE_EVICT_INTERVALS x RUNTIMES x STRIDE_SIZES matrix"""
+    return [
+        {'name': scenario_name(evict, runtime, stride), 'evict': evict,
+         'runtime': runtime, 'stride': stride, 'global_reset': False}
+        for evict in CACHE_EVICT_INTERVALS
+        for runtime in RUNTIMES
+        for stride in STRIDE_SIZES
+    ]
+
+def load_spec(path):
+    """Read '[name=<tag>] evict=<R> runtime=<C> stride=<S> [reset=global]' lines"""
+    scenarios = []
+    with open(path) as spec:
+        for lineno, line in enumerate(spec, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            fields = dict(token.split('=', 1) for token in line.split() if '=' in token)
+            try:
+                evict, runtime, stride = int(fields['evict']), fields['runtime'], int(fields['stride'])
+            except (KeyError, ValueError):
+                sys.exit(f"{path}:{lineno}: need evict=<R> runtime=<C> stride=<S>")
+            scenarios.append({
+                'name': fields.get('name', scenario_name(evict, runtime, stride)),
+                'evict': evict,
+                'runtime': runtime,
+                'stride': stride,
+                'global_reset': fields.get('reset', 'targeted') == 'global',
+            })
+    names = [s['name'] for s in scenarios]
+    duplicates = sorted({n for n in names if names.count(n) > 1})
+    if duplicates:
+        sys.exit(f"{path}: duplicate scenario names {duplicates}, set name=")
+    return scenarios
+
+def needs_global_reset(scenario):
+    return (scenario['global_reset'] or not TARGETED_CACHE_RESET or
+            scenario['runtime'] in GLOBAL_RESET_RUNTIMES)
+
+class ResetLock:
+    """Shared for scenarios with targeted resets, exclusive for global ones"""
+
+    def __init__(self):
+        self.cond = threading.Condition()
+        self.readers = 0
+        self.writer = False
+
+    def acquire(self, exclusive):
+        with self.cond:
+            if exclusive:
+                self.cond.wait_for(lambda: not self.writer and self.readers == 0)
+                self.writer = True
+            else:
+                self.cond.wait_for(lambda: not self.writer)
+                self.readers += 1
+
+    def release(self, exclusive):
+        with self.cond:
+            if exclusive:
+                self.writer = False
+            else:
+                self.readers -= 1
+            self.cond.notify_all()
+
+class ResultWriter:
+    """Appends tagged rows to the output CSV, durable row by row"""
+
+    def __init__(self, path, resume, rows_per_scenario):
+        self.lock = threading.Lock()
+        self.complete = set()
+        if resume and os.path.exists(path):
+            self.complete = self._keep_complete(path, rows_per_scenario)
+        else:
+            with open(path, 'w', newline='') as csvfile:
+                csv.writer(csvfile).writerow(CSV_HEADER)
+        self.file = open(path, 'a', newline='')
+        self.writer = csv.writer(self.file)
+
+    @staticmethod
+    def _keep_complete(path, rows_per_scenario):
+        """Drop rows of scenarios cut short (and a torn last line), return the complete ones"""
+        with open(path, newline='') as csvfile:
+            rows = [row for row in csv.reader(csvfile) if len(row) == len(CSV_HEADER)]
+        rows = [row for row in rows if row != CSV_HEADER]
+        counts = {}
+        for row in rows:
+            counts[row[0]] = counts.get(row[0], 0) + 1
+        complete = {name for name, count in counts.items() if count >= rows_per_scenario}
+        tmp = path + ".tmp"
+        with open(tmp, 'w', newline='') as csvfile:
+            writer = csv.writer(csvfile)
+            writer.writerow(CSV_HEADER)
+            writer.writerows(row for row in rows if row[0] in complete)
+        os.replace(tmp, path)
+        return complete
+
+    def write(self, row):
+        with self.lock:
+            self.writer.writerow(row)
+            self.file.flush()
+            os.fsync(self.file.fileno())
+
+    def close(self):
+        self.file.close()
+
+def run_scenario(scenario, slot, patterns, results, experiment_start, progress, args):
+    """All patterns and repetitions of one scenario in its slot"""
+    name, stride, evict = scenario['name'], scenario['stride'], scenario['evict']
+    global_reset = scenario['global_reset']
+    pacing = PacingController(stride, args.target_ber) if args.adaptive else None
+    settings = {'sender_gap_us': SENDER_GAP_US, 'receiver_gap_us': RECEIVER_GAP_US,
+                'settle_ms': SETTLE_MS, 'stride': stride}
+
+    log(f"[{name}] slot {slot.index}: R={evict} C={scenario['runtime']} S={stride} "
+        f"carrier={slot.carrier}{' (global reset, alone)' if global_reset else ''}")
+    if message_bits(stride) < MESSAGE_LENGTH:
+        log(f"[{name}] {FEC_CODE} at stride {stride} fits {message_bits(stride)} of "
+            f"{MESSAGE_LENGTH} bits into {CARRIER_PAGES // stride} pages, sending those")
+
+    try:
+        # Setup containers with specified runtime
+        slot.setup_containers(scenario['runtime'])
+
+        # Clear cache at the beginning, before anything is written
+        slot.clear_page_cache(global_reset)
+
+        for pattern_idx, full_pattern in enumerate(patterns, 1):
+            for rep in range(1, NUM_REPETITIONS + 1):
+                iteration_start = time.time()
+
+                # Clear page cache based on eviction interval
+                if evict > 0 and rep % evict == 1 and rep > 1:
+                    try:
+                        slot.clear_page_cache(global_reset)
+                    except GlobalResetNeeded:
+                        # Rows are out already, finish without evicting
+                        log(f"[{name}] cache_reset could not verify the eviction, not evicting")
+
+                if pacing:
+                    settings = pacing.settings()
+                pattern = full_pattern[:message_bits(settings['stride'])]
+
+                # Send pattern (prime cache) and get timing
+                send_cycles, send_ns = slot.send_pattern(pattern, settings['stride'],
+                                                         settings['sender_gap_us'])
+
+                # Let the sender's pages settle
+                time.sleep(settings['settle_ms'] / 1000)
+
+                # Receive pattern (detect cached pages)
+                received, cached_count, avg_cycles, min_cycles, max_cycles, cycle_values, threshold = \
+                    slot.receive_pattern(len(pattern), settings['stride'], settings['receiver_gap_us'])
+
+                # Calculate bit errors
+                bit_errors = calculate_bit_errors(pattern, received)
+                margin = hot_cold_margin(cycle_values, threshold)
+
+                duration_ms = (time.time() - iteration_start) * 1000
+
+                # Status output
+                status = "✓" if bit_errors == 0 else f"✗ ({bit_errors} errors)"
+                latency_info = f"[{min_cycles}-{max_cycles} cycles]" if min_cycles and max_cycles else ""
+                send_ms = float(send_ns) / 1_000_000  # Convert ns to ms
+                log(f"[{name}] pattern {pattern_idx} rep {rep}/{NUM_REPETITIONS}: {status} "
+                    f"{duration_ms:.2f}ms (send:{send_ms:.2f}ms) {latency_info} [{progress()}]")
+                if pacing:
+                    change = pacing.update(bit_errors / len(pattern), margin)
+                    log(f"[{name}]   pacing: gaps {settings['sender_gap_us']}/"
+                        f"{settings['receiver_gap_us']}us settle {settings['settle_ms']}ms "
+                        f"stride {settings['stride']} margin {margin:.2f} -> {change}")
+
+                results.write([
+                    name,
+                    slot.index,
+                    slot.carrier,
+                    experiment_start,
+                    evict,
+                    scenario['runtime'],
+                    stride,
+                    pattern,
+                    rep,
+                    received,
+                    bit_errors,
+                    f"{duration_ms:.2f}",
+                    send_cycles,
+                    send_ns,
+                    cached_count,
+                    avg_cycles,
+                    min_cycles,
+                    max_cycles,
+                    cycle_values,
+                    settings['sender_gap_us'],
+                    settings['receiver_gap_us'],
+                    settings['settle_ms'],
+                    f"{margin:.3f}",
+                    settings['stride']
+                ])
+
+                # Small delay between iterations
+                time.sleep(0.05)
+
+        if pacing:
+            settled = pacing.settings()
+            log(f"[{name}] pacing {'converged' if pacing.converged() else 'still searching'}: "
+                f"sender gap {settled['sender_gap_us']}us, receiver gap {settled['receiver_gap_us']}us, "
+                f"settle {settled['settle_ms']}ms, stride {settled['stride']}")
+    finally:
+        # Cleanup containers after each scenario
+        slot.cleanup_containers()
+
+def make_slots(jobs):
+    """One slot per carrier file, two pinned cores each while there are enough"""
+    cpus = sorted(os.sched_getaffinity(0))
+    slots = []
+    for i in range(min(jobs, len(CARRIER_FILES))):
+        pair = [cpus[2 * i], cpus[2 * i + 1]] if len(cpus) >= 2 * (i + 1) else None
+        if pair is None and i > 0:
+            break
+        slots.append(Slot(i, CARRIER_FILES[i], pair))
+    return slots
+
+def run_experiment(args):
     """Run the main experiment"""
     experiment_start = time.time()
-    
+
     # Generate random patterns
     patterns = generate_random_patterns(NUM_RANDOM_PATTERNS, MESSAGE_LENGTH)
-    
+    scenarios = load_spec(args.spec) if args.spec else matrix_scenarios()
+    for scenario in scenarios:
+        scenario['global_reset'] = needs_global_reset(scenario)
+    empty = sorted({s['stride'] for s in scenarios if message_bits(s['stride']) == 0})
+    if empty:
+        sys.exit(f"FEC {FEC_CODE}: no message fits {CARRIER_PAGES} pages at stride {empty}")
+    rows_per_scenario = len(patterns) * NUM_REPETITIONS
+
+    results = ResultWriter(args.output, args.resume, rows_per_scenario)
+    pending = [s for s in scenarios if s['name'] not in results.complete]
+    slots = make_slots(args.jobs)
+
     print("Starting strided page covert channel experiment...")
     print("Configuration:")
-    print(f"  Target file: {TARGET_FILE}")
     print(f"  Message length: {MESSAGE_LENGTH} bits")
     print(f"  Repetitions per scenario: {NUM_REPETITIONS}")
     print(f"  Random patterns: {NUM_RANDOM_PATTERNS}")
     print(f"  Random seed: {RANDOM_SEED if RANDOM_SEED is not None else 'None (truly random)'}")
-    print(f"  Output file: {OUTPUT_FILE}")
-    print()
-    print("Evaluation Matrix:")
-    print(f"  R (Cache evict intervals): {CACHE_EVICT_INTERVALS}")
-    print(f"  C (Runtimes): {RUNTIMES}")
-    print(f"  S (Stride sizes): {STRIDE_SIZES}")
-    print()
-    
-    # Display the random patterns
-    print("Generated random patterns:")
-    for i, pattern in enumerate(patterns, 1):
-        print(f"  Pattern {i}: {pattern}")
+    print(f"  Transport: {'agents' if USE_AGENTS else 'docker exec'}")
+    print(f"  FEC: {FEC_CODE}")
+    print(f"  Pacing: " + (f"adaptive, target BER {args.target_ber}" if args.adaptive else
+                           f"fixed, gaps {SENDER_GAP_US}/{RECEIVER_GAP_US}us settle {SETTLE_MS}ms"))
+    print(f"  Output file: {args.output}{' (resumed)' if args.resume else ''}")
+    print(f"  Scenarios: {len(pending)} to run, {len(scenarios) - len(pending)} complete"
+          f"{' from ' + args.spec if args.spec else ''}")
+    print(f"  Slots: " + ", ".join(f"{s.index}: {s.carrier} cpus {s.cpus}" for s in slots))
     print()
-    
-    # Calculate total scenarios
-    total_scenarios = len(CACHE_EVICT_INTERVALS) * len(RUNTIMES) * len(STRIDE_SIZES)
-    total_transmissions = total_scenarios * len(patterns) * NUM_REPETITIONS
-    scenario_count = 0
-    transmission_count = 0
-    
-    # Initialize CSV file
-    with open(OUTPUT_FILE, 'w', newline='') as csvfile:
-        writer = csv.writer(csvfile)
-        writer.writerow([
-            'experiment_start_time',
-            'cache_evict_interval',
-            'runtime',
-            'stride_size',
-            'pattern',
-            'repetition',
-            'received_pattern',
-            'bit_errors',
-            'duration_ms',
-            'send_cycles',
-            'send_ns',
-            'cached_count',
-            'avg_cycles',
-            'min_cycles',
-            'max_cycles',
-            'cycle_values'
-        ])
-    
-    # Run experiments across all dimensions
-    for cache_evict_interval in CACHE_EVICT_INTERVALS:
-        for runtime in RUNTIMES:
-            for stride in STRIDE_SIZES:
-                scenario_count += 1
-                
-                print("\n" + "=" * 70)
-                print(f"Scenario {scenario_count}/{total_scenarios}:")
-                print(f"  R={cache_evict_interval} (evict every {cache_evict_interval if cache_evict_interval > 0 else 'start only'})")
-                print(f"  C={runtime}")
-                print(f"  S={stride}")
-                print("=" * 70)
-                
-                # Setup containers with specified runtime
-                setup_containers(runtime)
-                
-                # Clear cache at the beginning
-                clear_page_cache()
-                
-                for pattern in patterns:
-                    print(f"\nPattern: {pattern[:50]}{'...' if len(pattern) > 50 else ''}")
-                    
-                    for rep in range(1, NUM_REPETITIONS + 1):
-                        iteration_start = time.time()
-                        transmission_count += 1
-                        
-                        print(f"  Rep {rep:3d}/{NUM_REPETITIONS}: ", end='', flush=True)
-                        
-                        # Clear page cache based on eviction interval
-                        if cache_evict_interval > 0 and rep % cache_evict_interval == 1 and rep > 1:
-                            clear_page_cache()
-                        
-                        # Send pattern (prime cache) and get timing
-                        send_cycles, send_ns = send_pattern(pattern, stride)
-                        
-                        # Small delay
-                        time.sleep(0.05)
-                        
-                        # Receive pattern (detect cached pages)
-                        received, cached_count, avg_cycles, min_cycles, max_cycles, cycle_values = receive_pattern(stride)
-                        
-                        # Calculate bit errors
-                        bit_errors = calculate_bit_errors(pattern, received)
-                        
-                        iteration_end = time.time()
-                        duration_ms = (iteration_end - iteration_start) * 1000
-                        
-                        # Status output
-                        if bit_errors == 0:
-                            status = "✓"
-                        else:
-                            status = f"✗ ({bit_errors} errors)"
-                        
-                        # Show latency range and send time in output
-                        latency_info = f"[{min_cycles}-{max_cycles} cycles]" if min_cycles and max_cycles else ""
-                        send_ms = float(send_ns) / 1_000_000  # Convert ns to ms
-                        send_info = f"send:{send_ms:.2f}ms"
-                        print(f"{status} {duration_ms:.2f}ms ({send_info}) {latency_info} [{transmission_count}/{total_transmissions}]")
-                        
-                        # Log to CSV
-                        with open(OUTPUT_FILE, 'a', newline='') as csvfile:
-                            writer = csv.writer(csvfile)
-                            writer.writerow([
-                                experiment_start,
-                                cache_evict_interval,
-                                runtime,
-                                stride,
-                                pattern,
-                                rep,
-                                received,
-                                bit_errors,
-                                f"{duration_ms:.2f}",
-                                send_cycles,
-                                send_ns,
-                                cached_count,
-                                avg_cycles,
-                                min_cycles,
-                                max_cycles,
-                                cycle_values
-                            ])
-                        
-                        # Small delay between iterations
-                        time.sleep(0.05)
-                
-                # Cleanup containers after each scenario
-                cleanup_containers()
-                print(f"\nScenario {scenario_count}/{total_scenarios} complete.")
-    
-    experiment_end = time.time()
-    total_duration = experiment_end - experiment_start
-    
+
+    # Targeted-reset scenarios first, so the exclusive ones do not stall them
+    work = queue.Queue()
+    for scenario in sorted(pending, key=lambda s: s['global_reset']):
+        work.put(scenario)
+    reset_lock = ResetLock()
+    counters = {'done': 0, 'transmissions': 0}
+    counter_lock = threading.Lock()
+    total_transmissions = len(pending) * rows_per_scenario
+    failed = []
+
+    def progress():
+        with counter_lock:
+            counters['transmissions'] += 1
+            return f"{counters['transmissions']}/{total_transmissions}"
+
+    def worker(slot):
+        while True:
+            try:
+                scenario = work.get_nowait()
+            except queue.Empty:
+                return
+            exclusive = scenario['global_reset']
+            reset_lock.acquire(exclusive)
+            try:
+                run_scenario(scenario, slot, patterns, results, experiment_start, progress, args)
+                with counter_lock:
+                    counters['done'] += 1
+                log(f"[{scenario['name']}] complete ({counters['done']}/{len(pending)})")
+            except GlobalResetNeeded:
+                log(f"[{scenario['name']}] cache_reset could not verify, requeued to run alone")
+                scenario['global_reset'] = True
+                work.put(scenario)
+            except Exception as e:
+                log(f"[{scenario['name']}] failed: {e}")
+                failed.append(scenario['name'])
+            finally:
+                reset_lock.release(exclusive)
+
+    threads = [threading.Thread(target=worker, args=(slot,), daemon=True) for slot in slots]
+    for t in threads:
+        t.start()
+    try:
+        for t in threads:
+            while t.is_alive():
+                t.join(0.5)
+    finally:
+        results.close()
+        if any(t.is_alive() for t in threads):
+            for slot in slots:
+                slot.cleanup_containers()
+
+    total_duration = time.time() - experiment_start
+
     print()
     print("=" * 70)
     print("Experiment complete!")
-    print(f"Total scenarios: {total_scenarios}")
+    print(f"Scenarios run: {counters['done']}/{len(pending)}")
+    if failed:
+        print(f"Failed (rerun with --resume): {', '.join(failed)}")
     print(f"Total duration: {total_duration:.2f}s")
-    print(f"Total transmissions: {total_transmissions}")
-    print(f"Results saved to: {OUTPUT_FILE}")
+    print(f"Results saved to: {args.output}")
     print("=" * 70)
-    
+
     print()
     print("Analysis:")
-    print(f"  Run './plot_stride_channel.py {OUTPUT_FILE}' to analyze results")
+    print(f"  Run './plot_stride_channel.py {args.output}' to analyze results")
+    return 1 if failed else 0
+
+def parse_args():
+    p = argparse.ArgumentParser(description="Strided page covert channel experiment")
+    p.add_argument("--spec", help="scenario spec file (default: the built-in matrix)")
+    p.add_argument("-j", "--jobs", type=lambda v: max(1, int(v)), default=len(CARRIER_FILES),
+                   help="scenarios run concurrently, at most one per carrier (default: %(default)s)")
+    p.add_argument("-o", "--output", default=OUTPUT_FILE, help="tagged result CSV")
+    p.add_argument("--resume", action="store_true",
+                   help="keep complete scenarios of --output and run the rest")
+    p.add_argument("--adaptive", action="store_true",
+                   help="pace sender, receiver and stride to hold --target-ber (see PacingController)")
+    p.add_argument("--target-ber", type=float, default=TARGET_BER,
+                   help="bit error rate the adaptive pacing holds (default: %(default)s)")
+    return p.parse_args()
 
 if __name__ == "__main__":
     try:
-        run_experiment()
+        sys.exit(run_experiment(parse_args()))
     except KeyboardInterrupt:
-        print("\n\nExperiment interrupted by user")
-        cleanup_containers()
-        sys.exit(1)
-    except Exception as e:
-        print(f"\n\nError: {e}")
-        import traceback
-        traceback.print_exc()
-        cleanup_containers()
+        print("\n\nExperiment interrupted by user, rerun with --resume")
         sys.exit(1)
@@ -2,6 +2,8 @@
 COMMAND="./reproduce_QEMU.sh 0"
 TARGET_FILES=("../rand0.bin" "../rand1.bin")
 VM_PATH="/home/fwilke/edu/BU/ec721"
+CACHE_RESET=${CACHE_RESET:-./cache_reset}
+. "$(dirname "$0")/../lib_evict.sh"
 MEASURE_PAGE_COUNT=1
 TARGET_PAGE=0
 
@@ -29,10 +31,7 @@ sleep 20  # wait for VMs to boot up
 
 for secret in {0..3}; do  
     for i in {1..100}; do
-        echo -e "\nEvicting page cache on the host..."
-        sync
-        echo 1 | sudo tee -a /proc/sys/vm/drop_caches
-        echo "========> Entire OS Page Cache is now evicted."
+        evict_vm_images
 
 
 
@@ -47,9 +46,9 @@ for secret in {0..3}; do
                 echo -e "\n---> [VM1]: ./read_page $TARGET_FILE $TARGET_PAGE"
 
                 ssh -p 2222 root@localhost << EOF
-                echo 1 | tee -a /proc/sys/vm/drop_caches
-
                 cd ~/unionbuster
+                ./cache_reset $TARGET_FILE > /dev/null || echo 1 | tee -a /proc/sys/vm/drop_caches
+
                 LD_BIND_NOW=1 ./read_page $TARGET_FILE $TARGET_PAGE
 EOF
 
@@ -63,9 +62,9 @@ EOF
         echo -e "\n---> [VM2]: ./spy_on ${TARGET_FILES[1]} $MEASURE_PAGE_COUNT"
 
         ssh -p 2223 root@localhost << EOF
-        echo 1 | tee -a /proc/sys/vm/drop_caches
-
         cd ~/unionbuster
+        ./cache_reset ${TARGET_FILES[@]} > /dev/null || echo 1 | tee -a /proc/sys/vm/drop_caches
+
         LD_BIND_NOW=1 ./spy_on ${TARGET_FILES[0]} $MEASURE_PAGE_COUNT
         LD_BIND_NOW=1 ./spy_on ${TARGET_FILES[1]} $MEASURE_PAGE_COUNT
 EOF
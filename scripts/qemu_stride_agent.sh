@@ -0,0 +1,70 @@
+#!/bin/bash
+# Strided channel between two QEMU guests through long-running agents.
+#
+# The agents are started once per VM over ssh, afterwards every transmission
+# is a single request line on a forwarded TCP port instead of an ssh
+# session per sample. Inside the guests the agents can listen on vsock:<port>
+# instead when the VMs get a vhost-vsock-pci device.
+#
+# Usage: ./scripts/qemu_stride_agent.sh [repetitions] [stride] [num_bits] [start_vms]
+
+TARGET_FILE="../rand0.bin"
+MANIFEST="../carriers.manifest"  # written by rebuildVMs.sh
+VM_PATH="/home/fwilke/edu/BU/ec721"
+SENDER_PORT=7001
+RECEIVER_PORT=7002
+CYCLE_THRESHOLD=0  # receiver_stride's own default
+
+REPETITIONS=${1:-100}
+STRIDE=${2:-32}
+NUM_BITS=${3:-1024}
+
+set -e
+
+. "$(dirname "$0")/../lib_bench.sh"
+
+if [ ! -z "$4" ]; then
+    echo -e "\nStarting two VMs (vmA and vmB)..."
+
+    sudo qemu-system-x86_64 \
+    -enable-kvm \
+    -m 2048 \
+    -drive file=$VM_PATH/vmA.qcow2,if=virtio \
+    -boot c \
+    -nic user,hostfwd=tcp:127.0.0.1:2222-:22,hostfwd=tcp:127.0.0.1:$SENDER_PORT-:$SENDER_PORT&
+
+    sudo qemu-system-x86_64 \
+    -enable-kvm \
+    -m 2048 \
+    -drive file=$VM_PATH/vmB.qcow2,if=virtio \
+    -boot c \
+    -nic user,hostfwd=tcp:127.0.0.1:2223-:22,hostfwd=tcp:127.0.0.1:$RECEIVER_PORT-:$RECEIVER_PORT&
+
+    sleep 20  # wait for VMs to boot up
+fi
+
+echo -e "\nStarting agents..."
+ssh -p 2222 root@localhost "cd ~/unionbuster && LD_BIND_NOW=1 nohup ./sender_stride -M $MANIFEST -a tcp:0.0.0.0:$SENDER_PORT $TARGET_FILE > /dev/null 2>&1 &"
+ssh -p 2223 root@localhost "cd ~/unionbuster && LD_BIND_NOW=1 nohup ./receiver_stride -M $MANIFEST -a tcp:0.0.0.0:$RECEIVER_PORT $TARGET_FILE > /dev/null 2>&1 &"
+sleep 1
+
+exec 3<>/dev/tcp/127.0.0.1/$SENDER_PORT
+exec 4<>/dev/tcp/127.0.0.1/$RECEIVER_PORT
+
+for i in $(seq 1 $REPETITIONS); do
+    PATTERN=$(random_pattern $NUM_BITS)
+
+    echo "SEND $PATTERN $STRIDE" >&3
+    read -r sent <&3
+    echo "RECV $NUM_BITS $CYCLE_THRESHOLD $STRIDE" >&4
+    read -r received <&4
+
+    echo "$i,$sent"
+    echo "$i,$received"
+done
+
+echo "SHUTDOWN" >&3
+echo "SHUTDOWN" >&4
+exec 3>&- 4>&-
+
+echo "Done."
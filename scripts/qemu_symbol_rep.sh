@@ -0,0 +1,80 @@
+#!/bin/bash
+# Symbol-codec version of qemu_2f_100_rep.sh: any number of carrier files,
+# one codebook slot per (file, page), every symbol sent REPETITIONS times.
+#
+# Usage: ./qemu_symbol_rep.sh [repetitions] [weight]
+#
+# Without a weight every slot carries one bit; with weight w every symbol
+# primes exactly w slots (see codebook.h). The codebook is written here and
+# copied into both VMs.
+TARGET_FILES=("../rand0.bin" "../rand1.bin")
+TARGET_PAGES="0,64"
+VM_PATH="/home/fwilke/edu/BU/ec721"
+CACHE_RESET=${CACHE_RESET:-./cache_reset}
+. "$(dirname "$0")/../lib_evict.sh"
+REPETITIONS=${1:-100}
+WEIGHT=$2
+CODEBOOK=symbols.cb
+
+
+echo -e "\nStarting two VMs (vmA and vmB)..."
+
+sudo qemu-system-x86_64 \
+-enable-kvm \
+-m 2048 \
+-drive file=$VM_PATH/vmA.qcow2,if=virtio \
+-boot c \
+-nic user,hostfwd=tcp:127.0.0.1:2222-:22&
+
+sudo qemu-system-x86_64 \
+-enable-kvm \
+-m 2048 \
+-drive file=$VM_PATH/vmB.qcow2,if=virtio \
+-boot c \
+-nic user,hostfwd=tcp:127.0.0.1:2223-:22&
+
+
+sleep 20  # wait for VMs to boot up
+
+
+{
+    for file in "${TARGET_FILES[@]}"; do
+        echo "slot $file $TARGET_PAGES"
+    done
+    if [ -n "$WEIGHT" ]; then
+        echo "weight $WEIGHT"
+    fi
+} > $CODEBOOK
+
+for port in 2222 2223; do
+    scp -P $port $CODEBOOK root@localhost:unionbuster/$CODEBOOK
+done
+
+# The sender reports the symbol width of the codebook
+SYMBOL_BITS=$(ssh -p 2222 root@localhost "cd ~/unionbuster && ./read_page -S $CODEBOOK 0" | cut -d, -f2)
+echo "Codebook: ${#TARGET_FILES[@]} files, pages $TARGET_PAGES, $SYMBOL_BITS bits per symbol"
+
+
+for ((secret = 0; secret < (1 << SYMBOL_BITS); secret++)); do
+    for i in $(seq 1 $REPETITIONS); do
+        evict_vm_images
+
+        echo -e "\n---> [VM1]: ./read_page -S $CODEBOOK $secret"
+
+        ssh -p 2222 root@localhost << EOF
+        cd ~/unionbuster
+        ./cache_reset ${TARGET_FILES[@]} > /dev/null || echo 1 | tee -a /proc/sys/vm/drop_caches
+
+        LD_BIND_NOW=1 ./read_page -S $CODEBOOK $secret
+EOF
+
+        echo -e "\n---> [VM2]: ./spy_on -S $CODEBOOK"
+
+        ssh -p 2223 root@localhost << EOF
+        cd ~/unionbuster
+        ./cache_reset ${TARGET_FILES[@]} > /dev/null || echo 1 | tee -a /proc/sys/vm/drop_caches
+
+        LD_BIND_NOW=1 ./spy_on -c spy.calib -S $CODEBOOK
+EOF
+    done
+done
@@ -18,6 +18,8 @@ ssh -p 2222 root@localhost << EOF
     git pull
     make clean
     make
+    # Same seed every rebuild, both clones inherit the carriers
+    ./mkcarrier -s 1 -m ../carriers.manifest 32768 ../rand0.bin ../rand1.bin
 EOF
 
 
@@ -2,10 +2,33 @@
  * Sender for strided page cache covert channel
  * Loads every Nth page of a file into the page cache to encode information
  * 
- * Usage: ./sender_stride <file> <bit_pattern> [stride]
+ * Usage: ./sender_stride [-v] [-d] [-e code] [-M manifest] [-g gap_us] <file> <bit_pattern> [stride]
+ *        ./sender_stride [-v] [-d] [-e code] [-M manifest] [-g gap_us] -a <endpoint> <file>
+ *        ./sender_stride [-v] [-d] [-e code] [-M manifest] -s <interval_us> <file> [stride] < payload
  *   bit_pattern: string of 0s and 1s indicating which pages to prime
  *                e.g., "10110" means prime pages 0, N*2, N*3 (indices 0, 2, 3)
  *   stride: page stride size (default: 32)
+ *   -d: dense mode for small strides: readahead off (POSIX_FADV_RANDOM) and
+ *       the pages of '0' bits evicted again after priming, in case the
+ *       runtime ignores the advice (-s always turns readahead off, -d adds
+ *       the eviction of every frame's '0' pages)
+ *   -e: encode with an error correcting code (none, hamming, conv; see
+ *       fec.h) before priming; num_bits in the CSV then counts carrier bits
+ *   -M: take the file geometry from a carrier manifest (see carrier.h)
+ *   -g: pause after every primed page in microseconds (default: 1000,
+ *       0: none), the knob the pacing controller of run_stride_channel.py
+ *       turns per SEND request
+ *   --low-jitter <cpu>[:<rt_prio>]: pin to cpu, optionally SCHED_FIFO, with
+ *       memory locked and prefaulted (see lowjitter.h)
+ *
+ * Agent mode (-a) keeps the file open and serves
+ * "SEND <bit_pattern> [stride] [gap_us]" requests on a control socket (see
+ * agent.h), replying with the CSV record. The file was opened once at
+ * start, so open_cycles and open_ns of the reply are always 0.
+ *
+ * Streaming mode (-s) reads a payload from stdin, cuts it into frames (see
+ * frame.h) and sends one frame per interval until end of input, then prints
+ * a summary record.
  */
 
 #define _GNU_SOURCE
@@ -23,110 +46,57 @@
 #include <stdint.h>
 #include <sys/types.h>
 
-#define DEFAULT_PAGE_STRIDE 32
-#define USE_RDTSC
-
-static inline uint64_t rdtsc(void) {
-    unsigned hi, lo;
-    asm volatile("lfence" ::: "memory");
-    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
-    return ((uint64_t)hi << 32) | lo;
-}
-
-static inline uint64_t realtime_ns(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
-}
-
-#ifdef USE_RDTSC
-#define CLOCK_FUNC() realtime_ns()
-#else
-#define CLOCK_FUNC() rdtsc()
-#endif
+#include "agent.h"
+#include "carrier.h"
+#include "frame.h"
+#include "fec.h"
+#include "lowjitter.h"
+#include "timing.h"
 
-#define COUNTER_FUNC() rdtsc()
+#define DEFAULT_PAGE_STRIDE 32
+#define DEFAULT_PAGE_GAP_US 1000
 
-int main(int argc, char *argv[]) {
+struct sender_agent {
     int f_map;
-    struct stat f_map_stat;
+    const char *filename;
+    size_t file_pgs;
+    enum fec_code code;
+    bool dense;
+    unsigned gap_us;
+    bool verbose;
+};
+
+// Prime pages according to bit_pattern and print the CSV record to out.
+// open_* and total_begin_* cover opening the file in one-shot mode.
+static void send_pattern(int f_map, const char *filename, size_t file_pgs,
+                         const char *bit_pattern, size_t page_stride, enum fec_code code,
+                         bool dense, unsigned gap_us, bool verbose, uint64_t open_cycles, uint64_t open_ns,
+                         uint64_t total_begin_cycles, uint64_t total_begin_ns, FILE *out)
+{
     size_t pg_size = sysconf(_SC_PAGESIZE);
     char buff[pg_size];
-    bool verbose = false;
-    int arg_idx = 1;
-    size_t page_stride = DEFAULT_PAGE_STRIDE;
+    size_t data_bits = strlen(bit_pattern);
+    size_t num_bits = fec_encoded_bits(code, data_bits);
+    size_t max_stride_pages = file_pgs / page_stride;
+    unsigned char *data = malloc(data_bits + 1);
+    unsigned char *coded = malloc(num_bits + 1);
     
-    // Check for -v flag
-    if (argc >= 2 && strcmp(argv[1], "-v") == 0) {
-        verbose = true;
-        arg_idx = 2;
-    }
-
-    if (argc < arg_idx + 2) {
-        fprintf(stderr, "Usage: %s [-v] <file> <bit_pattern> [stride]\n", argv[0]);
-        fprintf(stderr, "  bit_pattern: string of 0s and 1s (e.g., \"10110\")\n");
-        fprintf(stderr, "  stride: page stride size (default: %d)\n", DEFAULT_PAGE_STRIDE);
-        fprintf(stderr, "  Each bit controls stride*index page\n");
+    if (!data || !coded) {
+        perror("malloc");
         exit(1);
     }
-    
-    const char *filename = argv[arg_idx];
-    const char *bit_pattern = argv[arg_idx + 1];
-    size_t num_bits = strlen(bit_pattern);
-    
-    // Parse stride if provided
-    if (argc > arg_idx + 2) {
-        size_t requested_stride = strtoul(argv[arg_idx + 2], NULL, 10);
-        if (requested_stride > 0) {
-            page_stride = requested_stride;
-        }
-    }
-    
-    // Validate bit pattern
-    for (size_t i = 0; i < num_bits; i++) {
-        if (bit_pattern[i] != '0' && bit_pattern[i] != '1') {
-            fprintf(stderr, "Error: bit_pattern must contain only 0s and 1s\n");
-            exit(1);
-        }
-    }
-    
-    // Warm up timers
-    CLOCK_FUNC();
-    COUNTER_FUNC();
-    
-    uint64_t total_begin_ns = CLOCK_FUNC();
-    uint64_t total_begin_cycles = COUNTER_FUNC();
-    
-    // Open file
-    uint64_t open_begin_cycles = COUNTER_FUNC();
-    uint64_t open_begin_ns = CLOCK_FUNC();
-    f_map = open(filename, O_RDONLY);
-    uint64_t open_end_cycles = COUNTER_FUNC();
-    uint64_t open_end_ns = CLOCK_FUNC();
-    
-    if (f_map == -1) {
-        fprintf(stderr, "Failed to open file %s: %s\n", filename, strerror(errno));
-        exit(errno);
-    }
-    
-    // Get file size
-    if (fstat(f_map, &f_map_stat) == -1) {
-        perror("fstat");
-        close(f_map);
-        exit(errno);
-    }
-    
-    size_t file_pgs = (f_map_stat.st_size + (pg_size - 1)) / pg_size;
-    size_t max_stride_pages = file_pgs / page_stride;
+    for (size_t i = 0; i < data_bits; i++)
+        data[i] = bit_pattern[i] == '1';
+    fec_encode(code, data, data_bits, coded);
     
     if (verbose) {
         fprintf(stderr, "File: %s\n", filename);
-        fprintf(stderr, "File size: %ld bytes\n", f_map_stat.st_size);
         fprintf(stderr, "Page size: %zu bytes\n", pg_size);
         fprintf(stderr, "Total pages: %zu\n", file_pgs);
         fprintf(stderr, "Page stride: %zu\n", page_stride);
         fprintf(stderr, "Max strided pages: %zu\n", max_stride_pages);
-        fprintf(stderr, "Bit pattern: %s (%zu bits)\n", bit_pattern, num_bits);
+        fprintf(stderr, "Bit pattern: %s (%zu bits)\n", bit_pattern, data_bits);
+        fprintf(stderr, "Code: %s (%zu carrier bits)\n", fec_names[code], num_bits);
     }
     
     if (num_bits > max_stride_pages) {
@@ -140,9 +110,12 @@ int main(int argc, char *argv[]) {
     uint64_t total_read_cycles = 0;
     uint64_t total_read_ns = 0;
     
+    if (dense)
+        posix_fadvise(f_map, 0, 0, POSIX_FADV_RANDOM);
+    
     // Prime pages according to bit pattern
     for (size_t bit_idx = 0; bit_idx < num_bits; bit_idx++) {
-        if (bit_pattern[bit_idx] == '1') {
+        if (coded[bit_idx]) {
             size_t page_num = bit_idx * page_stride;
             off_t offset = (off_t)page_num * (off_t)pg_size;
             
@@ -154,21 +127,25 @@ int main(int argc, char *argv[]) {
             }
             
             // Read page to prime cache
-            uint64_t read_begin_cycles = COUNTER_FUNC();
-            uint64_t read_begin_ns = CLOCK_FUNC();
+            uint64_t read_begin_cycles = timing_start();
+            uint64_t read_begin_ns = timing_monotonic_ns();
             
             ssize_t bytes_read = read(f_map, buff, pg_size);
             
-            uint64_t read_end_cycles = COUNTER_FUNC();
-            uint64_t read_end_ns = CLOCK_FUNC();
+            uint64_t read_end_cycles = timing_stop();
+            uint64_t read_end_ns = timing_monotonic_ns();
             
             if (bytes_read < 0) {
                 fprintf(stderr, "Warning: Read error at page %zu: %s\n", 
                         page_num, strerror(errno));
                 continue;
             }
+            if (bytes_read == 0) {
+                carrier_short_read(page_num);
+                continue;
+            }
             
-            uint64_t read_cycles = read_end_cycles - read_begin_cycles;
+            uint64_t read_cycles = timing_elapsed(read_begin_cycles, read_end_cycles);
             uint64_t read_ns = read_end_ns - read_begin_ns;
             
             total_read_cycles += read_cycles;
@@ -180,38 +157,334 @@ int main(int argc, char *argv[]) {
                         bit_idx, page_num, offset, read_cycles, read_ns);
             }
             
-            // Small delay to ensure page is settled in cache
-            usleep(1000);
+            // Let the page settle in the cache
+            if (gap_us > 0)
+                usleep(gap_us);
         }
     }
     
-    uint64_t total_end_ns = CLOCK_FUNC();
-    uint64_t total_end_cycles = COUNTER_FUNC();
-    
-    // Print CSV header if verbose
-    if (verbose) {
-        printf("page_size,filename,bit_pattern,num_bits,pages_primed,stride,open_cycles,open_ns,");
-        printf("avg_read_cycles,avg_read_ns,total_cycles,total_ns\n");
+    // Undo readahead that reached neighbouring '0' pages anyway
+    if (dense) {
+        for (size_t bit_idx = 0; bit_idx < num_bits; bit_idx++) {
+            if (!coded[bit_idx])
+                posix_fadvise(f_map, (off_t)(bit_idx * page_stride) * (off_t)pg_size, pg_size,
+                              POSIX_FADV_DONTNEED);
+        }
     }
     
+    uint64_t total_end_ns = timing_monotonic_ns();
+    uint64_t total_end_cycles = timing_stop();
+    
     // Print CSV data
     uint64_t avg_read_cycles = pages_primed > 0 ? total_read_cycles / pages_primed : 0;
     uint64_t avg_read_ns = pages_primed > 0 ? total_read_ns / pages_primed : 0;
     
-    printf("%zu,%s,%s,%zu,%zu,%zu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+    fprintf(out, "%zu,%s,%s,%zu,%zu,%zu,%lu,%lu,%lu,%lu,%lu,%lu\n",
            pg_size,
            filename,
            bit_pattern,
            num_bits,
            pages_primed,
            page_stride,
-           (open_end_cycles - open_begin_cycles),
-           (open_end_ns - open_begin_ns),
+           open_cycles,
+           open_ns,
            avg_read_cycles,
            avg_read_ns,
-           (total_end_cycles - total_begin_cycles),
+           timing_elapsed(total_begin_cycles, total_end_cycles),
            (total_end_ns - total_begin_ns));
     
+    free(data);
+    free(coded);
+}
+
+static void sender_agent_handle(char *line, FILE *out, void *ctx)
+{
+    struct sender_agent *agent = ctx;
+    char *cmd = strtok(line, " ");
+    char *bit_pattern = strtok(NULL, " ");
+    char *stride_arg = strtok(NULL, " ");
+    char *gap_arg = strtok(NULL, " ");
+    size_t page_stride = DEFAULT_PAGE_STRIDE;
+    unsigned gap_us = agent->gap_us;
+
+    if (!cmd || strcmp(cmd, "SEND") != 0 || !bit_pattern) {
+        fprintf(out, "ERR usage: SEND <bit_pattern> [stride] [gap_us]\n");
+        return;
+    }
+    if (strspn(bit_pattern, "01") != strlen(bit_pattern)) {
+        fprintf(out, "ERR bit_pattern must contain only 0s and 1s\n");
+        return;
+    }
+    if (stride_arg && strtoul(stride_arg, NULL, 10) > 0)
+        page_stride = strtoul(stride_arg, NULL, 10);
+    if (gap_arg)
+        gap_us = strtoul(gap_arg, NULL, 10);
+
+    uint64_t total_begin_ns = timing_monotonic_ns();
+    uint64_t total_begin_cycles = timing_start();
+    send_pattern(agent->f_map, agent->filename, agent->file_pgs, bit_pattern, page_stride,
+                 agent->code, agent->dense, gap_us, agent->verbose, 0, 0, total_begin_cycles,
+                 total_begin_ns, out);
+}
+
+static int run_agent(const char *endpoint, const char *filename, const char *manifest,
+                     enum fec_code code, bool dense, unsigned gap_us, bool verbose)
+{
+    struct sender_agent agent = {
+        .filename = filename,
+        .code = code,
+        .dense = dense,
+        .gap_us = gap_us,
+        .verbose = verbose,
+    };
+
+    timing_init();
+    agent.f_map = open(filename, O_RDONLY);
+    if (agent.f_map == -1 ||
+        (agent.file_pgs = carrier_pages(agent.f_map, manifest, filename)) == (size_t)-1) {
+        fprintf(stderr, "Failed to open file %s: %s\n", filename, strerror(errno));
+        exit(errno);
+    }
+
+    int listen_fd = agent_listen(endpoint);
+    if (listen_fd == -1)
+        exit(1);
+    if (verbose)
+        fprintf(stderr, "Sender agent for %s listening on %s\n", filename, endpoint);
+
+    int ret = agent_serve(listen_fd, sender_agent_handle, &agent);
+    close(listen_fd);
+    close(agent.f_map);
+    return ret == 0 ? 0 : 1;
+}
+
+// Send stdin as a stream of frames, one per interval_ns slot.
+static int run_stream(const char *filename, const char *manifest, size_t page_stride,
+                      uint64_t interval_ns, enum fec_code code, bool dense, bool verbose)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    char buff[pg_size];
+    unsigned char bits[FRAME_SLOT_BITS];
+    size_t slot_bits = fec_encoded_bits(code, FRAME_SLOT_BITS);
+    unsigned char *coded = malloc(slot_bits);
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+    uint8_t seq = 0;
+    size_t frames = 0, payload_bytes = 0;
+    ssize_t len;
+
+    timing_init();
+    int f_map = open(filename, O_RDONLY);
+    size_t file_pgs = f_map == -1 ? (size_t)-1 : carrier_pages(f_map, manifest, filename);
+    if (file_pgs == (size_t)-1) {
+        fprintf(stderr, "Failed to open file %s: %s\n", filename, strerror(errno));
+        exit(errno);
+    }
+
+    size_t num_regions = file_pgs / page_stride / slot_bits;
+    if (!coded) {
+        perror("malloc");
+        exit(1);
+    }
+    // The receiver reads a region while the next one is being written
+    if (num_regions < 2) {
+        fprintf(stderr, "Error: %s too small for two frames (%zu strided pages each at stride %zu)\n",
+                filename, slot_bits, page_stride);
+        close(f_map);
+        exit(1);
+    }
+    if (verbose)
+        fprintf(stderr, "Streaming to %s: %zu regions, %lu us per frame\n",
+                filename, num_regions, interval_ns / 1000);
+
+    // Readahead would prime the neighbours of every '1' page
+    posix_fadvise(f_map, 0, 0, POSIX_FADV_RANDOM);
+
+    uint64_t begin_ns = timing_realtime_ns();
+    while ((len = read(STDIN_FILENO, payload, sizeof(payload))) > 0) {
+        frame_encode(bits, seq, payload, (uint8_t)len);
+        fec_encode(code, bits, FRAME_SLOT_BITS, coded);
+        uint64_t slot = timing_realtime_ns() / interval_ns + 1;
+        size_t region = slot % num_regions;
+
+        frame_sleep_until(slot * interval_ns);
+
+        // Reset the region, then prime the '1' bits back to back
+        for (size_t i = 0; i < slot_bits; i++)
+            posix_fadvise(f_map, (off_t)frame_page(region, slot_bits, i, page_stride) * pg_size,
+                          pg_size, POSIX_FADV_DONTNEED);
+        for (size_t i = 0; i < slot_bits; i++) {
+            size_t page = frame_page(region, slot_bits, i, page_stride);
+            ssize_t ret = coded[i] ? pread(f_map, buff, pg_size, (off_t)page * pg_size) : 1;
+
+            if (ret < 0)
+                fprintf(stderr, "Warning: Read error in region %zu bit %zu: %s\n",
+                        region, i, strerror(errno));
+            else if (ret == 0)
+                carrier_short_read(page);
+        }
+        // Dense: undo readahead that reached the '0' pages anyway
+        for (size_t i = 0; dense && i < slot_bits; i++) {
+            if (!coded[i])
+                posix_fadvise(f_map, (off_t)frame_page(region, slot_bits, i, page_stride) * pg_size,
+                              pg_size, POSIX_FADV_DONTNEED);
+        }
+
+        if (verbose)
+            fprintf(stderr, "Frame %u: %zd bytes in slot %lu (region %zu)\n",
+                    seq, len, slot, region);
+        seq++;
+        frames++;
+        payload_bytes += len;
+    }
+    if (len < 0)
+        perror("read");
+
+    // Stay until the last frame's slot is over so the receiver can read it
+    uint64_t end_ns = (timing_realtime_ns() / interval_ns + 1) * interval_ns;
+    frame_sleep_until(end_ns);
+
+    double seconds = (double)(end_ns - begin_ns) / 1e9;
+    if (verbose)
+        printf("filename,stride,interval_ns,frames,payload_bytes,total_ns,payload_bps\n");
+    printf("%s,%zu,%lu,%zu,%zu,%lu,%.1f\n", filename, page_stride, interval_ns, frames,
+           payload_bytes, end_ns - begin_ns, seconds > 0 ? payload_bytes * 8 / seconds : 0.0);
+
+    free(coded);
+    close(f_map);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int f_map;
+    bool verbose = false;
+    int arg_idx = 1;
+    size_t page_stride = DEFAULT_PAGE_STRIDE;
+    enum fec_code code = FEC_NONE;
+    bool dense = false;
+    unsigned gap_us = DEFAULT_PAGE_GAP_US;
+    const char *manifest = NULL;
+    const char *agent_endpoint = NULL;
+    uint64_t interval_us = 0;
+    struct low_jitter low_jitter = { .cpu = -1 };
+    
+    // Check for -v, -d, -e, -M, -g, -a, -s and --low-jitter flags
+    while (arg_idx < argc) {
+        if (strcmp(argv[arg_idx], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg_idx], "-d") == 0) {
+            dense = true;
+        } else if (strcmp(argv[arg_idx], "-e") == 0 && arg_idx + 1 < argc) {
+            if (fec_parse(argv[++arg_idx], &code) == -1) {
+                fprintf(stderr, "Error: unknown code %s (none, hamming, conv)\n", argv[arg_idx]);
+                exit(1);
+            }
+        } else if (strcmp(argv[arg_idx], "-M") == 0 && arg_idx + 1 < argc) {
+            manifest = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-g") == 0 && arg_idx + 1 < argc) {
+            gap_us = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-a") == 0 && arg_idx + 1 < argc) {
+            agent_endpoint = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-s") == 0 && arg_idx + 1 < argc) {
+            interval_us = strtoull(argv[++arg_idx], NULL, 10);
+            if (interval_us == 0) {
+                fprintf(stderr, "Error: interval must be a positive number of microseconds\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[arg_idx], "--low-jitter") == 0 && arg_idx + 1 < argc) {
+            if (low_jitter_parse(argv[++arg_idx], &low_jitter) == -1)
+                exit(EINVAL);
+        } else {
+            break;
+        }
+        arg_idx++;
+    }
+    if (low_jitter.cpu >= 0)
+        low_jitter_enter(&low_jitter, argv, verbose);
+
+    if (agent_endpoint && !interval_us && argc == arg_idx + 1)
+        return run_agent(agent_endpoint, argv[arg_idx], manifest, code, dense, gap_us, verbose);
+
+    if (interval_us && !agent_endpoint && (argc == arg_idx + 1 || argc == arg_idx + 2)) {
+        if (argc > arg_idx + 1 && strtoul(argv[arg_idx + 1], NULL, 10) > 0)
+            page_stride = strtoul(argv[arg_idx + 1], NULL, 10);
+        return run_stream(argv[arg_idx], manifest, page_stride, interval_us * 1000, code, dense,
+                          verbose);
+    }
+
+    if (agent_endpoint || interval_us || argc < arg_idx + 2) {
+        fprintf(stderr, "Usage: %s [-v] [-d] [-e code] [-M manifest] [-g gap_us] <file> <bit_pattern> [stride]\n", argv[0]);
+        fprintf(stderr, "       %s [-v] [-d] [-e code] [-M manifest] [-g gap_us] -a <endpoint> <file>\n", argv[0]);
+        fprintf(stderr, "       %s [-v] [-d] [-e code] [-M manifest] -s <interval_us> <file> [stride] < payload\n", argv[0]);
+        fprintf(stderr, "  bit_pattern: string of 0s and 1s (e.g., \"10110\")\n");
+        fprintf(stderr, "  stride: page stride size (default: %d)\n", DEFAULT_PAGE_STRIDE);
+        fprintf(stderr, "  Each bit controls stride*index page\n");
+        fprintf(stderr, "  endpoint: unix:<path>, tcp:[addr:]<port> or vsock:<port>\n");
+        fprintf(stderr, "  -d: suppress readahead for strides below %d\n", DEFAULT_PAGE_STRIDE);
+        fprintf(stderr, "  code: error correcting code none, hamming or conv (default: none)\n");
+        fprintf(stderr, "  -M: file geometry from a carrier manifest (see mkcarrier)\n");
+        fprintf(stderr, "  -g: pause after every primed page in microseconds (default: %d)\n",
+                DEFAULT_PAGE_GAP_US);
+        fprintf(stderr, "  --low-jitter cpu[:rt_prio]: pin, SCHED_FIFO, lock and prefault memory\n");
+        exit(1);
+    }
+    
+    const char *filename = argv[arg_idx];
+    const char *bit_pattern = argv[arg_idx + 1];
+    size_t num_bits = strlen(bit_pattern);
+    
+    // Parse stride if provided
+    if (argc > arg_idx + 2) {
+        size_t requested_stride = strtoul(argv[arg_idx + 2], NULL, 10);
+        if (requested_stride > 0) {
+            page_stride = requested_stride;
+        }
+    }
+    
+    // Validate bit pattern
+    for (size_t i = 0; i < num_bits; i++) {
+        if (bit_pattern[i] != '0' && bit_pattern[i] != '1') {
+            fprintf(stderr, "Error: bit_pattern must contain only 0s and 1s\n");
+            exit(1);
+        }
+    }
+    
+    // Calibrate and warm up timers
+    timing_init();
+    
+    uint64_t total_begin_ns = timing_monotonic_ns();
+    uint64_t total_begin_cycles = timing_start();
+    
+    // Open file
+    uint64_t open_begin_cycles = timing_start();
+    uint64_t open_begin_ns = timing_monotonic_ns();
+    f_map = open(filename, O_RDONLY);
+    uint64_t open_end_cycles = timing_stop();
+    uint64_t open_end_ns = timing_monotonic_ns();
+    
+    if (f_map == -1) {
+        fprintf(stderr, "Failed to open file %s: %s\n", filename, strerror(errno));
+        exit(errno);
+    }
+    
+    // Get file size, from the manifest if it lists the file
+    size_t file_pgs = carrier_pages(f_map, manifest, filename);
+    if (file_pgs == (size_t)-1) {
+        perror("fstat");
+        close(f_map);
+        exit(errno);
+    }
+    
+    // Print CSV header if verbose
+    if (verbose) {
+        fprintf(stderr, "File size: %zu pages\n", file_pgs);
+        printf("page_size,filename,bit_pattern,num_bits,pages_primed,stride,open_cycles,open_ns,");
+        printf("avg_read_cycles,avg_read_ns,total_cycles,total_ns\n");
+    }
+    
+    send_pattern(f_map, filename, file_pgs, bit_pattern, page_stride, code, dense, gap_us, verbose,
+                 timing_elapsed(open_begin_cycles, open_end_cycles), open_end_ns - open_begin_ns,
+                 total_begin_cycles, total_begin_ns, stdout);
+    
     fflush(stdout);
     close(f_map);
     
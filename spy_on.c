@@ -1,11 +1,71 @@
-/* Timing-based spy on page cache pages using rdtsc.
+/* Timing-based spy on page cache pages using the TSC.
  *
  * Usage: ./spy_on <path/to/shared/file> [<consider_at_least_pages>]
+ *        ./spy_on [-v] -b <rounds> <file>[:pages] [<file>[:pages] ...]
+ *        ./spy_on [-v] -b <rounds> -f <spec_file>
+ *        ./spy_on [-v] -S <codebook> [rounds]
+ *        ./spy_on [-v] -P <rounds> <file> [pages] [stride]
+ *
+ * -p <strategy> selects how a page is probed: read, pread, open, mmap,
+ * touch or nowait (see probe.h); open by default, pread in batch and
+ * symbol mode. nowait asks the kernel whether the page is cached instead
+ * of reading it, so probing leaves cold pages cold and can be repeated.
+ * Every mode shares the same probe loop and output, whatever the strategy.
+ *
+ * Sweep mode (-P) compares the strategies on pages of known state and
+ * prints one row each: hot/cold quantiles, their separation, the best
+ * threshold and its error rate (of the kernel's answers for nowait), and
+ * the probe cost.
+ *
+ * -c <calib_file> replaces the default threshold (DEFAULT_THRESHOLD_NS) by a
+ * calibrated threshold (see calib.h), calibrating on pages of the (first)
+ * file that are not probed when calib_file is missing or stale, -C forces
+ * the calibration. Probing every page leaves none to calibrate on: that
+ * needs a calib_file from an earlier run (or num_pages below the file's).
+ *
+ * Batch mode (-b) probes every listed file/page set <rounds> times from a
+ * single process. Descriptors are opened once and the read buffer is
+ * reused, one CSV row is streamed per round. Page sets are comma separated
+ * indices or ranges ("0,4,8-11"), all pages of the file if omitted. A spec
+ * file holds one "<file> [pages]" entry per line, '#' starts a comment.
+ *
+ * Symbol mode (-S) probes all (file, page) slots of a codebook (see
+ * codebook.h) in one shuffled pass per round, decodes the symbol and
+ * evicts the slots again so the next round sees the next symbol.
+ *
+ * -T <trace_file> appends every timed access to a binary sample trace (see
+ * trace.h), labelled hot or cold.
+ *
+ * Every classified access also feeds a hot and a cold latency histogram
+ * (see hist.h); -H <stats_file> saves their mean, stddev, quantiles and
+ * buckets at the end, -v prints the summaries.
+ *
+ * -J <jump_ns> runs the interference monitor (see monitor.h) on a spare
+ * core. Timed accesses that overlapped a gap of more than jump_ns (0: the
+ * default) in its clock are tainted: they keep their decision but stay out
+ * of the histograms, the calibration and the sweep, a tainted cold-looking
+ * slot is an erasure in symbol mode, and the trace labels them tainted.
+ *
+ * -W <pages> waits for the file cheaply instead of polling all of it: the
+ * sentinel pages (a page set as in batch mode) are asked for residency
+ * without reading them (nowait, see probe.h), with an exponential back-off
+ * from WAIT_MIN_US to WAIT_MAX_US between quiet polls, stretched further
+ * if polling would use more than -B <percent> (default 1) of a core. Once
+ * a sentinel is cached the full pass runs and the wait is reported on
+ * stderr: time waited, polls, CPU spent and the detection latency bound
+ * (the time since the last quiet poll). With at_least_pgs a pass that
+ * finds too few hot pages evicts the ones it warmed itself and waits again;
+ * while a sentinel stays cached the passes repeat within the same budget.
+ *
+ * --low-jitter <cpu>[:<rt_prio>] pins the spy to cpu, optionally under
+ * SCHED_FIFO, and locks and prefaults its memory first (see lowjitter.h).
  *
  * Similar semantics to the original program, but instead of mincore()
  * we decide page residency via access time: cached pages are faster.
  */
 
+#define _GNU_SOURCE
+
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
@@ -16,13 +76,18 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <ctype.h>
 #include <time.h>
 
-#define USE_READ_FOR_PROBING 1
-#define MMAP_PER_PAGE 0
-#define OPEN_PER_PAGE 1
-
-#define MY_MAP_FILE 0
+#include "timing.h"
+#include "cache_reset.h"
+#include "calib.h"
+#include "codebook.h"
+#include "hist.h"
+#include "lowjitter.h"
+#include "monitor.h"
+#include "probe.h"
+#include "trace.h"
 
 // Minimal portion of pages in spied file needed for the file being
 // considered accessed. This is kept for compatibility with the original.
@@ -30,136 +95,921 @@ static float at_least_pgs = .01;
 
 // This threshold must be tuned for the platform.
 // Rough idea: cached access ~100s of cycles, disk access >> 10^4 cycles.
-// Start with something like 2000 and adjust based on measurements.
-// static const uint64_t CYCLE_THRESHOLD = 25931470ULL;
-static const uint64_t CYCLE_THRESHOLD = 10ULL * 1000ULL * 1000ULL;
+// Kept in ns (4 ms, 10^7 cycles of a 2.5 GHz TSC) so it holds with the
+// clock fallback of timing.h too; cycle_threshold is it in timing ticks.
+#define DEFAULT_THRESHOLD_NS (4ULL * 1000ULL * 1000ULL)
+static uint64_t cycle_threshold;
+
+#define MAX_CALIBRATION_PAGES 256
+
+// Sentinel polling of the wait mode (-W)
+#define WAIT_MIN_US 50
+#define WAIT_MAX_US 2000
+#define WAIT_DEFAULT_BUDGET 1.0     // percent of a core
+
+// Calibrated, drift-tracked threshold; NULL while cycle_threshold applies
+static struct calib calib_state;
+static struct calib *calib = NULL;
+
+// Raw samples go here with -T
+static struct trace trace_state;
+static struct trace *trace = NULL;
+
+// Latencies of every classified access, by decision
+static struct hist hist_hot, hist_cold;
 
-static inline uint64_t rdtsc(void)
+// Interference monitor with -J, NULL without
+static struct monitor monitor_state;
+static struct monitor *monitor = NULL;
+static uint64_t tainted_samples;
+
+static inline bool page_looks_cached(uint64_t cycles)
 {
-    unsigned int lo, hi;
-    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
-    return ((uint64_t)hi << 32) | lo;
+    bool hot = calib ? calib_update(calib, cycles) : cycles < cycle_threshold;
+    hist_add(hot ? &hist_hot : &hist_cold, cycles);
+    return hot;
 }
 
-static inline uint64_t measure_page_access_cycles(int f_map, size_t pg_size, char* buff, int page_to_read, char* file_path,
-                                                    uint64_t *open_cycles, uint64_t *mmap_cycles, uint64_t *read_ns)
+// The kernel's answer where the probe has one (nowait), else the latency.
+// A tainted sample is only compared against the threshold.
+static inline bool sample_looks_cached(const struct probe_sample *sample, bool tainted)
 {
-    uint64_t start, end;
-    //rt clock structs
-    struct timespec ts_start, ts_end;
-    clock_gettime(CLOCK_REALTIME, &ts_start);
-
-#if OPEN_PER_PAGE
-    start = rdtsc();
-    f_map = open(file_path, O_RDONLY);
-    end = rdtsc();
-    if (f_map == -1) {
-        perror("open");
-        exit(errno);
+    if (sample->resident >= 0) {
+        hist_add(sample->resident ? &hist_hot : &hist_cold, sample->cycles);
+        return sample->resident;
     }
-    if (open_cycles) *open_cycles = end - start;
-#endif
+    if (tainted)
+        return sample->cycles < (calib ? calib->threshold : cycle_threshold);
+    return page_looks_cached(sample->cycles);
+}
+
+// probe_page() under the interference monitor: *tainted is set if the
+// timed access overlapped a jump. The kernel's answers are never tainted.
+static uint64_t probe_watched(struct probe *p, size_t page, struct probe_sample *sample,
+                              bool *tainted)
+{
+    uint64_t start = monitor ? timing_start() : 0;
+    uint64_t cycles = probe_page(p, page, sample);
 
+    *tainted = monitor && cycles != UINT64_MAX && sample->resident < 0 &&
+               monitor_tainted(monitor, start, timing_stop());
+    tainted_samples += *tainted;
+    return cycles;
+}
+
+// Report the histograms: summaries with -v, the full dump to stats_path.
+static void finish_stats(const char *stats_path, bool verbose)
+{
+    if (verbose) {
+        hist_print(stderr, "hot", &hist_hot);
+        hist_print(stderr, "cold", &hist_cold);
+        if (monitor)
+            fprintf(stderr, "Interference: %lu samples tainted, %lu jumps\n", tainted_samples,
+                    monitor_events(monitor));
+    }
+    if (stats_path)
+        hist_save(stats_path, &hist_hot, &hist_cold);
+}
+
+// Load the threshold from calib_path, or calibrate on the pages of fd not
+// marked in in_use and save the result there. Exits if a calibration is due
+// but every page is in use: it would wipe the pages about to be probed.
+static void setup_calibration(const char *calib_path, bool force, int fd, size_t total_pgs,
+                              const unsigned char *in_use, bool verbose)
+{
+    if (force || calib_load(&calib_state, calib_path) == -1) {
+        size_t pages[MAX_CALIBRATION_PAGES];
+        size_t num_pages = 0;
+
+        for (size_t i = 0; i < total_pgs && num_pages < MAX_CALIBRATION_PAGES; i++) {
+            if (!in_use[i])
+                pages[num_pages++] = i;
+        }
+        if (num_pages < 2) {
+            fprintf(stderr, "Error: no spare pages to calibrate %s on, probe fewer of the %zu "
+                    "pages or use a calib_file of an earlier run\n", calib_path, total_pgs);
+            exit(EINVAL);
+        } else if (calib_run(&calib_state, fd, pages, num_pages,
+                             CALIB_DEFAULT_ROUNDS, verbose) == 0) {
+            calib_save(&calib_state, calib_path);
+        }
+    }
 
-#if MMAP_PER_PAGE
-    start = rdtsc();
-    void *mapped_to = mmap(NULL, pg_size,
-                           PROT_READ, MAP_SHARED, f_map, pg_size * page_to_read);
-    end = rdtsc();
-    if (mapped_to == MAP_FAILED) {
-        perror("mmap");
+    if (calib_state.valid) {
+        calib = &calib_state;
+        if (verbose)
+            fprintf(stderr, "Calibrated threshold: %lu (hot 2^%.2f, cold 2^%.2f ticks)\n",
+                    calib->threshold, calib->hot_center, calib->cold_center);
+    } else {
+        fprintf(stderr, "Warning: no calibration, using threshold %lu\n", cycle_threshold);
+    }
+}
+
+
+// One carrier file in batch mode, opened once for all rounds.
+struct probe_target {
+    char *path;
+    struct probe probe;
+    size_t file_pgs;
+    size_t *pages;
+    size_t num_pages;
+    unsigned char *resident;
+};
+
+// A single (file, page) probe; the whole set is shuffled every round.
+struct probe_slot {
+    size_t target;
+    size_t page_idx;
+};
+
+// Parse "0,4,8-11" into target->pages. An empty or NULL set selects every
+// page of the file.
+static int parse_page_set(struct probe_target *t, const char *set)
+{
+    if (!set || !*set) {
+        t->pages = malloc(t->file_pgs * sizeof(size_t));
+        if (!t->pages)
+            return -1;
+        for (size_t i = 0; i < t->file_pgs; i++)
+            t->pages[i] = i;
+        t->num_pages = t->file_pgs;
+        return 0;
+    }
+
+    size_t cap = 16;
+    t->pages = malloc(cap * sizeof(size_t));
+    t->num_pages = 0;
+    if (!t->pages)
+        return -1;
+
+    const char *p = set;
+    while (*p) {
+        char *end;
+        size_t lo = strtoul(p, &end, 10), hi = lo;
+        if (end == p)
+            return -1;
+        p = end;
+        if (*p == '-') {
+            hi = strtoul(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo)
+                return -1;
+            p = end;
+        }
+        if (hi >= t->file_pgs) {
+            fprintf(stderr, "Page %zu out of range for %s (%zu pages)\n",
+                    hi, t->path, t->file_pgs);
+            return -1;
+        }
+        for (size_t pg = lo; pg <= hi; pg++) {
+            if (t->num_pages == cap) {
+                cap *= 2;
+                size_t *grown = realloc(t->pages, cap * sizeof(size_t));
+                if (!grown)
+                    return -1;
+                t->pages = grown;
+            }
+            t->pages[t->num_pages++] = pg;
+        }
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return -1;
+    }
+
+    return t->num_pages ? 0 : -1;
+}
+
+static int open_probe_target(struct probe_target *t, const char *path,
+                             const char *set, enum probe_strategy strategy)
+{
+    memset(t, 0, sizeof(*t));
+    t->path = strdup(path);
+    if (probe_open(&t->probe, t->path, strategy) == -1)
+        return -1;
+    if (t->probe.file_size == 0) {
+        fprintf(stderr, "Cannot probe empty file %s\n", path);
+        return -1;
+    }
+    t->file_pgs = (t->probe.file_size + (t->probe.pg_size - 1)) / t->probe.pg_size;
+
+    if (parse_page_set(t, set) == -1) {
+        fprintf(stderr, "Invalid page set '%s' for %s\n", set, path);
+        return -1;
+    }
+    t->resident = calloc(t->num_pages, 1);
+    return t->resident ? 0 : -1;
+}
+
+// Read "<file> [pages]" lines from a spec file into targets.
+static size_t load_spec_file(const char *spec_path, struct probe_target **targets,
+                             enum probe_strategy strategy)
+{
+    FILE *spec = fopen(spec_path, "r");
+    if (!spec) {
+        fprintf(stderr, "Failed to open spec file %s: %s\n", spec_path, strerror(errno));
         exit(errno);
     }
-    if (mmap_cycles) *mmap_cycles = end - start;
-#endif
 
-    lseek(f_map, pg_size * page_to_read, SEEK_SET);
+    char line[4096];
+    size_t n = 0, cap = 4;
+    *targets = malloc(cap * sizeof(**targets));
 
-    start = rdtsc();
-    read(f_map, buff, pg_size);
-    end = rdtsc();
+    while (fgets(line, sizeof(line), spec)) {
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
 
-    
-    #if MMAP_PER_PAGE
-    munmap(mapped_to, pg_size);
-    #endif
-    
-    #if OPEN_PER_PAGE
-    close(f_map);
-    #endif
-    
-    clock_gettime(CLOCK_REALTIME, &ts_end);
+        char *path = strtok(line, " \t\r\n");
+        if (!path)
+            continue;
+        char *set = strtok(NULL, " \t\r\n");
 
-    if (read_ns) {
-        *read_ns = (ts_end.tv_sec - ts_start.tv_sec) * 1000000000 +
-                   (ts_end.tv_nsec - ts_start.tv_nsec);
+        if (n == cap) {
+            cap *= 2;
+            *targets = realloc(*targets, cap * sizeof(**targets));
+        }
+        if (!*targets || open_probe_target(&(*targets)[n], path, set, strategy) == -1)
+            exit(1);
+        n++;
     }
-    
-    return end - start;
+
+    fclose(spec);
+    return n;
 }
 
-static inline uint64_t measure_random_page_word_access_cycles(char *page_addr)
+static int run_batch(int argc, char *argv[], int arg_idx, bool verbose,
+                     const char *calib_path, bool force_calibration,
+                     enum probe_strategy strategy)
 {
+    struct probe_target *targets = NULL;
+    size_t num_targets = 0;
 
-    uint64_t start = rdtsc();
-    volatile int tmp = *(int *)page_addr;
-    (void)tmp; // Prevent optimization
-    uint64_t end = rdtsc();
+    if (argc < arg_idx + 3) {
+        fprintf(stderr, "Usage: %s [-v] -b <rounds> <file>[:pages] [<file>[:pages] ...]\n"
+                        "       %s [-v] -b <rounds> -f <spec_file>\n", argv[0], argv[0]);
+        exit(EBADF);
+    }
 
-    return end - start;
+    size_t rounds = strtoul(argv[arg_idx + 1], NULL, 10);
+    if (rounds == 0) {
+        fprintf(stderr, "Error: rounds must be > 0\n");
+        return 1;
+    }
+
+    if (strcmp(argv[arg_idx + 2], "-f") == 0) {
+        if (argc < arg_idx + 4) {
+            fprintf(stderr, "Error: -f needs a spec file\n");
+            return 1;
+        }
+        num_targets = load_spec_file(argv[arg_idx + 3], &targets, strategy);
+    } else {
+        num_targets = argc - (arg_idx + 2);
+        targets = malloc(num_targets * sizeof(*targets));
+        if (!targets) {
+            perror("malloc targets");
+            exit(1);
+        }
+        for (size_t t = 0; t < num_targets; t++) {
+            char *arg = strdup(argv[arg_idx + 2 + t]);
+            // Only split on the last ':' when a page set follows it.
+            char *colon = strrchr(arg, ':');
+            char *set = NULL;
+            if (colon && isdigit((unsigned char)colon[1])) {
+                *colon = '\0';
+                set = colon + 1;
+            }
+            if (open_probe_target(&targets[t], arg, set, strategy) == -1)
+                exit(1);
+            free(arg);
+        }
+    }
+
+    if (num_targets == 0) {
+        fprintf(stderr, "Error: no files to probe\n");
+        return 1;
+    }
+
+    size_t num_slots = 0;
+    for (size_t t = 0; t < num_targets; t++)
+        num_slots += targets[t].num_pages;
+
+    if (calib_path) {
+        unsigned char *in_use = calloc(targets[0].file_pgs, 1);
+        if (!in_use) {
+            perror("calloc");
+            exit(1);
+        }
+        for (size_t p = 0; p < targets[0].num_pages; p++)
+            in_use[targets[0].pages[p]] = 1;
+        setup_calibration(calib_path, force_calibration, targets[0].probe.fd, targets[0].file_pgs,
+                          in_use, verbose);
+        free(in_use);
+    }
+
+    uint16_t file_ids[num_targets];
+    for (size_t t = 0; t < num_targets; t++)
+        file_ids[t] = trace ? trace_file_id(trace, targets[t].path) : 0;
+
+    struct probe_slot *slots = malloc(num_slots * sizeof(*slots));
+    if (!slots) {
+        perror("malloc slots");
+        exit(1);
+    }
+    for (size_t t = 0, s = 0; t < num_targets; t++) {
+        for (size_t p = 0; p < targets[t].num_pages; p++, s++) {
+            slots[s].target = t;
+            slots[s].page_idx = p;
+        }
+    }
+
+    if (verbose) {
+        for (size_t t = 0; t < num_targets; t++)
+            fprintf(stderr, "File %zu: %s (%zu of %zu pages)\n", t, targets[t].path,
+                    targets[t].num_pages, targets[t].file_pgs);
+        fprintf(stderr, "Probe strategy: %s\n", probe_names[strategy]);
+        printf("round,round_ns,num_measurements,min_cycles,max_cycles,avg_cycles,"
+               "avg_read_ns,resident_patterns\n");
+    }
+
+    for (size_t round = 0; round < rounds; round++) {
+        uint64_t min_cycles = UINT64_MAX, max_cycles = 0;
+        uint64_t total_cycles = 0, total_read_ns = 0;
+        size_t num_measurements = 0;
+        struct timespec ts_start, ts_end;
+
+        // Fisher-Yates shuffle of the whole probe set
+        for (size_t i = num_slots - 1; i > 0; i--) {
+            size_t j = (size_t)rand() % (i + 1);
+            struct probe_slot tmp = slots[i];
+            slots[i] = slots[j];
+            slots[j] = tmp;
+        }
+
+        clock_gettime(CLOCK_REALTIME, &ts_start);
+        for (size_t s = 0; s < num_slots; s++) {
+            struct probe_target *t = &targets[slots[s].target];
+            size_t page = t->pages[slots[s].page_idx];
+            struct probe_sample sample;
+            bool tainted;
+            uint64_t ts = trace ? timing_realtime_ns() : 0;
+            uint64_t cycles = probe_watched(&t->probe, page, &sample, &tainted);
+            if (cycles == UINT64_MAX) {
+                t->resident[slots[s].page_idx] = 0;
+                if (trace)
+                    trace_add(trace, ts, file_ids[slots[s].target], page, 0, 0, TRACE_LABEL_NONE);
+                continue;
+            }
+
+            total_cycles += cycles;
+            total_read_ns += sample.ns;
+            num_measurements++;
+            if (cycles < min_cycles) min_cycles = cycles;
+            if (cycles > max_cycles) max_cycles = cycles;
+            t->resident[slots[s].page_idx] = sample_looks_cached(&sample, tainted) ? 1 : 0;
+            if (trace)
+                trace_add(trace, ts, file_ids[slots[s].target], page, cycles, sample.ns,
+                          tainted ? TRACE_LABEL_TAINTED : t->resident[slots[s].page_idx]);
+        }
+        clock_gettime(CLOCK_REALTIME, &ts_end);
+
+        printf("%zu,%lu,%zu,%lu,%lu,%lu,%lu,",
+               round,
+               (uint64_t)((ts_end.tv_sec - ts_start.tv_sec) * 1000000000 +
+                          (ts_end.tv_nsec - ts_start.tv_nsec)),
+               num_measurements,
+               num_measurements > 0 ? min_cycles : 0,
+               max_cycles,
+               num_measurements > 0 ? total_cycles / num_measurements : 0,
+               num_measurements > 0 ? total_read_ns / num_measurements : 0);
+
+        // One pattern per file in argument order, space-separated
+        for (size_t t = 0; t < num_targets; t++) {
+            for (size_t p = 0; p < targets[t].num_pages; p++)
+                fputc('0' + (targets[t].resident[p] & 1), stdout);
+            if (t < num_targets - 1)
+                fputc(' ', stdout);
+        }
+        fputc('\n', stdout);
+        fflush(stdout);
+    }
+
+    if (calib)
+        calib_save(calib, calib_path);
+
+    for (size_t t = 0; t < num_targets; t++) {
+        probe_close(&targets[t].probe);
+        free(targets[t].path);
+        free(targets[t].pages);
+        free(targets[t].resident);
+    }
+    free(targets);
+    free(slots);
+
+    return 0;
 }
 
+static int run_symbols(int argc, char *argv[], int arg_idx, bool verbose,
+                       const char *calib_path, bool force_calibration,
+                       enum probe_strategy strategy)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    struct codebook cb;
+    size_t rounds = 1;
+
+    if (argc < arg_idx + 2) {
+        fprintf(stderr, "Usage: %s [-v] -S <codebook> [rounds]\n", argv[0]);
+        exit(EBADF);
+    }
+    if (argc > arg_idx + 2 && strtoul(argv[arg_idx + 2], NULL, 10) > 0)
+        rounds = strtoul(argv[arg_idx + 2], NULL, 10);
+    if (codebook_load(&cb, argv[arg_idx + 1]) == -1 || codebook_open(&cb) == -1)
+        exit(1);
+
+    size_t n = cb.num_slots;
+    size_t order[CODEBOOK_MAX_SLOTS];
+    uint64_t cycles[CODEBOOK_MAX_SLOTS];
+    struct probe_sample samples[CODEBOOK_MAX_SLOTS];
+    double soft[CODEBOOK_MAX_SLOTS];
+    uint64_t stamps[CODEBOOK_MAX_SLOTS];
+    bool tainted[CODEBOOK_MAX_SLOTS];
+    uint16_t file_ids[CODEBOOK_MAX_FILES];
+    struct probe probes[CODEBOOK_MAX_FILES];
+    for (size_t i = 0; i < n; i++)
+        order[i] = i;
+    for (size_t f = 0; f < cb.num_files; f++) {
+        if (probe_open(&probes[f], cb.files[f].path, strategy) == -1)
+            exit(1);
+        file_ids[f] = trace ? trace_file_id(trace, cb.files[f].path) : 0;
+    }
+
+    if (calib_path) {
+        struct stat st;
+        int fd = cb.files[0].fd;
+        if (fstat(fd, &st) == -1) {
+            perror("fstat");
+            exit(errno);
+        }
+        size_t total_pgs = (st.st_size + (pg_size - 1)) / pg_size;
+        unsigned char *in_use = calloc(total_pgs, 1);
+        if (!in_use) {
+            perror("calloc");
+            exit(1);
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (cb.slots[i].file == 0 && cb.slots[i].page < total_pgs)
+                in_use[cb.slots[i].page] = 1;
+        }
+        setup_calibration(calib_path, force_calibration, fd, total_pgs, in_use, verbose);
+        free(in_use);
+    }
+
+    if (verbose) {
+        fprintf(stderr, "Codebook: %zu slots over %zu files, %u bits per symbol, probe %s\n",
+                n, cb.num_files, cb.symbol_bits, probe_names[strategy]);
+        printf("round,round_ns,symbol_bits,symbol,margin,slot_pattern,cycle_values\n");
+    }
+
+    for (size_t round = 0; round < rounds; round++) {
+        struct timespec ts_start, ts_end;
+
+        for (size_t i = n - 1; i > 0; i--) {
+            size_t j = (size_t)rand() % (i + 1);
+            size_t tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+
+        clock_gettime(CLOCK_REALTIME, &ts_start);
+        for (size_t k = 0; k < n; k++) {
+            struct codebook_slot *slot = &cb.slots[order[k]];
+            stamps[order[k]] = trace ? timing_realtime_ns() : 0;
+            cycles[order[k]] = probe_watched(&probes[slot->file], slot->page, &samples[order[k]],
+                                             &tainted[order[k]]);
+        }
+        clock_gettime(CLOCK_REALTIME, &ts_end);
+
+        for (size_t i = 0; i < n; i++) {
+            // Decoding uses the soft values, the hard decision is only for
+            // the drift tracking, unless the kernel answered (nowait)
+            soft[i] = calib_soft(calib, cycle_threshold, cycles[i]);
+            if (cycles[i] != UINT64_MAX) {
+                bool hot = sample_looks_cached(&samples[i], tainted[i]);
+                if (samples[i].resident >= 0)
+                    soft[i] = hot ? 1.0 : -1.0;
+                // Slow during interference proves nothing
+                else if (tainted[i] && soft[i] < 0)
+                    soft[i] = 0.0;
+            }
+            if (trace) {
+                uint8_t label = cycles[i] == UINT64_MAX ? TRACE_LABEL_NONE
+                                : tainted[i] ? TRACE_LABEL_TAINTED : soft[i] > 0;
+                trace_add(trace, stamps[i], file_ids[cb.slots[i].file], cb.slots[i].page,
+                          cycles[i] == UINT64_MAX ? 0 : cycles[i], 0, label);
+            }
+        }
+        double margin;
+        int64_t symbol = codebook_decode(&cb, soft, &margin);
+
+        // Consume the symbol: the probe itself cached every slot
+        for (size_t i = 0; i < n; i++) {
+            probe_release(&probes[cb.slots[i].file], cb.slots[i].page);
+            posix_fadvise(cb.files[cb.slots[i].file].fd, (off_t)(cb.slots[i].page * pg_size),
+                          pg_size, POSIX_FADV_DONTNEED);
+        }
+
+        printf("%zu,%lu,%u,%ld,%.3f,",
+               round,
+               (uint64_t)((ts_end.tv_sec - ts_start.tv_sec) * 1000000000 +
+                          (ts_end.tv_nsec - ts_start.tv_nsec)),
+               cb.symbol_bits,
+               symbol,
+               margin);
+        for (size_t i = 0; i < n; i++)
+            fputc(soft[i] > 0 ? '1' : '0', stdout);
+        fputc(',', stdout);
+        for (size_t i = 0; i < n; i++)
+            printf("%lu%s", cycles[i] == UINT64_MAX ? 0 : cycles[i], i < n - 1 ? " " : "\n");
+        fflush(stdout);
+    }
+
+    if (calib)
+        calib_save(calib, calib_path);
+    for (size_t f = 0; f < cb.num_files; f++)
+        probe_close(&probes[f]);
+    codebook_close(&cb);
+    return 0;
+}
+
+
+#define SWEEP_DEFAULT_PAGES 64
+#define SWEEP_DEFAULT_STRIDE 64
+
+/*
+ * Probe strategy sweep (-P): in every round a random half of the sample
+ * pages is evicted and the other half primed, then all of them are probed
+ * in shuffled order. The known state gives each strategy a hot and a cold
+ * histogram, i.e. its latency separation on this runtime, and its cost.
+ * The stride keeps readahead of one sample page off the next.
+ */
+static int run_sweep(int argc, char *argv[], int arg_idx, bool verbose)
+{
+    size_t pg_size = sysconf(_SC_PAGESIZE);
+    size_t num_pages = SWEEP_DEFAULT_PAGES;
+    size_t stride = SWEEP_DEFAULT_STRIDE;
+    struct stat st;
+
+    if (argc < arg_idx + 3) {
+        fprintf(stderr, "Usage: %s [-v] -P <rounds> <file> [pages] [stride]\n", argv[0]);
+        exit(EBADF);
+    }
+    size_t rounds = strtoul(argv[arg_idx + 1], NULL, 10);
+    const char *path = argv[arg_idx + 2];
+    if (argc > arg_idx + 3)
+        num_pages = strtoul(argv[arg_idx + 3], NULL, 10);
+    if (argc > arg_idx + 4)
+        stride = strtoul(argv[arg_idx + 4], NULL, 10);
+    if (rounds == 0 || num_pages < 2 || stride == 0) {
+        fprintf(stderr, "Error: rounds, stride must be > 0 and pages > 1\n");
+        return 1;
+    }
+
+    // Primes and evicts; no readahead, it would warm the cold half
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "Failed to open file %s: %s\n", path, strerror(errno));
+        exit(errno);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    size_t file_pgs = (st.st_size + (pg_size - 1)) / pg_size;
+    if ((num_pages - 1) * stride >= file_pgs) {
+        fprintf(stderr, "Error: %zu pages at stride %zu do not fit in %s (%zu pages)\n",
+                num_pages, stride, path, file_pgs);
+        return 1;
+    }
+
+    char buff[pg_size];
+    unsigned char hot[num_pages];
+    size_t order[num_pages];
+
+    if (verbose) {
+        fprintf(stderr, "Sweep: %zu rounds over %zu pages of %s at stride %zu\n",
+                rounds, num_pages, path, stride);
+        printf("strategy,num_measurements,hot_p50,hot_p99,cold_p1,cold_p50,separation,"
+               "threshold,error_rate,avg_setup_cycles,avg_probe_ns\n");
+    }
+
+    for (int s = 0; s < PROBE_STRATEGIES; s++) {
+        struct probe probe;
+        struct hist hot_hist, cold_hist;
+        uint64_t total_setup_cycles = 0, total_probe_ns = 0;
+        uint64_t answers = 0, wrong_answers = 0, discarded = 0;
+
+        if (probe_open(&probe, path, s) == -1)
+            exit(1);
+        if (verbose && s == PROBE_NOWAIT)
+            fprintf(stderr, "nowait via %s\n", probe_via_names[probe.via]);
+        hist_init(&hot_hist);
+        hist_init(&cold_hist);
+
+        for (size_t round = 0; round < rounds; round++) {
+            for (size_t i = 0; i < num_pages; i++) {
+                hot[i] = rand() & 1;
+                order[i] = i;
+                probe_release(&probe, i * stride);
+            }
+            // The whole span: cached neighbours make a cold probe look
+            // sequential and read ahead over the next sample pages
+            cache_reset(fd, 0, (num_pages - 1) * stride + 1, false);
+            for (size_t i = 0; i < num_pages; i++) {
+                if (hot[i])
+                    pread(fd, buff, pg_size, (off_t)(i * stride * pg_size));
+            }
+            for (size_t i = num_pages - 1; i > 0; i--) {
+                size_t j = (size_t)rand() % (i + 1);
+                size_t tmp = order[i];
+                order[i] = order[j];
+                order[j] = tmp;
+            }
+
+            for (size_t k = 0; k < num_pages; k++) {
+                struct probe_sample sample;
+                bool tainted;
+                uint64_t cycles = probe_watched(&probe, order[k] * stride, &sample, &tainted);
+                if (cycles == UINT64_MAX)
+                    continue;
+                if (tainted) {
+                    discarded++;
+                    continue;
+                }
+                hist_add(hot[order[k]] ? &hot_hist : &cold_hist, cycles);
+                if (sample.resident >= 0) {
+                    answers++;
+                    wrong_answers += sample.resident != hot[order[k]];
+                }
+                total_setup_cycles += sample.setup_cycles;
+                total_probe_ns += sample.ns;
+            }
+        }
+        probe_close(&probe);
+
+        uint64_t n = hot_hist.count + cold_hist.count, errors;
+        uint64_t threshold = hist_split(&hot_hist, &cold_hist, &errors);
+        // Where the kernel answers, its answers are the decision
+        if (answers == n)
+            errors = wrong_answers;
+        uint64_t hot_p50 = hist_quantile(&hot_hist, 0.5);
+        uint64_t cold_p50 = hist_quantile(&cold_hist, 0.5);
+
+        printf("%s,%lu,%lu,%lu,%lu,%lu,%.2f,%lu,%.4f,%lu,%lu\n",
+               probe_names[s],
+               n,
+               hot_p50,
+               hist_quantile(&hot_hist, 0.99),
+               hist_quantile(&cold_hist, 0.01),
+               cold_p50,
+               hot_p50 > 0 ? (double)cold_p50 / hot_p50 : 0.0,
+               threshold,
+               n > 0 ? (double)errors / n : 1.0,
+               n > 0 ? total_setup_cycles / n : 0,
+               n > 0 ? total_probe_ns / n : 0);
+        fflush(stdout);
+        if (verbose) {
+            fprintf(stderr, "%s ", probe_names[s]);
+            hist_print(stderr, "hot", &hot_hist);
+            fprintf(stderr, "%s ", probe_names[s]);
+            hist_print(stderr, "cold", &cold_hist);
+            if (monitor)
+                fprintf(stderr, "%s: %lu tainted samples discarded\n", probe_names[s], discarded);
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+struct wait_stats {
+    uint64_t polls;
+    uint64_t wait_ns;       // from the start of the wait to the firing poll
+    uint64_t cpu_ns;        // spent polling
+    uint64_t detect_ns;     // since the last quiet poll, bounds the latency
+};
+
+static inline uint64_t thread_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Poll the sentinels until one of them is cached. Without cachestat() the
+// query may bring a sentinel in itself (RWF_NOWAIT, timing), so it is
+// evicted again after every quiet poll.
+static void wait_for_sentinels(struct probe_target *s, double budget, struct wait_stats *ws)
+{
+    uint64_t sleep_us = WAIT_MIN_US;
+    uint64_t begin_ns = timing_monotonic_ns();
+    uint64_t quiet_ns = begin_ns;
+
+    memset(ws, 0, sizeof(*ws));
+    for (;;) {
+        uint64_t cpu_begin = thread_cpu_ns();
+        bool fired = false;
+
+        for (size_t i = 0; i < s->num_pages && !fired; i++) {
+            struct probe_sample sample;
+
+            if (probe_page(&s->probe, s->pages[i], &sample) == UINT64_MAX)
+                continue;
+            fired = sample.resident >= 0 ? sample.resident
+                    : sample.cycles < (calib ? calib->threshold : cycle_threshold);
+        }
+        if (!fired && s->probe.via != PROBE_VIA_CACHESTAT) {
+            for (size_t i = 0; i < s->num_pages; i++)
+                cache_reset(s->probe.fd, s->pages[i], 1, false);
+        }
+
+        uint64_t cost = thread_cpu_ns() - cpu_begin;
+        uint64_t now = timing_monotonic_ns();
+        ws->polls++;
+        ws->cpu_ns += cost;
+        if (fired) {
+            ws->wait_ns = now - begin_ns;
+            ws->detect_ns = now - quiet_ns;
+            return;
+        }
+        quiet_ns = now;
+
+        // Back off, but never below what keeps polling within the budget
+        uint64_t budget_us = (uint64_t)(cost / 1000.0 * (100.0 / budget - 1.0));
+        usleep(sleep_us > budget_us ? sleep_us : budget_us);
+        sleep_us = sleep_us * 2 < WAIT_MAX_US ? sleep_us * 2 : WAIT_MAX_US;
+    }
+}
 
 int main(int argc, char *argv[])
 {
-    int f_map;
-    struct stat f_map_stat;
     size_t file_pgs;
     size_t pg_size = sysconf(_SC_PAGESIZE);
-    char buff[pg_size];
     bool verbose = false;
     int arg_idx = 1;
+    const char *calib_path = NULL;
+    bool force_calibration = false;
+    const char *trace_path = NULL;
+    const char *stats_path = NULL;
+    enum probe_strategy strategy = PROBE_STRATEGIES;    // per mode default
+    bool use_monitor = false;
+    uint64_t jump_ns = 0;
+    const char *wait_set = NULL;
+    double wait_budget = WAIT_DEFAULT_BUDGET;
+    bool budget_set = false;
+    struct low_jitter low_jitter = { .cpu = -1 };
 
-    // Check for -v flag
-    if (argc >= 2 && strcmp(argv[1], "-v") == 0) {
-        verbose = true;
-        arg_idx = 2;
+    // Check for -v, -c, -C, -T, -H, -p, -J, -W, -B and --low-jitter flags
+    while (arg_idx < argc) {
+        if (strcmp(argv[arg_idx], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg_idx], "-c") == 0 && arg_idx + 1 < argc) {
+            calib_path = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-C") == 0) {
+            force_calibration = true;
+        } else if (strcmp(argv[arg_idx], "-T") == 0 && arg_idx + 1 < argc) {
+            trace_path = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-H") == 0 && arg_idx + 1 < argc) {
+            stats_path = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-p") == 0 && arg_idx + 1 < argc) {
+            if (probe_parse(argv[++arg_idx], &strategy) == -1) {
+                fprintf(stderr, "Unknown probe strategy %s (read, pread, open, mmap, touch, nowait)\n",
+                        argv[arg_idx]);
+                exit(EINVAL);
+            }
+        } else if (strcmp(argv[arg_idx], "-J") == 0 && arg_idx + 1 < argc) {
+            use_monitor = true;
+            jump_ns = strtoull(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-W") == 0 && arg_idx + 1 < argc) {
+            wait_set = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "-B") == 0 && arg_idx + 1 < argc) {
+            wait_budget = strtod(argv[++arg_idx], NULL);
+            budget_set = true;
+            if (wait_budget <= 0 || wait_budget > 100) {
+                fprintf(stderr, "Invalid CPU budget %s, expected a percentage in (0, 100]\n",
+                        argv[arg_idx]);
+                exit(EINVAL);
+            }
+        } else if (strcmp(argv[arg_idx], "--low-jitter") == 0 && arg_idx + 1 < argc) {
+            if (low_jitter_parse(argv[++arg_idx], &low_jitter) == -1)
+                exit(EINVAL);
+        } else {
+            break;
+        }
+        arg_idx++;
+    }
+    // Only the single-file pass waits for sentinels
+    if ((wait_set || budget_set) && argc >= arg_idx + 1 &&
+        (strcmp(argv[arg_idx], "-b") == 0 || strcmp(argv[arg_idx], "-S") == 0 ||
+         strcmp(argv[arg_idx], "-P") == 0)) {
+        fprintf(stderr, "Error: -W and -B do not apply to %s\n", argv[arg_idx]);
+        exit(EINVAL);
+    }
+
+    if (low_jitter.cpu >= 0)
+        low_jitter_enter(&low_jitter, argv, verbose);
+    timing_init();
+    cycle_threshold = timing_from_ns(DEFAULT_THRESHOLD_NS);
+    if (verbose)
+        fprintf(stderr, "Timing: %s, %.4f ns/tick, overhead %lu ticks\n",
+                timing.source, timing.ns_per_tick, timing.overhead);
+    if (use_monitor && monitor_start(&monitor_state, jump_ns) == 0) {
+        monitor = &monitor_state;
+        if (verbose)
+            fprintf(stderr, "Interference monitor on cpu %d, jumps over %lu ticks\n",
+                    monitor->cpu, monitor->threshold);
+    }
+
+    if (argc >= arg_idx + 1 && strcmp(argv[arg_idx], "-P") == 0) {
+        // The sweep keeps per-strategy histograms of its own and no trace
+        if (trace_path || stats_path) {
+            fprintf(stderr, "Error: -T and -H do not apply to the strategy sweep (-P)\n");
+            exit(EINVAL);
+        }
+        int ret = run_sweep(argc, argv, arg_idx, verbose);
+        if (monitor)
+            monitor_stop(monitor);
+        return ret;
+    }
+
+    if (trace_path) {
+        if (trace_open(&trace_state, trace_path) == -1)
+            exit(1);
+        trace = &trace_state;
+    }
+    hist_init(&hist_hot);
+    hist_init(&hist_cold);
+
+    if (argc >= arg_idx + 1 && strcmp(argv[arg_idx], "-b") == 0) {
+        int ret = run_batch(argc, argv, arg_idx, verbose, calib_path, force_calibration,
+                            strategy == PROBE_STRATEGIES ? PROBE_PREAD : strategy);
+        finish_stats(stats_path, verbose);
+        if (monitor)
+            monitor_stop(monitor);
+        if (trace)
+            trace_close(trace);
+        return ret;
+    }
+    if (argc >= arg_idx + 1 && strcmp(argv[arg_idx], "-S") == 0) {
+        int ret = run_symbols(argc, argv, arg_idx, verbose, calib_path, force_calibration,
+                              strategy == PROBE_STRATEGIES ? PROBE_PREAD : strategy);
+        finish_stats(stats_path, verbose);
+        if (monitor)
+            monitor_stop(monitor);
+        if (trace)
+            trace_close(trace);
+        return ret;
     }
 
     if (argc < arg_idx + 1) {
-        fprintf(stderr, "Usage: %s [-v] <file> [num_pages] [at_least_pgs]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-v] [-p strategy] [-c calib_file [-C]] [-T trace_file] [-H stats_file] [-J jump_ns] [-W pages [-B percent]] [--low-jitter cpu[:rt_prio]] <file> [num_pages] [at_least_pgs]\n", argv[0]);
+        fprintf(stderr, "       %s [-v] [-p strategy] [-c calib_file [-C]] -b <rounds> <file>[:pages] [<file>[:pages] ...]\n", argv[0]);
+        fprintf(stderr, "       %s [-v] [-p strategy] [-c calib_file [-C]] -b <rounds> -f <spec_file>\n", argv[0]);
+        fprintf(stderr, "       %s [-v] [-p strategy] [-c calib_file [-C]] -S <codebook> [rounds]\n", argv[0]);
+        fprintf(stderr, "       %s [-v] -P <rounds> <file> [pages] [stride]\n", argv[0]);
+        fprintf(stderr, "  -p: read, pread, open, mmap, touch or nowait (default: open, pread for -b/-S)\n");
+        fprintf(stderr, "  -P: compare the latency separation and cost of every strategy\n");
+        fprintf(stderr, "  -T: append every timed access to a binary sample trace\n");
+        fprintf(stderr, "  -H: save hot/cold latency statistics and histograms\n");
+        fprintf(stderr, "  --low-jitter: pin to cpu, SCHED_FIFO at rt_prio, lock and prefault memory\n");
+        fprintf(stderr, "  -J: tag accesses during timing jumps over jump_ns (0: %d) from a monitor thread\n",
+                MONITOR_DEFAULT_JUMP_NS);
+        fprintf(stderr, "  -W: wait until one of the sentinel pages is cached, polling at most -B percent\n"
+                        "      of a core (default: %.0f), then probe the file\n", WAIT_DEFAULT_BUDGET);
         exit(EBADF);
     }
-    
+    if (strategy == PROBE_STRATEGIES)
+        strategy = PROBE_OPEN;
+
     // Check if we have the at_least_pgs parameter
-    int adjusted_argc = argc - (verbose ? 1 : 0);
+    int adjusted_argc = argc - arg_idx + 1;
+    bool poll = false;
     if (adjusted_argc == 4) {
         char *end;
         float f = strtof(argv[arg_idx + 2], &end);
         if (f)
             at_least_pgs = f;
+        poll = true;
     }
 
-    f_map = open(argv[arg_idx], O_RDONLY);
-    if (f_map == -1) {
-        fprintf(stderr, "Failed to open file %s\n", argv[arg_idx]);
-        exit(errno);
-    }
-
-    if (fstat(f_map, &f_map_stat) == -1) {
-        perror("fstat");
-        close(f_map);
+    struct probe probe;
+    if (probe_open(&probe, argv[arg_idx], strategy) == -1)
         exit(errno);
-    }
 
-    if (f_map_stat.st_size == 0) {
+    if (probe.file_size == 0) {
         printf("File is empty.\n");
-        close(f_map);
+        probe_close(&probe);
         return 0;
     }
-    
-    
-    file_pgs = (f_map_stat.st_size + (pg_size - 1)) / pg_size;
+
+    size_t total_pgs = (probe.file_size + (pg_size - 1)) / pg_size;
+    file_pgs = total_pgs;
 
     if (argc > arg_idx + 1) {
         //override number of pages to consider
@@ -168,26 +1018,34 @@ int main(int argc, char *argv[])
 
     if (file_pgs == 0) {
         fprintf(stderr, "Error: file_pgs is 0\n");
-        close(f_map);
+        probe_close(&probe);
         return 1;
     }
 
-    // Map the file read-only; we just probe by reading.
-    #if MY_MAP_FILE
-    char *mapped_to = mmap(NULL, f_map_stat.st_size,
-                           PROT_READ, MAP_SHARED, f_map, 0);
-    if (mapped_to == MAP_FAILED) {
-        perror("mmap");
-        close(f_map);
-        exit(errno);
+    if (calib_path) {
+        unsigned char *in_use = calloc(total_pgs, 1);
+        if (!in_use) {
+            perror("calloc");
+            exit(1);
+        }
+        memset(in_use, 1, file_pgs < total_pgs ? file_pgs : total_pgs);
+        setup_calibration(calib_path, force_calibration, probe.fd, total_pgs, in_use, verbose);
+        free(in_use);
+    }
+
+    struct probe_target sentinels = { .path = argv[arg_idx], .file_pgs = total_pgs };
+    if (wait_set) {
+        if (parse_page_set(&sentinels, wait_set) == -1) {
+            fprintf(stderr, "Invalid sentinel pages '%s'\n", wait_set);
+            exit(EINVAL);
+        }
+        if (probe_open(&sentinels.probe, sentinels.path, PROBE_NOWAIT) == -1)
+            exit(errno);
+        if (verbose)
+            fprintf(stderr, "Waiting on %zu sentinel page(s) via %s\n", sentinels.num_pages,
+                    probe_via_names[sentinels.probe.via]);
     }
-#else
-    char* mapped_to = NULL;
-#endif
 
-#if !MMAP_PER_PAGE || OPEN_PER_PAGE
-    close(f_map);
-#endif
     // resident_pages[i] == 1 if we think page i is cached, 0 otherwise
     unsigned char resident_pages[file_pgs];
 
@@ -195,76 +1053,37 @@ int main(int argc, char *argv[])
     size_t *page_indices = malloc(file_pgs * sizeof(size_t));
     if (!page_indices) {
         perror("malloc page_indices");
-        #if MY_MAP_FILE
-        munmap(mapped_to, f_map_stat.st_size);
-        #endif
         exit(1);
     }
     for (size_t i = 0; i < file_pgs; i++)
         page_indices[i] = i;
 
-    // Randomized offset inside each page (word-granularity)
-    size_t words_per_page = pg_size / sizeof(int);
-    if (words_per_page == 0)
-        words_per_page = 1;
+    uint16_t file_id = trace ? trace_file_id(trace, argv[arg_idx]) : 0;
 
     // Timing data collection
-    uint64_t total_open_cycles = 0, total_mmap_cycles = 0, total_read_ns = 0;
+    uint64_t total_setup_cycles = 0, total_read_ns = 0;
     uint64_t min_cycles = UINT64_MAX, max_cycles = 0;
     size_t num_measurements = 0;
 
-    if (adjusted_argc == 4) {
-        // Poll until enough pages look "hot" 
-        do {
-            int touched_pgs = 0;
+    // One pass in randomized page order; when polling, repeat until enough
+    // pages look "hot". With sentinels each pass waits for one of them.
+    for (size_t pass = 0;; pass++) {
+        size_t touched_pgs = 0;
+        uint64_t pass_cpu_ns = thread_cpu_ns();
 
-            // Fisher-Yates shuffle of page_indices
-            for (size_t i = file_pgs - 1; i > 0; i--) {
-                size_t j = (size_t)rand() % (i + 1);
-                size_t tmp = page_indices[i];
-                page_indices[i] = page_indices[j];
-                page_indices[j] = tmp;
-            }
-
-            for (size_t idx = 0; idx < file_pgs; idx++) {
-                size_t i = page_indices[idx];
-                
-#if USE_READ_FOR_PROBING || MMAP_PER_PAGE
-                uint64_t open_cyc = 0, mmap_cyc = 0, read_ns_val = 0;
-                uint64_t cycles = measure_page_access_cycles(f_map, pg_size, buff, i, argv[arg_idx],
-                                                              &open_cyc, &mmap_cyc, &read_ns_val);
-                total_open_cycles += open_cyc;
-                total_mmap_cycles += mmap_cyc;
-                total_read_ns += read_ns_val;
-                num_measurements++;
-                if (cycles < min_cycles) min_cycles = cycles;
-                if (cycles > max_cycles) max_cycles = cycles;
-#else
-                size_t word_index = (size_t)rand() % words_per_page;
-                char *page_addr = mapped_to + i * pg_size + word_index * sizeof(int);
-
-                // Clamp to file size
-                if ((size_t)(page_addr - mapped_to) >= (size_t)f_map_stat.st_size)
-                    continue;
-
-                uint64_t cycles = measure_random_page_word_access_cycles(page_addr);
-#endif  
-
-                if (cycles < CYCLE_THRESHOLD) {
-                    resident_pages[i] = 1;
-                    touched_pgs++;
-                } else {
-                    resident_pages[i] = 0;
-                }
-            }
+        if (wait_set) {
+            struct wait_stats ws;
 
-            if (touched_pgs >= at_least_pgs * file_pgs)
-                break;
+            wait_for_sentinels(&sentinels, wait_budget, &ws);
+            pass_cpu_ns = thread_cpu_ns();
+            if (pass == 0 || verbose)
+                fprintf(stderr, "Wait: sentinel cached after %.3f ms, %lu polls, %.3f ms CPU (%.3f%%), "
+                        "detected within %.3f ms\n",
+                        ws.wait_ns / 1e6, ws.polls, ws.cpu_ns / 1e6,
+                        ws.wait_ns ? 100.0 * ws.cpu_ns / ws.wait_ns : 0.0, ws.detect_ns / 1e6);
+        }
 
-            usleep(5 * 1000);
-        } while (1);
-    } else {
-        // Single measurement in randomized page order and offset
+        // Fisher-Yates shuffle of page_indices
         for (size_t i = file_pgs - 1; i > 0; i--) {
             size_t j = (size_t)rand() % (i + 1);
             size_t tmp = page_indices[i];
@@ -274,77 +1093,97 @@ int main(int argc, char *argv[])
 
         for (size_t idx = 0; idx < file_pgs; idx++) {
             size_t i = page_indices[idx];
-#if USE_READ_FOR_PROBING
-            uint64_t open_cyc = 0, mmap_cyc = 0, read_ns_val = 0;
-            uint64_t cycles = measure_page_access_cycles(f_map, pg_size, buff, i, argv[arg_idx],
-                                                          &open_cyc, &mmap_cyc, &read_ns_val);
-            total_open_cycles += open_cyc;
-            total_mmap_cycles += mmap_cyc;
-            total_read_ns += read_ns_val;
-            num_measurements++;
-            if (cycles < min_cycles) min_cycles = cycles;
-            if (cycles > max_cycles) max_cycles = cycles;
-#else
-            size_t word_index = (size_t)rand() % words_per_page;
-            char *page_addr = mapped_to + i * pg_size + word_index * sizeof(int);
+            struct probe_sample sample;
+            bool tainted;
+            uint64_t ts = trace ? timing_realtime_ns() : 0;
+            uint64_t cycles = probe_watched(&probe, i, &sample, &tainted);
 
-            // Clamp to file size
-            if ((size_t)(page_addr - mapped_to) >= (size_t)f_map_stat.st_size)
+            // Past the end of the file, or the access failed
+            if (cycles == UINT64_MAX) {
+                resident_pages[i] = 0;
+                if (trace)
+                    trace_add(trace, ts, file_id, i, 0, 0, TRACE_LABEL_NONE);
                 continue;
-            
-            uint64_t cycles = measure_random_page_word_access_cycles(page_addr);
+            }
+
+            total_setup_cycles += sample.setup_cycles;
+            total_read_ns += sample.ns;
+            num_measurements++;
             if (cycles < min_cycles) min_cycles = cycles;
             if (cycles > max_cycles) max_cycles = cycles;
-            num_measurements++;
-#endif  
-            resident_pages[i] = (cycles < CYCLE_THRESHOLD) ? 1 : 0;
+
+            resident_pages[i] = sample_looks_cached(&sample, tainted) ? 1 : 0;
+            touched_pgs += resident_pages[i];
+            if (trace)
+                trace_add(trace, ts, file_id, i, cycles, sample.ns,
+                          tainted ? TRACE_LABEL_TAINTED : resident_pages[i]);
+        }
+
+        if (!poll || touched_pgs >= at_least_pgs * file_pgs)
+            break;
+
+        if (wait_set) {
+            // The pass read the cold pages in itself, evict them again
+            for (size_t i = 0; i < file_pgs; i++) {
+                if (!resident_pages[i]) {
+                    probe_release(&probe, i);
+                    cache_reset(probe.fd, i, 1, false);
+                }
+            }
+            // Sentinels that stay cached do not hold the next pass back,
+            // the budget does
+            uint64_t cost = thread_cpu_ns() - pass_cpu_ns;
+            uint64_t budget_us = (uint64_t)(cost / 1000.0 * (100.0 / wait_budget - 1.0));
+            usleep(budget_us > WAIT_MAX_US ? budget_us : WAIT_MAX_US);
+        } else {
+            usleep(5 * 1000);
         }
     }
 
     // Print CSV header if verbose
-    if (verbose) {
-        printf("filename,page_size,file_pages,num_measurements,min_cycles,max_cycles,avg_cycles");
-#if OPEN_PER_PAGE
-        printf(",avg_open_cycles");
-#endif
-#if MMAP_PER_PAGE
-        printf(",avg_mmap_cycles");
-#endif
-        printf(",avg_read_ns,resident_pattern\n");
-    }
-
-    // Print CSV data row
-    uint64_t avg_cycles = num_measurements > 0 ? (min_cycles + max_cycles) / 2 : 0;
-    printf("%s,%zu,%zu,%zu,%lu,%lu,%lu",
+    if (verbose)
+        printf("filename,page_size,file_pages,num_measurements,min_cycles,max_cycles,avg_cycles,"
+               "avg_open_cycles,avg_mmap_cycles,avg_read_ns,strategy,resident_pattern\n");
+
+    // Print CSV data row, the mean over every classified access
+    struct hist all;
+    hist_init(&all);
+    hist_merge(&all, &hist_hot);
+    hist_merge(&all, &hist_cold);
+    uint64_t avg_cycles = num_measurements > 0 ? (uint64_t)all.mean : 0;
+    uint64_t avg_setup_cycles = num_measurements > 0 ? total_setup_cycles / num_measurements : 0;
+    printf("%s,%zu,%zu,%zu,%lu,%lu,%lu,%lu,%lu,%lu,%s,",
            argv[arg_idx],
            pg_size,
            file_pgs,
            num_measurements,
-           min_cycles,
+           num_measurements > 0 ? min_cycles : 0,
            max_cycles,
-           avg_cycles);
-#if OPEN_PER_PAGE
-    printf(",%lu", num_measurements > 0 ? total_open_cycles / num_measurements : 0);
-#endif
-#if MMAP_PER_PAGE
-    printf(",%lu", num_measurements > 0 ? total_mmap_cycles / num_measurements : 0);
-#endif
-    printf(",%lu,", num_measurements > 0 ? total_read_ns / num_measurements : 0);
-    
+           avg_cycles,
+           strategy == PROBE_OPEN ? avg_setup_cycles : 0,
+           strategy == PROBE_MMAP ? avg_setup_cycles : 0,
+           num_measurements > 0 ? total_read_ns / num_measurements : 0,
+           probe_names[strategy]);
+
     for (size_t i = 0; i < file_pgs; i++)
         fputc('0' + (resident_pages[i] & 1), stdout);
     printf("\n");
     fflush(stdout);
 
-    free(page_indices);
-    #if MY_MAP_FILE
-    munmap(mapped_to, f_map_stat.st_size);
-    #endif
-
-    #if MMAP_PER_PAGE && !OPEN_PER_PAGE
-    close(f_map);
-    #endif
+    if (calib)
+        calib_save(calib, calib_path);
+    finish_stats(stats_path, verbose);
+    if (monitor)
+        monitor_stop(monitor);
+    if (trace)
+        trace_close(trace);
 
+    free(page_indices);
+    if (wait_set) {
+        probe_close(&sentinels.probe);
+        free(sentinels.pages);
+    }
+    probe_close(&probe);
 
     return 0;
 }
@@ -1,129 +1,240 @@
-/* Timing-based differential spy on page cache pages using rdtsc.
+/* Timing-based differential spy on page cache pages using the TSC.
  *
- * Usage: ./spy_on_diff <path/to/shared/file> [<consider_at_least_pages>]
+ * Usage: ./spy_on_diff [-v] [-n pairs] [-p stride] [-M manifest] [--low-jitter cpu[:rt_prio]]
+ *                      <path/to/shared/file> [<file> ...]
  *
- * minimal version of spy_on.c that compares adjacent pages to decode a bit
+ * minimal version of spy_on.c that compares the two pages of a pair to decode a bit
  * 0 if the first page loads faster than the second page -> first page is cached
  * 1 if the second page loads faster than the first page -> second page is cached
  *
+ *   -n: decode this many pairs (default: 1, pages 0 and 1), spread over the
+ *       files as laid out in pairs.h; read_page -D encodes them
+ *   -p: pages between the pages of the layout (default: 1)
+ *   -M: take the file geometry from a carrier manifest (see carrier.h)
+ *   --low-jitter <cpu>[:<rt_prio>]: pin to cpu, optionally SCHED_FIFO, with
+ *       memory locked and prefaulted (see lowjitter.h)
+ *
+ * All pages of all pairs are read in one random order. Prints one CSV
+ * record: files,pairs,stride,bit_pattern,min_margin,total_ns,margins where
+ * the margin of a pair is log10(slower / faster read), i.e. how clearly it
+ * decoded; -v prints the header and the reads of every pair to stderr.
+ *
  * based on spy_on.c of Novak Boskov <boskov@bu.edu>
  */
 
+#define _GNU_SOURCE
+
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <math.h>
 #include <time.h>
 
-#define USE_READ_FOR_PROBING 1
-#define OPEN_PER_PAGE 1
+#include "carrier.h"
+#include "timing.h"
+#include "lowjitter.h"
+#include "pairs.h"
 
-// Minimal portion of pages in spied file needed for the file being
-// considered accessed. This is kept for compatibility with the original.
-static float at_least_pgs = .01;
+// Reads go through the descriptors main opened with readahead off; 1 opens
+// a fresh descriptor for every read instead (2 opens per pair)
+#define OPEN_PER_PAGE 0
 
+// One timed read: which pair, which of its pages, and what it cost
+struct pair_probe {
+    size_t bit;
+    int side;
+    uint64_t open_cycles;
+};
 
-static inline uint64_t rdtsc(void)
-{
-    unsigned int lo, hi;
-    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
-    return ((uint64_t)hi << 32) | lo;
-}
 
-static inline uint64_t measure_page_access_cycles(int f_map, size_t pg_size, char* buff, int page_to_read, char* file_path)
+// Time the read of page_to_read. With OPEN_PER_PAGE every read gets a fresh
+// descriptor (and readahead state); the open is timed separately into
+// open_cycles, outside the measured span.
+static inline uint64_t measure_page_access_cycles(int f_map, size_t pg_size, char* buff, size_t page_to_read,
+                                                  const char* file_path, uint64_t *open_cycles)
 {
     uint64_t start, end;
 
-    start = rdtsc();
+#if OPEN_PER_PAGE
+    start = timing_start();
     f_map = open(file_path, O_RDONLY);
-    end = rdtsc();
+    end = timing_stop();
     if (f_map == -1) {
         perror("open");
         exit(errno);
     }
-    printf("Open took %lu cycles\n", end - start);
-
-    lseek(f_map, pg_size * page_to_read, SEEK_SET);
-
-    start = rdtsc();
-    read(f_map, buff, pg_size);
-    end = rdtsc();
-    
+    *open_cycles = timing_elapsed(start, end);
+    posix_fadvise(f_map, 0, 0, POSIX_FADV_RANDOM);
+#else
+    (void)file_path;
+    *open_cycles = 0;
+#endif
+
+    start = timing_start();
+    ssize_t ret = pread(f_map, buff, pg_size, (off_t)(pg_size * page_to_read));
+    end = timing_stop();
+
+#if OPEN_PER_PAGE
     close(f_map);
-    return end - start;
-
+#endif
+    if (ret == 0)
+        carrier_short_read(page_to_read);
+    return ret <= 0 ? UINT64_MAX : timing_elapsed(start, end);
 }
 
 
 int main(int argc, char *argv[])
 {
-    int f_map;
-    struct stat f_map_stat;
-    size_t file_pgs;
     size_t pg_size = sysconf(_SC_PAGESIZE);
-    char buff[pg_size];    
+    char buff[pg_size];
+    bool verbose = false;
+    int arg_idx = 1;
+    size_t num_pairs = 1;
+    size_t stride = PAIRS_DEFAULT_STRIDE;
+    const char *manifest = NULL;
+    struct low_jitter low_jitter = { .cpu = -1 };
+
+    // Check for -v, -n, -p, -M and --low-jitter flags
+    while (arg_idx < argc) {
+        if (strcmp(argv[arg_idx], "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[arg_idx], "-n") == 0 && arg_idx + 1 < argc) {
+            num_pairs = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-p") == 0 && arg_idx + 1 < argc) {
+            stride = strtoul(argv[++arg_idx], NULL, 10);
+        } else if (strcmp(argv[arg_idx], "-M") == 0 && arg_idx + 1 < argc) {
+            manifest = argv[++arg_idx];
+        } else if (strcmp(argv[arg_idx], "--low-jitter") == 0 && arg_idx + 1 < argc) {
+            if (low_jitter_parse(argv[++arg_idx], &low_jitter) == -1)
+                exit(EINVAL);
+        } else {
+            break;
+        }
+        arg_idx++;
+    }
 
-    if (argc < 2) {
-        printf("Needs 1 arg at least.\n");
+    size_t num_files = argc - arg_idx;
+    if (num_files < 1 || num_files > PAIRS_MAX_FILES || num_pairs == 0 || stride == 0) {
+        fprintf(stderr, "Usage: %s [-v] [-n pairs] [-p stride] [-M manifest] [--low-jitter cpu[:rt_prio]] <file> [<file> ...]\n", argv[0]);
+        fprintf(stderr, "  -n: number of page pairs (bits) to decode (default: 1)\n");
+        fprintf(stderr, "  -p: page stride of the pair layout (default: %d)\n", PAIRS_DEFAULT_STRIDE);
+        fprintf(stderr, "  up to %d files, bit i in file i %% files (see pairs.h)\n", PAIRS_MAX_FILES);
         exit(EBADF);
-    } 
+    }
+    char **files = &argv[arg_idx];
+
+    if (low_jitter.cpu >= 0)
+        low_jitter_enter(&low_jitter, argv, verbose);
+    timing_init();
+
+    int fds[PAIRS_MAX_FILES];
+    size_t file_pgs[PAIRS_MAX_FILES];
+    for (size_t f = 0; f < num_files; f++) {
+        fds[f] = open(files[f], O_RDONLY);
+        if (fds[f] == -1) {
+            fprintf(stderr, "Failed to open file %s: %s\n", files[f], strerror(errno));
+            exit(errno);
+        }
+        file_pgs[f] = carrier_pages(fds[f], manifest, files[f]);
+        if (file_pgs[f] == (size_t)-1) {
+            perror("fstat");
+            exit(errno);
+        }
+        posix_fadvise(fds[f], 0, 0, POSIX_FADV_RANDOM);
+    }
 
-    f_map = open(argv[1], O_RDONLY);
-    if (f_map == -1) {
-        printf("Failed to open file %s\n", argv[1]);
-        exit(errno);
+    size_t capacity = pairs_capacity(file_pgs, num_files, stride);
+    if (num_pairs > capacity) {
+        fprintf(stderr, "Error: %zu pairs at stride %zu need more pages, the files hold %zu\n",
+                num_pairs, stride, capacity);
+        exit(EINVAL);
     }
 
-    if (fstat(f_map, &f_map_stat) == -1) {
-        perror("fstat");
-        close(f_map);
-        exit(errno);
+    struct pair_probe *order = malloc(2 * num_pairs * sizeof(*order));
+    uint64_t *cycles = malloc(2 * num_pairs * sizeof(*cycles));
+    char *bits = malloc(num_pairs + 1);
+    if (!order || !cycles || !bits) {
+        perror("malloc");
+        exit(1);
     }
 
-    if (f_map_stat.st_size == 0) {
-        printf("File is empty.\n");
-        close(f_map);
-        return 0;
+    // Both pages of every pair, shuffled across the pairs as well
+    srandom((unsigned)timing_start());
+    for (size_t i = 0; i < 2 * num_pairs; i++)
+        order[i] = (struct pair_probe){ .bit = i / 2, .side = (int)(i % 2) };
+    for (size_t i = 2 * num_pairs - 1; i > 0; i--) {
+        size_t j = (size_t)random() % (i + 1);
+        struct pair_probe tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
     }
-    
-    
-    close(f_map);
 
     //time the entire process to calculate bandwidth
-    struct timespec current_time;
-    clock_gettime(CLOCK_REALTIME, &current_time);
-    time_t begin = current_time.tv_nsec;
-
-
-    // two measurement in randomized page order and offset
-    size_t first = rand() % 2;
-    size_t second = 1 - first;
-    uint64_t results[2];
-
-    results[first] = measure_page_access_cycles(f_map, pg_size, buff, first, argv[1]);
-    results[second] = measure_page_access_cycles(f_map, pg_size, buff, second, argv[1]);
-    
-    clock_gettime(CLOCK_REALTIME, &current_time);
-    time_t end = current_time.tv_nsec;
-    
-    printf("Page 0: %lu cycles\n",
-        results[0]);
-    printf("Page 1: %lu cycles\n",
-        results[1]);
-        
-    //print results
-    if (results[0] < results[1]) {
-        printf("Encoded bit is 0\n");
-    } else {
-        printf("Encoded bit is 1\n");
+    uint64_t begin_ns = timing_monotonic_ns();
+
+    for (size_t i = 0; i < 2 * num_pairs; i++) {
+        struct pair_probe *p = &order[i];
+        size_t f = pair_file(p->bit, num_files);
+
+        cycles[2 * p->bit + p->side] =
+            measure_page_access_cycles(fds[f], pg_size, buff,
+                                       pair_page(p->bit, num_files, stride, p->side),
+                                       files[f], &p->open_cycles);
+    }
+
+    uint64_t end_ns = timing_monotonic_ns();
+
+#if OPEN_PER_PAGE
+    if (verbose) {
+        for (size_t i = 0; i < 2 * num_pairs; i++)
+            fprintf(stderr, "Open took %lu cycles\n", order[i].open_cycles);
+    }
+#endif
+
+    // Decide every pair, the faster page is the cached one
+    double min_margin = INFINITY;
+    double *margins = malloc(num_pairs * sizeof(*margins));
+    if (!margins) {
+        perror("malloc");
+        exit(1);
+    }
+    for (size_t b = 0; b < num_pairs; b++) {
+        uint64_t first = cycles[2 * b], second = cycles[2 * b + 1];
+        uint64_t fast = first < second ? first : second;
+        uint64_t slow = first < second ? second : first;
+
+        bits[b] = first < second ? '0' : '1';
+        margins[b] = fast > 0 && slow != UINT64_MAX ? log10((double)slow / (double)fast) : 0.0;
+        if (margins[b] < min_margin)
+            min_margin = margins[b];
+        if (verbose) {
+            size_t f = pair_file(b, num_files);
+            fprintf(stderr, "Pair %zu (%s): page %zu %lu cycles, page %zu %lu cycles -> %c\n",
+                    b, files[f], pair_page(b, num_files, stride, 0), first,
+                    pair_page(b, num_files, stride, 1), second, bits[b]);
+        }
     }
-    
-    printf("Total time: %ld nanoseconds\n", end - begin);
-            
+    bits[num_pairs] = '\0';
+
+    if (verbose)
+        printf("files,pairs,stride,bit_pattern,min_margin,total_ns,margins\n");
+    printf("%zu,%zu,%zu,%s,%.3f,%lu,", num_files, num_pairs, stride, bits, min_margin,
+           end_ns - begin_ns);
+    for (size_t b = 0; b < num_pairs; b++)
+        printf("%.3f%s", margins[b], b + 1 < num_pairs ? " " : "\n");
+
+    for (size_t f = 0; f < num_files; f++)
+        close(fds[f]);
+    free(order);
+    free(cycles);
+    free(bits);
+    free(margins);
     return 0;
 }
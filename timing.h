@@ -0,0 +1,205 @@
+/*
+ * Shared timing primitives for all probe tools
+ *
+ * timing_start()/timing_stop() bracket a timed operation with fenced TSC
+ * reads (rdtscp on the stop side where available) so the probed syscall
+ * cannot be reordered around them. timing_init() must run once at startup:
+ *   - picks the clock source: the TSC, or CLOCK_MONOTONIC_RAW when the TSC
+ *     is trapped (slow to read, e.g. some gVisor platforms) or unstable
+ *     between two calibration windows,
+ *   - calibrates ticks to nanoseconds against CLOCK_MONOTONIC_RAW,
+ *   - measures the start/stop self-overhead that timing_elapsed() removes.
+ *
+ * With the clock fallback every tick is a nanosecond, so fixed thresholds
+ * are kept in ns and turned into ticks with timing_from_ns(). Setting
+ * UB_TIMING=tsc or UB_TIMING=clock in the environment forces a source.
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define TIMING_HAVE_TSC 1
+#else
+#define TIMING_HAVE_TSC 0
+#endif
+
+// Calibration window, done twice to check the TSC rate is stable
+#define TIMING_CALIB_NS (2ULL * 1000ULL * 1000ULL)
+// Relative disagreement between the two windows tolerated
+#define TIMING_MAX_DRIFT 0.005
+// A native rdtsc costs a few tens of ns, a trapped one microseconds
+#define TIMING_TRAP_NS 250.0
+#define TIMING_OVERHEAD_SAMPLES 1000
+
+struct timing_state {
+    bool use_tsc;
+    bool has_rdtscp;
+    double ns_per_tick;
+    uint64_t overhead;
+    const char *source;
+};
+
+static struct timing_state timing = {
+    .use_tsc = TIMING_HAVE_TSC,
+    .ns_per_tick = 1.0,
+    .source = TIMING_HAVE_TSC ? "tsc" : "clock",
+};
+
+static inline uint64_t timing_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t timing_realtime_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#if TIMING_HAVE_TSC
+static inline uint64_t timing_tsc_fenced(void)
+{
+    unsigned lo, hi;
+    __asm__ __volatile__("lfence\n\trdtsc\n\tlfence" : "=a"(lo), "=d"(hi) :: "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t timing_tscp(void)
+{
+    unsigned lo, hi, aux;
+    __asm__ __volatile__("rdtscp\n\tlfence" : "=a"(lo), "=d"(hi), "=c"(aux) :: "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+// Read before the timed operation; earlier work is done, later work waits.
+static inline uint64_t timing_start(void)
+{
+#if TIMING_HAVE_TSC
+    if (timing.use_tsc)
+        return timing_tsc_fenced();
+#endif
+    return timing_monotonic_ns();
+}
+
+// Read after the timed operation; waits for it to retire.
+static inline uint64_t timing_stop(void)
+{
+#if TIMING_HAVE_TSC
+    if (timing.use_tsc)
+        return timing.has_rdtscp ? timing_tscp() : timing_tsc_fenced();
+#endif
+    return timing_monotonic_ns();
+}
+
+// Ticks between a start/stop pair minus the pair's own cost
+static inline uint64_t timing_elapsed(uint64_t start, uint64_t end)
+{
+    uint64_t delta = end - start;
+    return delta > timing.overhead ? delta - timing.overhead : 0;
+}
+
+static inline uint64_t timing_to_ns(uint64_t ticks)
+{
+    return (uint64_t)((double)ticks * timing.ns_per_tick);
+}
+
+static inline uint64_t timing_from_ns(uint64_t ns)
+{
+    return (uint64_t)((double)ns / timing.ns_per_tick);
+}
+
+#if TIMING_HAVE_TSC
+static double timing_calibrate_window(void)
+{
+    uint64_t ns_begin = timing_monotonic_ns();
+    uint64_t tsc_begin = timing_tsc_fenced();
+    uint64_t ns_end;
+
+    do {
+        ns_end = timing_monotonic_ns();
+    } while (ns_end - ns_begin < TIMING_CALIB_NS);
+    uint64_t tsc_end = timing_tsc_fenced();
+
+    if (tsc_end <= tsc_begin)
+        return 0.0;
+    return (double)(ns_end - ns_begin) / (double)(tsc_end - tsc_begin);
+}
+
+// Returns NULL if the TSC is usable, otherwise why it is not.
+static const char *timing_probe_tsc(void)
+{
+    unsigned eax, ebx, ecx, edx;
+
+    if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx))
+        timing.has_rdtscp = (edx >> 27) & 1;
+
+    uint64_t ns_begin = timing_monotonic_ns();
+    for (int i = 0; i < 256; i++)
+        timing_tsc_fenced();
+    double read_ns = (double)(timing_monotonic_ns() - ns_begin) / 256.0;
+    if (read_ns > TIMING_TRAP_NS)
+        return "trapped";
+
+    double first = timing_calibrate_window();
+    double second = timing_calibrate_window();
+    if (first <= 0.0 || second <= 0.0)
+        return "not monotonic";
+    double drift = first > second ? (first - second) / first : (second - first) / second;
+    if (drift > TIMING_MAX_DRIFT)
+        return "unstable";
+
+    timing.ns_per_tick = (first + second) / 2.0;
+    return NULL;
+}
+#endif
+
+static void timing_init(void)
+{
+    const char *force = getenv("UB_TIMING");
+
+    timing.use_tsc = false;
+    timing.ns_per_tick = 1.0;
+    timing.source = "clock";
+
+#if TIMING_HAVE_TSC
+    if (!force || strcmp(force, "clock") != 0) {
+        const char *reason = timing_probe_tsc();
+        if (reason && force && strcmp(force, "tsc") == 0) {
+            // Forced: one more window for the rate, if the TSC counts at all
+            timing.ns_per_tick = timing_calibrate_window();
+            if (timing.ns_per_tick > 0.0)
+                reason = NULL;
+        }
+        if (!reason) {
+            timing.use_tsc = true;
+            timing.source = timing.has_rdtscp ? "rdtscp" : "tsc";
+        } else {
+            timing.ns_per_tick = 1.0;
+            fprintf(stderr, "Warning: TSC %s, timing with CLOCK_MONOTONIC_RAW\n", reason);
+        }
+    }
+#endif
+
+    timing.overhead = UINT64_MAX;
+    for (int i = 0; i < TIMING_OVERHEAD_SAMPLES; i++) {
+        uint64_t start = timing_start();
+        uint64_t end = timing_stop();
+        if (end - start < timing.overhead)
+            timing.overhead = end - start;
+    }
+}
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Binary sample trace
+ *
+ * Raw probe samples (one timed page access each) are appended to a trace
+ * file instead of being printed as text. The file is a sequence of
+ * fixed-size blocks, each a 32-byte header followed by TRACE_BLOCK_SAMPLES
+ * slots per column, column by column:
+ *   uint64 timestamp   CLOCK_REALTIME ns of the sample, or of the probe
+ *                      pass it belongs to
+ *   uint64 cycles      timing ticks of the access (see timing.h)
+ *   uint64 ns          wall time of the access, 0 if not measured
+ *   uint32 page        page index in the file
+ *   uint16 file        file id, see the name blocks
+ *   uint8  label       TRACE_LABEL_*
+ * A sample block holds count valid samples (the last one of each writer
+ * may be partial). A name block (kind TRACE_KIND_NAME, count = file id)
+ * carries the NUL-terminated path of that id in place of the columns;
+ * ids are shared by everyone appending to the same trace: a writer hands
+ * out a new id only under an exclusive flock() of the trace, after reading
+ * the name blocks the others appended, so ids are dense and unique. Should
+ * an id still appear twice (a trace of some other writer), both readers
+ * take its first name block.
+ *
+ * Because every block has the same size and layout the whole file maps as
+ * one array of blocks, see trace_reader.py for the numpy reader. All values are
+ * little endian, i.e. native on the machines we run on.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/file.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_MAGIC "UBTRACE1"
+#define TRACE_BLOCK_SAMPLES 1024
+#define TRACE_MAX_FILES 256
+
+#define TRACE_KIND_SAMPLES 0
+#define TRACE_KIND_NAME 1
+
+#define TRACE_LABEL_COLD 0      // classified as not cached
+#define TRACE_LABEL_HOT 1       // classified as cached
+#define TRACE_LABEL_PRIME 2     // sender access that primes the page
+#define TRACE_LABEL_TAINTED 3   // overlapped interference (see monitor.h), discarded
+#define TRACE_LABEL_NONE 255    // failed access
+
+struct trace_block {
+    char magic[8];
+    uint32_t kind;
+    uint32_t count;
+    uint64_t reserved[2];
+    uint64_t timestamp[TRACE_BLOCK_SAMPLES];
+    uint64_t cycles[TRACE_BLOCK_SAMPLES];
+    uint64_t ns[TRACE_BLOCK_SAMPLES];
+    uint32_t page[TRACE_BLOCK_SAMPLES];
+    uint16_t file[TRACE_BLOCK_SAMPLES];
+    uint8_t label[TRACE_BLOCK_SAMPLES];
+} __attribute__((aligned(8)));
+
+struct trace {
+    int fd;
+    struct trace_block *block;
+    char *names[TRACE_MAX_FILES];
+    size_t num_names;
+    off_t scanned;      // name blocks before this offset are known
+};
+
+static int trace_write_block(struct trace *t, struct trace_block *b)
+{
+    // One write per block, O_APPEND keeps concurrent writers block aligned
+    if (write(t->fd, b, sizeof(*b)) != (ssize_t)sizeof(*b)) {
+        perror("trace write");
+        return -1;
+    }
+    return 0;
+}
+
+// Learn the name blocks appended since the last scan, by anyone.
+static void trace_read_names(struct trace *t)
+{
+    // Only name blocks matter, read the headers and skip the columns
+    char head[offsetof(struct trace_block, timestamp)];
+    uint32_t kind, id;
+
+    for (; pread(t->fd, head, sizeof(head), t->scanned) == (ssize_t)sizeof(head);
+         t->scanned += sizeof(struct trace_block)) {
+        if (memcmp(head, TRACE_MAGIC, 8) != 0) {
+            fprintf(stderr, "Trace: bad block at offset %ld\n", (long)t->scanned);
+            break;
+        }
+        memcpy(&kind, head + offsetof(struct trace_block, kind), sizeof(kind));
+        memcpy(&id, head + offsetof(struct trace_block, count), sizeof(id));
+        if (kind == TRACE_KIND_NAME && id == t->num_names && t->num_names < TRACE_MAX_FILES) {
+            char name[PATH_MAX] = "";
+            pread(t->fd, name, sizeof(name) - 1, t->scanned + sizeof(head));
+            t->names[t->num_names++] = strdup(name);
+        }
+    }
+}
+
+// Open (or create) the trace at path for appending; learns its file ids.
+static int trace_open(struct trace *t, const char *path)
+{
+    memset(t, 0, sizeof(*t));
+    t->block = calloc(1, sizeof(*t->block));
+    t->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (!t->block || t->fd == -1) {
+        fprintf(stderr, "Failed to open trace %s: %s\n", path, strerror(errno));
+        free(t->block);
+        return -1;
+    }
+    trace_read_names(t);
+
+    memcpy(t->block->magic, TRACE_MAGIC, 8);
+    t->block->kind = TRACE_KIND_SAMPLES;
+    return 0;
+}
+
+static int trace_find_name(const struct trace *t, const char *path)
+{
+    for (size_t i = 0; i < t->num_names; i++) {
+        if (strcmp(t->names[i], path) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// File id of path, appending a name block the first time anyone sees it.
+// Exits when all TRACE_MAX_FILES ids are taken.
+static uint16_t trace_file_id(struct trace *t, const char *path)
+{
+    int id = trace_find_name(t, path);
+    if (id >= 0)
+        return id;
+
+    // Other writers may have named it, or taken the next id, since we looked
+    flock(t->fd, LOCK_EX);
+    trace_read_names(t);
+    id = trace_find_name(t, path);
+    if (id >= 0) {
+        flock(t->fd, LOCK_UN);
+        return id;
+    }
+    if (t->num_names == TRACE_MAX_FILES) {
+        fprintf(stderr, "Trace: no file id left for %s, all %d are taken\n", path,
+                TRACE_MAX_FILES);
+        exit(ENOSPC);
+    }
+
+    struct trace_block *b = calloc(1, sizeof(*b));
+    if (b) {
+        memcpy(b->magic, TRACE_MAGIC, 8);
+        b->kind = TRACE_KIND_NAME;
+        b->count = t->num_names;
+        snprintf((char *)b->timestamp, sizeof(*b) - offsetof(struct trace_block, timestamp),
+                 "%s", path);
+        trace_write_block(t, b);
+        free(b);
+    }
+    t->names[t->num_names] = strdup(path);
+    flock(t->fd, LOCK_UN);
+    return t->num_names++;
+}
+
+// Write out the pending samples, if any.
+static void trace_flush(struct trace *t)
+{
+    if (t->block->count == 0)
+        return;
+    trace_write_block(t, t->block);
+    t->block->count = 0;
+}
+
+static inline void trace_add(struct trace *t, uint64_t timestamp, uint16_t file, size_t page,
+                             uint64_t cycles, uint64_t ns, uint8_t label)
+{
+    struct trace_block *b = t->block;
+    uint32_t i = b->count;
+
+    b->timestamp[i] = timestamp;
+    b->cycles[i] = cycles;
+    b->ns[i] = ns;
+    b->page[i] = page;
+    b->file[i] = file;
+    b->label[i] = label;
+    if (++b->count == TRACE_BLOCK_SAMPLES)
+        trace_flush(t);
+}
+
+static void trace_close(struct trace *t)
+{
+    trace_flush(t);
+    close(t->fd);
+    for (size_t i = 0; i < t->num_names; i++)
+        free(t->names[i]);
+    free(t->block);
+    t->num_names = 0;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Zero-copy reader for the binary sample traces written by spy_on,
+receiver_stride and read_page with -T (layout in trace.h).
+
+The file is mapped as an array of fixed-size blocks; per-block column
+slices are views into the mapping, column() concatenates them into one
+array (a single copy, no parsing).
+
+    import trace_reader
+    t = trace_reader.Trace("run.trace")
+    cycles = t.column("cycles")
+    hot = cycles[t.column("label") == trace_reader.LABEL_HOT]
+
+Run as a script it prints per (file, label) cycle statistics. Needs numpy
+(pip install numpy).
+"""
+import argparse
+import os
+import numpy as np
+
+BLOCK_SAMPLES = 1024
+MAGIC = b"UBTRACE1"
+KIND_SAMPLES = 0
+KIND_NAME = 1
+
+LABEL_COLD = 0
+LABEL_HOT = 1
+LABEL_PRIME = 2
+LABEL_TAINTED = 3
+LABEL_NONE = 255
+LABEL_NAMES = {LABEL_COLD: "cold", LABEL_HOT: "hot", LABEL_PRIME: "prime", LABEL_TAINTED: "tainted",
+               LABEL_NONE: "none"}
+
+COLUMNS = ("timestamp", "cycles", "ns", "page", "file", "label")
+
+BLOCK_DTYPE = np.dtype([
+    ("magic", "S8"),
+    ("kind", "<u4"),
+    ("count", "<u4"),
+    ("reserved", "<u8", (2,)),
+    ("timestamp", "<u8", (BLOCK_SAMPLES,)),
+    ("cycles", "<u8", (BLOCK_SAMPLES,)),
+    ("ns", "<u8", (BLOCK_SAMPLES,)),
+    ("page", "<u4", (BLOCK_SAMPLES,)),
+    ("file", "<u2", (BLOCK_SAMPLES,)),
+    ("label", "u1", (BLOCK_SAMPLES,)),
+])
+
+
+class Trace:
+    def __init__(self, path):
+        # A writer may be in the middle of appending the last block
+        num_blocks = os.path.getsize(path) // BLOCK_DTYPE.itemsize
+        if num_blocks:
+            self.blocks = np.memmap(path, dtype=BLOCK_DTYPE, mode="r", shape=(num_blocks,))
+        else:
+            self.blocks = np.zeros(0, dtype=BLOCK_DTYPE)
+
+        bad = np.flatnonzero(self.blocks["magic"] != MAGIC)
+        if bad.size:
+            raise ValueError(f"{path}: bad block {bad[0]}")
+
+        kinds = self.blocks["kind"]
+        self.names = {}
+        for i in np.flatnonzero(kinds == KIND_NAME):
+            raw = self.blocks[i]["timestamp"].tobytes()
+            # The first name block of an id wins, as in trace.h
+            self.names.setdefault(int(self.blocks[i]["count"]), raw.split(b"\0", 1)[0].decode())
+        self.sample_blocks = np.flatnonzero(kinds == KIND_SAMPLES)
+        self.counts = self.blocks["count"][self.sample_blocks].astype(np.int64)
+
+    def __len__(self):
+        return int(self.counts.sum())
+
+    def block_views(self, name):
+        """Zero-copy views of one column, one per sample block."""
+        return [self.blocks[i][name][:n] for i, n in zip(self.sample_blocks, self.counts)]
+
+    def column(self, name):
+        """One column over all samples, in append order."""
+        if name not in COLUMNS:
+            raise KeyError(name)
+        views = self.block_views(name)
+        if not views:
+            return np.zeros(0, dtype=BLOCK_DTYPE[name].base)
+        return np.concatenate(views)
+
+    def columns(self):
+        return {name: self.column(name) for name in COLUMNS}
+
+    def file_id(self, path):
+        """Id of a file by its path (as given to the tool) or basename."""
+        for fid, name in self.names.items():
+            if name == path or os.path.basename(name) == path:
+                return fid
+        raise KeyError(path)
+
+    def select(self, spec, label=None):
+        """Cycle values of "<file>[:<page>]", optionally of one label only."""
+        path, _, page = spec.rpartition(":") if ":" in spec else (spec, "", "")
+        sel = self.column("file") == self.file_id(path)
+        if page:
+            sel &= self.column("page") == int(page)
+        if label is not None:
+            sel &= self.column("label") == label
+        return self.column("cycles")[sel]
+
+
+def load_pair(path, spec0, spec1):
+    """Two equally long cycle series, e.g. for the page 0 / page 1 plots."""
+    t = Trace(path)
+    page0, page1 = t.select(spec0), t.select(spec1)
+    n = min(page0.size, page1.size)
+    return page0[:n].astype(np.float64), page1[:n].astype(np.float64)
+
+
+def main():
+    p = argparse.ArgumentParser(description="Summarize a binary sample trace")
+    p.add_argument("trace", help="trace file written with -T")
+    args = p.parse_args()
+
+    t = Trace(args.trace)
+    cols = t.columns()
+    print(f"{len(t)} samples in {len(t.sample_blocks)} blocks, {len(t.names)} files")
+    print("file,label,samples,mean_cycles,p50_cycles,p99_cycles,mean_ns")
+    for fid in np.unique(cols["file"]):
+        for label in np.unique(cols["label"][cols["file"] == fid]):
+            sel = (cols["file"] == fid) & (cols["label"] == label)
+            cycles = cols["cycles"][sel]
+            print(f"{t.names.get(int(fid), fid)},{LABEL_NAMES.get(int(label), label)},{cycles.size},"
+                  f"{cycles.mean():.1f},{np.percentile(cycles, 50):.0f},"
+                  f"{np.percentile(cycles, 99):.0f},{cols['ns'][sel].mean():.1f}")
+
+
+if __name__ == "__main__":
+    main()
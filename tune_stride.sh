@@ -0,0 +1,63 @@
+#!/bin/bash
+# Find the smallest page stride that still decodes cleanly on this runtime
+# and filesystem.
+#
+# Usage: ./tune_stride.sh [file] [num_bits] [repetitions] [max_ber] [calib_prefix]
+#
+# Sweeps STRIDES (override from the environment, default "1 2 4 8 16 32")
+# with sender/receiver in dense mode (-d, readahead suppressed). Every
+# repetition evicts the page cache and sends a fresh random pattern. Prints
+# one CSV row per (stride, repetition), the BER and per-file capacity per
+# stride, and the smallest stride whose BER is at most max_ber. The spare
+# pages, and so the threshold, differ per stride: each stride calibrates into
+# calib_prefix.<stride>.calib of its own.
+
+TARGET_FILE=${1:-/workspace/rand0.bin}
+NUM_BITS=${2:-512}
+REPETITIONS=${3:-5}
+MAX_BER=${4:-0}
+CALIB_PREFIX=${5:-/tmp/tune_stride}
+STRIDES=${STRIDES:-"1 2 4 8 16 32"}
+PAGE_SIZE=$(getconf PAGESIZE)
+FILE_PAGES=$(( ($(stat -c %s $TARGET_FILE) + PAGE_SIZE - 1) / PAGE_SIZE ))
+
+set -e
+
+. "$(dirname "$0")/lib_bench.sh"
+
+bench_results
+
+echo "stride,repetition,num_bits,bit_errors,wall_ns"
+
+for stride in $STRIDES; do
+    for rep in $(seq 1 $REPETITIONS); do
+        PATTERN=$(random_pattern $NUM_BITS)
+
+        evict $TARGET_FILE
+        begin=$(date +%s%N)
+        LD_BIND_NOW=1 ./sender_stride -d $TARGET_FILE $PATTERN $stride > /dev/null
+        out=$(LD_BIND_NOW=1 ./receiver_stride -d -c $CALIB_PREFIX.$stride.calib $TARGET_FILE $NUM_BITS 0 $stride)
+        end=$(date +%s%N)
+
+        errors=$(bit_errors "$PATTERN" "$(received_bits "$out")")
+
+        echo "$stride,$rep,$NUM_BITS,$errors,$((end - begin))" | tee -a $RESULTS
+    done
+done
+
+awk -F, -v max_ber=$MAX_BER -v file_pages=$FILE_PAGES '
+    { bits[$1] += $3; errs[$1] += $4; if (!($1 in seen)) { seen[$1] = 1; order[n++] = $1 } }
+    END {
+        best = ""
+        for (i = 0; i < n; i++) {
+            s = order[i]
+            ber = errs[s] / bits[s]
+            printf "# stride %s: BER %.4f, %d bits per file\n", s, ber, int(file_pages / s)
+            if (ber <= max_ber && (best == "" || s + 0 < best + 0))
+                best = s
+        }
+        if (best == "")
+            printf "# no stride reached BER <= %s\n", max_ber
+        else
+            printf "# smallest stride with BER <= %s: %s\n", max_ber, best
+    }' $RESULTS